@@ -34,9 +34,10 @@ WRITE_PERIOD                = 0.1
 # Messages
 CONFIRMATION_MSG             = 'Ready'
 
-# Images
+# Images, resolution profile of the firmware (mod_img_processing.h)
 IM_LENGTH_PX                = 100
 IM_HEIGHT_PX                = 90
+EDGE_MAP_ROW_BITS           = 32*((IM_LENGTH_PX + 31)//32) # rows of the edge maps (edge_map.h)
 IMG_PATH                    = "C:/Users/41786/Desktop/Projects/BA-6/SE/epuck-artist/img/"
 
 # Sobel
@@ -71,6 +72,13 @@ COMMANDS = (
     'I'     ,   # IMAGE
     'H'     ,   # HOME
     'V'     ,   # VALIDATE
+    'T'     ,   # TELEMETRY
+    'M'     ,   # MOSAIC (tiled image)
+    'A'     ,   # ACCUMULATE (frames averaged by a capture)
+    'F'     ,   # FLAT (outlines of the color regions)
+    'L'     ,   # LENGTH (minimum stroke length)
+    'W'     ,   # WATCH (start the live preview)
+    'X'     ,   # STOP THE LIVE PREVIEW
 )
 
 # associate an index to each command
@@ -84,21 +92,37 @@ CMD_INDEX = {
     'D' : 6    ,   
     'I' : 7    ,   
     'H' : 8    , 
-    'V' : 9    
+    'V' : 9    ,
+    'T' : 10   ,
+    'M' : 11   ,
+    'A' : 12   ,
+    'F' : 13   ,
+    'L' : 14   ,
+    'W' : 15   ,
+    'X' : 16
 }
 
 CMD_HEADER = [b'' for x in range(len(COMMANDS))]
 CMD_HEADER[CMD_INDEX['V']] = b'LEN'
 CMD_HEADER[CMD_INDEX['G']] = b'MOVE'
+CMD_HEADER[CMD_INDEX['T']] = b'TEL'
+CMD_HEADER[CMD_INDEX['A']] = b'AVG'
+CMD_HEADER[CMD_INDEX['L']] = b'LEN'
 
 # commands that need a second argument
 COMMANDS_TWO_ARGS = (
     'V'     ,   # VALIDATE
+    'T'     ,   # TELEMETRY
+    'A'     ,   # ACCUMULATE
+    'L'     ,   # LENGTH
 )
 
 # associate a command to an index in the SECOND_ARG_LIMIT matrix
 CMD_TWO_ARGS_INDEX = {
-    'V' : 0
+    'V' : 0    ,
+    'T' : 1    ,
+    'A' : 2    ,
+    'L' : 3
 }
 
 # create a matrix of size len(COMMANDS_TWO_ARG) x 2
@@ -106,7 +130,10 @@ CMD_TWO_ARGS_INDEX = {
 SECOND_ARG_LIMIT = [0 for x in range(2) for y in range(len(COMMANDS_TWO_ARGS))]
 
 # assign lower and upper bounds
-SECOND_ARG_LIMIT[CMD_TWO_ARGS_INDEX['V']] = [0, 150] # in mm
+SECOND_ARG_LIMIT[CMD_TWO_ARGS_INDEX['V']] = [1, 149] # in mm
+SECOND_ARG_LIMIT[CMD_TWO_ARGS_INDEX['T']] = [0, 2]   # 0: none, 1: edges only, 2: all images
+SECOND_ARG_LIMIT[CMD_TWO_ARGS_INDEX['A']] = [1, 16]  # frames averaged by a capture
+SECOND_ARG_LIMIT[CMD_TWO_ARGS_INDEX['L']] = [0, 20]  # minimum stroke length in px (0: no pruning)
 
 # ========================================================================== #
 #  Module local functions.                                                   # 
@@ -222,6 +249,36 @@ def receive_data(ser_epuck, ser_arduino):
                 elif "canny" in msg:
                     img_name = "canny"
 
+            elif "thresholds" in msg:
+                # max gradient, high and low thresholds (uint16, L2 norm of the gradient)
+                thr = np.frombuffer(output_buffer, dtype=np.uint16)
+                print("Canny thresholds: high %d, low %d (max gradient %d)" % (thr[1], thr[2], thr[0]))
+
+            elif "pruning" in msg:
+                # contours traced and removed (uint16), drawing time saved (uint32, ms)
+                cnt = np.frombuffer(output_buffer[0:4], dtype=np.uint16)
+                saved = np.frombuffer(output_buffer[4:8], dtype=np.uint32)
+                print("Pruning: %d of %d contours removed, %.1f s of drawing saved"
+                      % (cnt[1], cnt[0], saved[0]/1000.0))
+
+            elif "ordering" in msg:
+                # contours and moves of the improvement (uint16), pen up travel before and
+                # after (uint32, canvas px), drawing time saved and predicted (uint32, ms),
+                # pen changes (uint16)
+                cnt = np.frombuffer(output_buffer[0:4], dtype=np.uint16)
+                travel = np.frombuffer(output_buffer[4:20], dtype=np.uint32)
+                changes = np.frombuffer(output_buffer[20:22], dtype=np.uint16)
+                print("Ordering: %d contours, pen up travel %d -> %d px (%d moves), %.1f s of drawing saved"
+                      % (cnt[0], travel[0], travel[1], cnt[1], travel[2]/1000.0))
+                print("Drawing: %d pen changes, %.1f s predicted" % (changes[0], travel[3]/1000.0))
+
+            elif "preview" in msg:
+                # edge map, 1 bit per pixel in little endian 32-bit words, rows padded to whole words
+                bits = np.unpackbits(np.frombuffer(output_buffer, dtype=np.uint8), bitorder='little')
+                edges = bits.reshape(IM_HEIGHT_PX, EDGE_MAP_ROW_BITS)[:, :IM_LENGTH_PX]*255
+                img = Image.fromarray(edges.astype(np.uint8), "L")
+                img_name = "preview"
+
             elif "sobel" in msg:
                 img_buffer = bytearray(2*len(output_buffer))
                 for i in range (0, length-1):
@@ -249,9 +306,11 @@ def receive_data(ser_epuck, ser_arduino):
                 img = Image.frombytes("RGB", (IM_LENGTH_PX, IM_HEIGHT_PX), bytes(img_buffer), "raw", "BGR;16")
                 img_name = "sobel"
 
-            if ("color" not in msg):
+            if img_name != '':
                 img.save(IMG_PATH + img_name + ".png", "PNG")
-        time.sleep(0.5)
+        # the preview frames are received as fast as the link allows
+        if "preview" not in msg:
+            time.sleep(0.5)
 
 # @brief                    Creates svg file from x, y and color buffers
 # @param[in]   x_buffer     Path x-coordinate buffer
@@ -353,7 +412,7 @@ def send_command(ser, command):
                 upper_bound = SECOND_ARG_LIMIT[CMD_TWO_ARGS_INDEX[command]][1]
                 second_arg = np.uint8(input("Enter an integer between %d and %d: "
                 % (lower_bound, upper_bound)))
-                if (lower_bound < second_arg <  upper_bound):
+                if (lower_bound <= second_arg <= upper_bound):
                     pass
                 else:
                     print("Second argument must be between %d and %d: "
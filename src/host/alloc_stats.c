@@ -0,0 +1,121 @@
+/**
+ * @file    alloc_stats.c
+ * @brief   Counting wrappers around the C heap for the host benchmark.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Module headers
+
+#include <alloc_stats.h>
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+// Stored in front of each block to know its size when it is freed
+typedef union alloc_header {
+	size_t size;
+	max_align_t align;
+} alloc_header;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static alloc_stats stats;
+
+/*===========================================================================*/
+/* Real allocator (provided by the linker).                                  */
+/*===========================================================================*/
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size);
+void* __wrap_calloc(size_t nmemb, size_t size);
+void* __wrap_realloc(void* ptr, size_t size);
+void __wrap_free(void* ptr);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Accounts for a change of live bytes
+ * @param[in]   added   bytes allocated
+ * @param[in]   removed bytes released
+ * @return              none
+ */
+static void account(size_t added, size_t removed)
+{
+	stats.live_bytes += added;
+	stats.live_bytes -= removed;
+	if (stats.live_bytes > stats.peak_bytes)
+		stats.peak_bytes = stats.live_bytes;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+void* __wrap_malloc(size_t size)
+{
+	alloc_header* header = __real_malloc(sizeof(alloc_header) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	++stats.allocs;
+	account(size, 0);
+	return header + 1;
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+	void* ptr = __wrap_malloc(nmemb*size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb*size);
+	return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	if (ptr == NULL)
+		return __wrap_malloc(size);
+
+	alloc_header* header = (alloc_header*)ptr - 1;
+	size_t old_size = header->size;
+	header = __real_realloc(header, sizeof(alloc_header) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	++stats.allocs;
+	account(size, old_size);
+	return header + 1;
+}
+
+void __wrap_free(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+	alloc_header* header = (alloc_header*)ptr - 1;
+	account(0, header->size);
+	__real_free(header);
+}
+
+void alloc_stats_mark(void)
+{
+	stats.allocs = 0;
+	stats.peak_bytes = stats.live_bytes;
+}
+
+alloc_stats alloc_stats_get(void)
+{
+	return stats;
+}
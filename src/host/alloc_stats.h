@@ -0,0 +1,43 @@
+/**
+ * @file    alloc_stats.h
+ * @brief   Heap usage statistics of the host benchmark.
+ * @note    malloc, calloc, realloc and free are wrapped at link time
+ *          (-Wl,--wrap) so that the pipeline code is measured unchanged.
+ */
+
+#ifndef _ALLOC_STATS_H_
+#define _ALLOC_STATS_H_
+
+// C standard header files
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef struct alloc_stats {
+	uint32_t allocs;        // number of allocations since last mark
+	size_t peak_bytes;      // highest number of live bytes since last mark
+	size_t live_bytes;      // number of live bytes
+} alloc_stats;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               Starts a new measurement window: resets the
+ *                      allocation count and sets the peak to the live bytes.
+ * @return              none
+ */
+void alloc_stats_mark(void);
+
+/**
+ * @brief               Returns the statistics of the current window
+ * @return              Allocation statistics
+ */
+alloc_stats alloc_stats_get(void);
+
+#endif /* _ALLOC_STATS_H_ */
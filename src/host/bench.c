@@ -0,0 +1,1096 @@
+/**
+ * @file    bench.c
+ * @brief   Host benchmark of the image to path pipeline.
+ * @details Runs canny_edge() and planner_path() on recorded frames and
+ *          reports, for each stage, the wall time, the number of arena
+ *          allocations and the peak arena usage. The arena is reset before
+ *          each run (each mosaic with -t), the peak of a run is checked
+ *          against the budget (ARENA_SIZE) and the heap allocations left
+ *          (path and color buffers of mod_data) are counted.
+ *
+ *          Before the frames, the scalar and SIMD implementations of the
+ *          gaussian filter are checked against a direct 5x5 convolution and
+ *          their cost in cycles per pixel is reported. The nearest
+ *          neighbour ordering of the contours by grid (path_order_nearest) is
+ *          checked against the scan of all the contours on random short
+ *          contours and both are timed. The pipeline then runs on frames
+ *          that exceed the arena budget (color blocks of BLOCK_PX pixels,
+ *          single frame and tiled, and a black and white checkerboard of 1
+ *          pixel, edges and regions), it has to give up on their edges or
+ *          contours without crashing.
+ *
+ *          usage: bench [-n runs] [-s] [-r] [-t] [-a] [-l] [-p length] [-o budget] [-d groups] [-f] frame...
+ *          -s uses the streaming Canny engine (canny_edge_stream)
+ *          -r region mode: the outlines of the color regions replace the
+ *             edges (canny_segment_regions), single frames only
+ *          -t tiled capture: the frame is loaded at the mosaic size and cut
+ *             into NB_TILES overlapping tiles, the tiles are processed one
+ *             after the other and their contours stitched (planner_mosaic_*)
+ *          -a multi-frame capture: sensor noise is added to the frame and
+ *             the number of contours is reported for 1 to
+ *             MAX_ACCUMULATED_FRAMES averaged noisy frames (canny_accumulate)
+ *          -l lighting: the frame is dimmed down to a quarter of its levels
+ *             and the contours and adaptive thresholds are reported for
+ *             each exposure
+ *          -p minimum stroke length in pixels (planner_set_min_stroke), the
+ *             report gives the contours pruned and the drawing time saved
+ *          -o time allowed in ms to the improvement of the order of the
+ *             contours (planner_set_ordering), 0 keeps the nearest neighbour
+ *             order. Without it, the order is improved until no move
+ *             shortens it, so that the paths do not depend on the timing.
+ *          -d row streaming: the frame is delivered in row groups by the
+ *             DCMI stand-in (frame_feed), the rows are processed as they land
+ *             (canny_stream_rows) and the time from the last row group to the
+ *             edges is reported against the processing of the whole frame
+ *          -f fidelity: the path is rasterized back onto the image and
+ *             compared with the edge map by chamfer distance
+ *             (fidelity_measure), for several tolerances of the contour
+ *             simplification (planner_set_simplification), single frames
+ *             only
+ *
+ *          The edges are thinned before the tracing (planner_set_thinning),
+ *          the report gives the pixels thinned out and the path points and
+ *          draw length saved against a run without thinning.
+ *
+ *          The ordering line gives the pen up travel of the nearest
+ *          neighbour order and of the improved order, with the pen up moves
+ *          measured on the path itself (rounded to the canvas pixels).
+ *
+ *          The contours are grouped by color (planner_set_color_grouping),
+ *          the colors line gives the pen changes and the drawing time
+ *          predicted by the planner against an order that ignores the
+ *          colors.
+ *
+ *          The tracing line gives the contours and points traced, the
+ *          moves of the tracer from a pixel to a neighbour (both walks of
+ *          each contour) per us of the tracing stage and the bytes of the
+ *          contour store (chain codes and records) per point traced.
+ *
+ *          The edge hash is the hash of the edge image produced by the
+ *          hysteresis (by the region segmentation with -r). The popcount
+ *          of the edge map is checked against the edge image and against
+ *          the pixels of the edge components.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Module headers
+
+#include <canny.h>
+#include <edge_map.h>
+#include <gaussian.h>
+#include <planner.h>
+#include <path_order.h>
+#include <tools.h>
+#include <mod_data.h>
+#include <mod_img_processing.h>
+#include <frame_io.h>
+#include <frame_feed.h>
+#include <fidelity.h>
+#include <alloc_stats.h>
+#include <arena.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define DEFAULT_RUNS       100
+
+#define FRAME_SIZE         (IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint16_t))
+#define EDGE_SIZE          (IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t))
+#define MOSAIC_SIZE        (MOSAIC_LENGTH_PX*MOSAIC_HEIGHT_PX*sizeof(uint16_t))
+
+// Odd sizes exercise the remainder loops of the SIMD implementation
+#define ODD_LENGTH_PX      37
+#define ODD_HEIGHT_PX      11
+#define GAUSS_SEED         1
+
+// Sensor noise of the multi-frame capture, triangular distribution of
+// +/- 2*NOISE_AMPLITUDE levels (8-bit scale) on each channel
+#define NOISE_AMPLITUDE    20
+#define NOISE_SEED         7
+
+// Row streaming: time between two row groups delivered by the DCMI stand-in
+#define ROW_GROUP_US       1000
+#define ROW_BYTES          (IM_LENGTH_PX*sizeof(uint16_t))
+
+// Exposures of the lighting report, in percent of the levels of the frame
+static const uint8_t exposures[] = {100, 70, 50, 35, 25};
+
+// Tolerances of the contour simplification compared by the fidelity report,
+// the defaults of the planner among them
+static const struct {
+	float perp_dist;
+	uint8_t pixel_dist;
+} simplifications[] = {
+	{0.5f, 2}, {MAX_PERP_DIST, MAX_PIXEL_DIST}, {1.5f, 4}, {2.5f, 6}
+};
+
+// Ordering check: random short contours over the image, their extremities
+// at most ORDER_SPAN_PX apart
+#define ORDER_SEED         3
+#define ORDER_SPAN_PX      6
+#define ORDER_MAX_CONTOURS 512
+static const uint16_t order_sizes[] = {32, 128, ORDER_MAX_CONTOURS};
+
+// Arena budget check: frames whose edges do not fit in the arena, the
+// pipeline has to give up on them without crashing
+#define BLOCK_PX           3
+static const uint16_t block_colors[] = {0xF800, 0x07E0, 0x001F, 0x0000, 0xFFFF};
+
+#define FNV_OFFSET         2166136261u
+#define FNV_PRIME          16777619u
+
+static const char* const stage_names[NB_STAGES] = {
+	"grayscale", "gauss", "sobel", "nms", "hysteresis", "regions", "thinning",
+	"tracing", "pruning", "optimization", "ordering"
+};
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef void (*hpass_func)(const uint8_t* in, uint16_t* out, uint16_t width);
+typedef void (*vpass_func)(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                           uint8_t* out, uint16_t width);
+
+typedef struct stage_report {
+	uint64_t time_ns;       // accumulated over all runs
+	uint32_t runs;          // number of runs in which the stage completed
+	uint32_t allocs;        // arena allocations of the last run
+	size_t peak_bytes;      // highest arena usage over all runs
+} stage_report;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static stage_report report[NB_STAGES];
+static uint64_t stage_start_ns;
+
+// not on the heap, like the camera buffer on the e-puck
+static uint8_t frame[FRAME_SIZE];
+static uint8_t image[FRAME_SIZE];
+static uint8_t mosaic[MOSAIC_SIZE];
+static edge_map edges;
+
+// gaussian filter check
+static uint8_t gauss_in[EDGE_SIZE];
+static uint8_t gauss_ref[EDGE_SIZE];
+static uint8_t gauss_out[EDGE_SIZE];
+static uint16_t gauss_hpass[IM_LENGTH_PX*IM_HEIGHT_PX];
+
+// ordering check
+static edge_pos order_in[2*ORDER_MAX_CONTOURS];
+static edge_pos order_ref[2*ORDER_MAX_CONTOURS];
+static edge_pos order_out[2*ORDER_MAX_CONTOURS];
+static uint8_t order_ref_status[2*ORDER_MAX_CONTOURS];
+static uint8_t order_status[2*ORDER_MAX_CONTOURS];
+
+static bool use_stream = false;
+static bool use_regions = false;
+static bool use_tiles = false;
+static bool use_accumulation = false;
+static bool use_lighting = false;
+static uint8_t nb_row_groups = 0;
+static bool use_fidelity = false;
+static uint8_t* color_buffer;
+static uint32_t color_hash;
+static uint32_t nb_edge_components;
+
+// edges of the frame or of all the tiles, before the planner modifies them
+static uint32_t edge_hash;
+static uint32_t edge_pixels;
+static bool edge_count_ok;
+
+// edge map of the frame before the planner modifies it
+static edge_map canny_edges;
+
+// edge pixels left by the thinning (of all the tiles)
+static uint32_t thin_pixels;
+
+// arena and heap usage of a whole run
+static size_t arena_peak_bytes;
+static uint32_t arena_failures;
+static uint32_t heap_allocs;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                returns a monotonic timestamp
+ * @return               time in ns
+ */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief                clock of the ordering budget (planner_set_ordering)
+ * @return               time in ms
+ */
+static uint32_t now_ms(void)
+{
+	return now_ns()/1000000u;
+}
+
+/**
+ * @brief                returns a cycle counter (time stamp counter on x86,
+ *                       ns elsewhere)
+ * @return               cycles
+ */
+static uint64_t now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return now_ns();
+#endif
+}
+
+/**
+ * @brief                FNV-1a hash, used to compare outputs between builds
+ * @return               updated hash
+ */
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/**
+ * @brief                stage hook: closes the measurement of a stage and
+ *                       opens the next one
+ */
+static void bench_hook(pipeline_stage stage, uint8_t* data, uint16_t size)
+{
+	(void)data;
+	(void)size;
+	uint64_t now = now_ns();
+	arena_stats stats = arena_get_stats();
+
+	report[stage].time_ns += now - stage_start_ns;
+	++report[stage].runs;
+	report[stage].allocs = stats.allocs;
+	if (stats.peak_bytes > report[stage].peak_bytes)
+		report[stage].peak_bytes = stats.peak_bytes;
+
+	if (stage == STAGE_HYSTERESIS || stage == STAGE_REGIONS) {
+		const edge_component* components;
+		uint16_t nb_components = canny_components(&components);
+		uint32_t component_pixels = 0;
+		for (uint16_t i = 0; i < nb_components; ++i)
+			component_pixels += components[i].nb_pixels;
+		uint32_t image_pixels = 0;
+		for (uint32_t i = 0; i < size; ++i)
+			image_pixels += (data[i] != 0);
+		uint16_t map_pixels = edge_map_count(&edges);
+		if (map_pixels != image_pixels || map_pixels != component_pixels)
+			edge_count_ok = false;
+
+		color_hash = fnv1a(use_tiles ? color_hash : FNV_OFFSET, color_buffer, EDGE_SIZE);
+		edge_hash = fnv1a(use_tiles ? edge_hash : FNV_OFFSET, data, size);
+		edge_pixels = (use_tiles ? edge_pixels : 0) + map_pixels;
+		nb_edge_components += nb_components;
+		canny_edges = edges;
+	}
+	if (stage == STAGE_THINNING)
+		thin_pixels = (use_tiles ? thin_pixels : 0) + edge_map_count(&edges);
+
+	arena_mark();
+	stage_start_ns = now_ns();
+}
+
+/**
+ * @brief                reference gaussian filter: direct 5x5 convolution
+ *                       with the outer product of [1 4 6 4 1]
+ */
+static void gaussian_reference(const uint8_t* in, uint8_t* out, uint16_t width,
+                               uint16_t height)
+{
+	static const uint8_t ker[GAUSSIAN_TAPS] = {1, 4, 6, 4, 1};
+	for (uint16_t y = 0; y < height; ++y) {
+		for (uint16_t x = 0; x < width; ++x) {
+			if (x < GAUSSIAN_RADIUS || x + GAUSSIAN_RADIUS >= width
+			    || y < GAUSSIAN_RADIUS || y + GAUSSIAN_RADIUS >= height) {
+				out[x + y*width] = in[x + y*width];
+				continue;
+			}
+			uint32_t conv = 0;
+			for (uint8_t j = 0; j < GAUSSIAN_TAPS; ++j) {
+				for (uint8_t i = 0; i < GAUSSIAN_TAPS; ++i) {
+					conv += ker[i]*ker[j]*in[x + i - GAUSSIAN_RADIUS
+					                          + (y + j - GAUSSIAN_RADIUS)*width];
+				}
+			}
+			out[x + y*width] = (conv + 128) >> 8;
+		}
+	}
+}
+
+/**
+ * @brief                gaussian filter of a whole image with the given passes
+ */
+static void gaussian_frame(hpass_func hpass, vpass_func vpass, const uint8_t* in,
+                           uint8_t* out, uint16_t width, uint16_t height)
+{
+	for (uint16_t y = 0; y < height; ++y)
+		hpass(&in[y*width], &gauss_hpass[y*width], width);
+	for (uint16_t y = 0; y < height; ++y) {
+		if (y < GAUSSIAN_RADIUS || y + GAUSSIAN_RADIUS >= height) {
+			memcpy(&out[y*width], &in[y*width], width);
+			continue;
+		}
+		const uint16_t* h[GAUSSIAN_TAPS];
+		for (uint8_t i = 0; i < GAUSSIAN_TAPS; ++i)
+			h[i] = &gauss_hpass[(y + i - GAUSSIAN_RADIUS)*width];
+		vpass(h, &in[y*width], &out[y*width], width);
+	}
+}
+
+/**
+ * @brief                compares both gaussian implementations to the
+ *                       reference on random and saturated images, then
+ *                       measures them
+ * @return               true if both implementations are exact
+ */
+static bool gaussian_check(uint32_t runs)
+{
+	static const hpass_func hpass[] = {gaussian_hpass_scalar, gaussian_hpass_simd};
+	static const vpass_func vpass[] = {gaussian_vpass_scalar, gaussian_vpass_simd};
+	static const char* const names[] = {"scalar", "simd"};
+	static const uint16_t sizes[][2] = {{IM_LENGTH_PX, IM_HEIGHT_PX},
+	                                    {ODD_LENGTH_PX, ODD_HEIGHT_PX}};
+	bool exact = true;
+
+	srand(GAUSS_SEED);
+	for (uint8_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+		uint16_t width = sizes[s][0];
+		uint16_t height = sizes[s][1];
+		for (uint8_t pattern = 0; pattern < 3; ++pattern) {
+			for (uint32_t i = 0; i < (uint32_t)width*height; ++i)
+				gauss_in[i] = pattern == 0 ? rand() : pattern == 1 ? 255 : 0;
+			gaussian_reference(gauss_in, gauss_ref, width, height);
+			for (uint8_t impl = 0; impl < 2; ++impl) {
+				gaussian_frame(hpass[impl], vpass[impl], gauss_in, gauss_out,
+				               width, height);
+				if (memcmp(gauss_out, gauss_ref, (size_t)width*height) != 0) {
+					printf("gaussian %s: mismatch (%ux%u, pattern %u)\n",
+					       names[impl], width, height, pattern);
+					exact = false;
+				}
+			}
+		}
+	}
+
+	printf("gaussian filter (%dx%d, %u runs)\n", IM_LENGTH_PX, IM_HEIGHT_PX, runs);
+	for (uint8_t impl = 0; impl < 2; ++impl) {
+		uint64_t start = now_cycles();
+		for (uint32_t i = 0; i < runs; ++i)
+			gaussian_frame(hpass[impl], vpass[impl], gauss_in, gauss_out,
+			               IM_LENGTH_PX, IM_HEIGHT_PX);
+		uint64_t cycles = now_cycles() - start;
+		printf("  %-14s %8.2f cycles/px%s\n", names[impl],
+		       (double)cycles/runs/(IM_LENGTH_PX*IM_HEIGHT_PX),
+		       impl == GAUSSIAN_USE_SIMD ? " (used)" : "");
+	}
+	printf("  %s\n\n", exact ? "exact" : "NOT EXACT");
+	return exact;
+}
+
+/**
+ * @brief                compares the grid ordering of the contours to the
+ *                       scan of all of them on random contours, then
+ *                       measures both
+ * @return               true if the orders are identical
+ */
+static bool ordering_check(uint32_t runs)
+{
+	cartesian_coord from = {IM_LENGTH_PX/2, 0};
+	bool identical = true;
+
+	srand(ORDER_SEED);
+	printf("nearest neighbour ordering (%dx%d, %u runs)\n", IM_LENGTH_PX, IM_HEIGHT_PX, runs);
+	printf("  %-14s %12s %12s\n", "contours", "scan [us]", "grid [us]");
+	for (uint8_t s = 0; s < sizeof(order_sizes)/sizeof(order_sizes[0]); ++s) {
+		uint16_t size_edges = 2*order_sizes[s];
+		for (uint16_t i = 0; i < size_edges; i += 2) {
+			order_in[i].pos.x = rand() % IM_LENGTH_PX;
+			order_in[i].pos.y = rand() % IM_HEIGHT_PX;
+			int16_t x = order_in[i].pos.x + rand() % (2*ORDER_SPAN_PX + 1) - ORDER_SPAN_PX;
+			int16_t y = order_in[i].pos.y + rand() % (2*ORDER_SPAN_PX + 1) - ORDER_SPAN_PX;
+			order_in[i+1].pos.x = x < 0 ? 0 : x >= IM_LENGTH_PX ? IM_LENGTH_PX - 1 : x;
+			order_in[i+1].pos.y = y < 0 ? 0 : y >= IM_HEIGHT_PX ? IM_HEIGHT_PX - 1 : y;
+			order_in[i].index = order_in[i+1].index = i/2;
+		}
+
+		uint64_t start = now_ns();
+		for (uint32_t r = 0; r < runs; ++r) {
+			memcpy(order_ref, order_in, size_edges*sizeof(edge_pos));
+			path_order_nearest_scan(order_ref, order_ref_status, size_edges, from);
+		}
+		uint64_t scan_ns = now_ns() - start;
+
+		arena_reset();
+		start = now_ns();
+		for (uint32_t r = 0; r < runs; ++r) {
+			memcpy(order_out, order_in, size_edges*sizeof(edge_pos));
+			if (!path_order_nearest(order_out, order_status, size_edges, from))
+				identical = false;
+		}
+		uint64_t grid_ns = now_ns() - start;
+
+		for (uint16_t i = 0; i < size_edges; i += 2) {
+			if (order_out[i].index != order_ref[i].index
+			    || order_out[i].pos.x != order_ref[i].pos.x
+			    || order_out[i].pos.y != order_ref[i].pos.y
+			    || order_status[i] != order_ref_status[i])
+				identical = false;
+		}
+		printf("  %-14u %12.1f %12.1f\n", order_sizes[s], scan_ns/1000.0/runs,
+		       grid_ns/1000.0/runs);
+	}
+	printf("  %s\n\n", identical ? "identical" : "NOT IDENTICAL");
+	return identical;
+}
+
+/**
+ * @brief                runs the whole pipeline once on a copy of frame
+ * @return               length of the path
+ */
+static uint16_t run_pipeline(void)
+{
+	memcpy(image, frame, FRAME_SIZE);
+	data_free();
+	nb_edge_components = 0;
+
+	arena_reset();
+	alloc_stats_mark();
+	arena_mark();
+	stage_start_ns = now_ns();
+
+	color_buffer = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
+	if (use_regions)
+		canny_segment_regions(image, color_buffer, &edges, bench_hook);
+	else if (use_stream)
+		canny_edge_stream(image, NULL, color_buffer, &edges, bench_hook);
+	else
+		canny_edge(image, NULL, color_buffer, &edges, bench_hook);
+	return planner_path(&edges, color_buffer, bench_hook);
+}
+
+/**
+ * @brief                runs the tiled pipeline once on the tiles of mosaic
+ * @return               length of the path
+ */
+static uint16_t run_pipeline_tiled(void)
+{
+	data_free();
+	arena_reset();
+	planner_mosaic_begin();
+	color_hash = FNV_OFFSET;
+	nb_edge_components = 0;
+	edge_hash = FNV_OFFSET;
+	edge_pixels = 0;
+	thin_pixels = 0;
+
+	alloc_stats_mark();
+	arena_mark();
+	for (uint8_t tile_y = 0; tile_y < TILES_Y; ++tile_y) {
+		for (uint8_t tile_x = 0; tile_x < TILES_X; ++tile_x) {
+			// the camera delivers the tile window of the mosaic
+			for (uint16_t y = 0; y < IM_HEIGHT_PX; ++y) {
+				uint32_t src = (tile_y*TILE_STEP_Y + y)*MOSAIC_LENGTH_PX
+				               + tile_x*TILE_STEP_X;
+				memcpy(&image[y*IM_LENGTH_PX*sizeof(uint16_t)],
+				       &mosaic[src*sizeof(uint16_t)],
+				       IM_LENGTH_PX*sizeof(uint16_t));
+			}
+			stage_start_ns = now_ns();
+
+			color_buffer = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
+			if (use_stream)
+				canny_edge_stream(image, NULL, color_buffer, &edges, bench_hook);
+			else
+				canny_edge(image, NULL, color_buffer, &edges, bench_hook);
+
+			planner_mosaic_add(&edges, color_buffer, tile_x, tile_y, bench_hook);
+			data_free_color();
+		}
+	}
+	return planner_mosaic_path(bench_hook);
+}
+
+/**
+ * @brief                number of contours of the path in mod_data, each of
+ *                       them starts with a pen up move
+ */
+static uint16_t count_contours(uint16_t path_length)
+{
+	const uint8_t* color = data_get_color();
+	uint16_t nb_contours = 0;
+	for (uint16_t i = 1; i < path_length; ++i)
+		nb_contours += (color[i] == white);
+	return nb_contours;
+}
+
+/**
+ * @brief                length of the pen down moves of the path in
+ *                       mod_data (canvas pixels)
+ */
+static double draw_length(uint16_t path_length)
+{
+	const cartesian_coord* pos = data_get_pos();
+	const uint8_t* color = data_get_color();
+	double length = 0;
+	for (uint16_t i = 1; i < path_length; ++i) {
+		if (color[i] != white)
+			length += two_point_distance(pos[i-1], pos[i]);
+	}
+	return length;
+}
+
+/**
+ * @brief                length of the pen up moves of the path in mod_data
+ *                       (canvas pixels)
+ */
+static double travel_length(uint16_t path_length)
+{
+	const cartesian_coord* pos = data_get_pos();
+	const uint8_t* color = data_get_color();
+	double length = 0;
+	for (uint16_t i = 1; i < path_length; ++i) {
+		if (color[i] == white)
+			length += two_point_distance(pos[i-1], pos[i]);
+	}
+	return length;
+}
+
+/**
+ * @brief                changes of pen along the path in mod_data, the pen
+ *                       is black before the drawing
+ */
+static uint16_t count_pen_changes(uint16_t path_length)
+{
+	const uint8_t* color = data_get_color();
+	uint8_t pen = black;
+	uint16_t changes = 0;
+	for (uint16_t i = 1; i < path_length; ++i) {
+		if (color[i] != white && color[i] != pen) {
+			++changes;
+			pen = color[i];
+		}
+	}
+	return changes;
+}
+
+/**
+ * @brief                reports the pen changes and the drawing time
+ *                       predicted by the planner, against an order of the
+ *                       contours that ignores their colors (the path of the
+ *                       frame is planned again)
+ * @param[in]   path_length points of the path of the last run (grouped)
+ */
+static void color_report(uint16_t path_length)
+{
+	planner_ordering grouped = planner_get_ordering();
+	uint16_t changes = count_pen_changes(path_length);
+
+	planner_set_color_grouping(false);
+	use_tiles ? run_pipeline_tiled() : run_pipeline();
+	planner_ordering mixed = planner_get_ordering();
+	planner_set_color_grouping(true);
+
+	printf("  colors: %u pen changes, drawing %.1f s predicted (%u changes, %.1f s"
+	       " without grouping)%s\n", grouped.color_changes, grouped.total_ms/1000.0,
+	       mixed.color_changes, mixed.total_ms/1000.0,
+	       changes == grouped.color_changes ? "" : ", NOT THE CHANGES OF THE PATH");
+}
+
+/**
+ * @brief                reports what the thinning saves: the path of the frame
+ *                       is planned again without it
+ * @param[in]            path_length, draw: points and draw length of the path
+ *                       of the last run (thinned)
+ */
+static void thinning_report(uint16_t path_length, double draw)
+{
+	uint32_t pixels = edge_pixels;
+	uint32_t thinned = thin_pixels;
+
+	planner_set_thinning(false);
+	uint16_t thick_length = use_tiles ? run_pipeline_tiled() : run_pipeline();
+	double thick_draw = draw_length(thick_length);
+	planner_set_thinning(true);
+
+	printf("  thinning: %u of %u edge pixels removed, path points %u -> %u,"
+	       " draw length %.0f -> %.0f px\n", pixels - thinned, pixels, thick_length,
+	       path_length, thick_draw, draw);
+}
+
+/**
+ * @brief                reports the fidelity of the path to the edges of the
+ *                       frame for several tolerances of the simplification,
+ *                       the frame is planned again for each of them
+ */
+static void fidelity_report(void)
+{
+	printf("  fidelity (error in pixels, tolerance %u px):\n", FIDELITY_TOLERANCE_PX);
+	printf("  %6s %5s %8s %12s %6s %6s %8s %8s\n", "perp", "step", "points",
+	       "draw [px]", "mean", "max", "missed", "absent");
+	for (uint8_t i = 0; i < sizeof(simplifications)/sizeof(simplifications[0]); ++i) {
+		planner_set_simplification(simplifications[i].perp_dist,
+		                           simplifications[i].pixel_dist);
+		uint16_t path_length = run_pipeline();
+		path_fidelity fidelity = fidelity_measure(&canny_edges, data_get_pos(),
+		                                          data_get_color(), path_length,
+		                                          planner_get_scale());
+		bool is_default = simplifications[i].perp_dist == MAX_PERP_DIST
+		                  && simplifications[i].pixel_dist == MAX_PIXEL_DIST;
+		printf("  %6.2f %5u %8u %12.0f %6.2f %6.2f %8u %8u%s\n",
+		       simplifications[i].perp_dist, simplifications[i].pixel_dist,
+		       path_length, draw_length(path_length), fidelity.mean_error,
+		       fidelity.max_error, fidelity.missed_pixels, fidelity.absent_pixels,
+		       is_default ? "  (default)" : "");
+	}
+	planner_set_simplification(MAX_PERP_DIST, MAX_PIXEL_DIST);
+	printf("  (%u edge pixels)\n", edge_pixels);
+}
+
+/**
+ * @brief                adds sensor noise to each channel of an RGB565 frame
+ */
+static void add_noise(const uint8_t* in, uint8_t* out)
+{
+	static const uint8_t bits[] = {5, 6, 5};
+	static const uint8_t pos[] = {11, 5, 0};
+	for (uint32_t i = 0; i < IM_LENGTH_PX*IM_HEIGHT_PX; ++i) {
+		uint16_t rgb_565 = ((uint16_t)in[2*i] << 8) | in[2*i+1];
+		uint16_t noisy = 0;
+		for (uint8_t c = 0; c < 3; ++c) {
+			uint8_t shift = 8 - bits[c];
+			int16_t level = ((rgb_565 >> pos[c]) & ((1 << bits[c]) - 1)) << shift;
+			level += rand() % (2*NOISE_AMPLITUDE + 1) + rand() % (2*NOISE_AMPLITUDE + 1)
+			         - 2*NOISE_AMPLITUDE;
+			level = level < 0 ? 0 : level > UINT8_MAX ? UINT8_MAX : level;
+			noisy |= (level >> shift) << pos[c];
+		}
+		out[2*i] = noisy >> 8;
+		out[2*i+1] = noisy & 0xFF;
+	}
+}
+
+/**
+ * @brief                runs the pipeline on the average of nb_frames noisy
+ *                       copies of frame (0: the frame itself)
+ * @param[out]  nb_edge_pixels edge pixels found by the edge detection
+ * @return               length of the path
+ */
+static uint16_t run_pipeline_accumulated(uint8_t nb_frames, uint16_t* nb_edge_pixels)
+{
+	data_free();
+	arena_reset();
+
+	srand(NOISE_SEED);
+	gray_sum* sum = NULL;
+	if (nb_frames == 0) {
+		memcpy(image, frame, FRAME_SIZE);
+	} else {
+		sum = arena_calloc(1, sizeof(gray_sum));
+		for (uint8_t i = 0; i < nb_frames; ++i) {
+			add_noise(frame, image);
+			canny_accumulate(image, sum);
+		}
+	}
+
+	// the colors are those of the last frame
+	color_buffer = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
+	if (use_stream)
+		canny_edge_stream(image, sum, color_buffer, &edges, NULL);
+	else
+		canny_edge(image, sum, color_buffer, &edges, NULL);
+	arena_free(sum);
+	*nb_edge_pixels = edge_map_count(&edges);
+	return planner_path(&edges, color_buffer, NULL);
+}
+
+/**
+ * @brief                scales the levels of each channel of an RGB565
+ *                       frame, as a shorter exposure
+ * @param[in]   percent  exposure in percent of the frame
+ */
+static void dim_frame(const uint8_t* in, uint8_t* out, uint8_t percent)
+{
+	static const uint8_t bits[] = {5, 6, 5};
+	static const uint8_t pos[] = {11, 5, 0};
+	for (uint32_t i = 0; i < IM_LENGTH_PX*IM_HEIGHT_PX; ++i) {
+		uint16_t rgb_565 = ((uint16_t)in[2*i] << 8) | in[2*i+1];
+		uint16_t dimmed = 0;
+		for (uint8_t c = 0; c < 3; ++c) {
+			uint16_t level = (rgb_565 >> pos[c]) & ((1 << bits[c]) - 1);
+			dimmed |= (level*percent/100) << pos[c];
+		}
+		out[2*i] = dimmed >> 8;
+		out[2*i+1] = dimmed & 0xFF;
+	}
+}
+
+/**
+ * @brief                reports the contours and the thresholds of the edge
+ *                       detection against the exposure of the frame
+ */
+static void lighting_report(void)
+{
+	printf("  lighting (adaptive thresholds, gradient L2 norm)\n");
+	printf("  %-14s %12s %8s %12s %6s %6s %6s\n", "exposure [%]", "edge pixels",
+	       "contours", "path points", "max", "high", "low");
+	for (uint8_t i = 0; i < sizeof(exposures); ++i) {
+		data_free();
+		arena_reset();
+		dim_frame(frame, image, exposures[i]);
+		color_buffer = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
+		if (use_stream)
+			canny_edge_stream(image, NULL, color_buffer, &edges, NULL);
+		else
+			canny_edge(image, NULL, color_buffer, &edges, NULL);
+		canny_thresholds thr = canny_get_thresholds();
+		uint16_t nb_edge_pixels = edge_map_count(&edges);
+		uint16_t path_length = planner_path(&edges, color_buffer, NULL);
+		printf("  %-14u %12u %8u %12u %6u %6u %6u\n", exposures[i], nb_edge_pixels,
+		       count_contours(path_length), path_length, thr.max, thr.high, thr.low);
+	}
+	printf("\n");
+}
+
+/**
+ * @brief                reports the contours found with noisy frames
+ *                       against the number of frames averaged
+ */
+static void accumulation_report(void)
+{
+	printf("  multi-frame capture (noise +/-%d levels)\n", 2*NOISE_AMPLITUDE);
+	printf("  %-14s %12s %8s %12s\n", "frames", "edge pixels", "contours",
+	       "path points");
+	for (uint8_t nb_frames = 0; nb_frames <= MAX_ACCUMULATED_FRAMES;
+	     nb_frames = nb_frames ? 2*nb_frames : 1) {
+		uint16_t nb_edge_pixels;
+		uint16_t path_length = run_pipeline_accumulated(nb_frames, &nb_edge_pixels);
+		char label[16];
+		if (nb_frames == 0)
+			snprintf(label, sizeof(label), "no noise");
+		else
+			snprintf(label, sizeof(label), "%u", nb_frames);
+		printf("  %-14s %12u %8u %12u\n", label, nb_edge_pixels,
+		       count_contours(path_length), path_length);
+	}
+	printf("\n");
+}
+
+/**
+ * @brief                reports the time from the last row group of a frame
+ *                       delivered by the DCMI stand-in to its edges, with the
+ *                       rows processed as they land and with the whole frame
+ *                       processed once it has landed
+ * @param[in]   runs     frames delivered for each of them
+ */
+static void row_stream_report(uint32_t runs)
+{
+	static uint8_t ref_color[EDGE_SIZE];
+	static uint8_t row_color[EDGE_SIZE];
+	static edge_map ref_edges;
+	static edge_map row_edges;
+
+	uint64_t whole_ns = 0;
+	uint64_t tail_ns = 0;
+	bool identical = true;
+	for (uint32_t i = 0; i < runs; ++i) {
+		frame_feed_start(frame, image, FRAME_SIZE, nb_row_groups, ROW_GROUP_US);
+		frame_feed_wait_bytes_received(FRAME_SIZE - 1);
+		uint64_t landed = frame_feed_join();
+		arena_reset();
+		canny_edge_stream(image, NULL, ref_color, &ref_edges, NULL);
+		whole_ns += now_ns() - landed;
+
+		arena_reset();
+		frame_feed_start(frame, image, FRAME_SIZE, nb_row_groups, ROW_GROUP_US);
+		canny_stream_begin(image, NULL, row_color, &row_edges, NULL);
+		for (uint32_t received = 0; received < FRAME_SIZE; ) {
+			received = frame_feed_wait_bytes_received(received);
+			canny_stream_rows(received / ROW_BYTES);
+		}
+		canny_stream_end();
+		uint64_t done = now_ns();
+		tail_ns += done - frame_feed_join();
+
+		identical &= memcmp(&ref_edges, &row_edges, sizeof(edge_map)) == 0
+		             && memcmp(ref_color, row_color, EDGE_SIZE) == 0;
+	}
+
+	printf("  row streaming (%u row groups, %u us apart): edges %.1f us after the"
+	       " last rows instead of %.1f us, %s\n", nb_row_groups, ROW_GROUP_US,
+	       tail_ns/1000.0/runs, whole_ns/1000.0/runs,
+	       identical ? "identical" : "NOT IDENTICAL");
+	if (!identical)
+		edge_count_ok = false;
+}
+
+/**
+ * @brief                closes the measurement of a run
+ */
+static void run_done(void)
+{
+	arena_stats stats = arena_get_stats();
+	if (stats.frame_peak_bytes > arena_peak_bytes)
+		arena_peak_bytes = stats.frame_peak_bytes;
+	arena_failures += stats.failures;
+	heap_allocs = alloc_stats_get().allocs;
+}
+
+/**
+ * @brief                fills an RGB565 frame with a pattern that exceeds the
+ *                       arena budget
+ * @param[out]  out      frame of length x height pixels
+ * @param[in]   blocks   true for blocks of BLOCK_PX pixels of the colors of
+ *                       block_colors (all the neighbour blocks differ), false
+ *                       for a black and white checkerboard of 1 pixel
+ */
+static void fill_pattern(uint8_t* out, uint16_t length, uint16_t height, bool blocks)
+{
+	uint8_t nb_colors = sizeof(block_colors)/sizeof(block_colors[0]);
+	for (uint16_t y = 0; y < height; ++y) {
+		for (uint16_t x = 0; x < length; ++x) {
+			uint16_t rgb_565 = blocks
+			                   ? block_colors[(x/BLOCK_PX + 2*(y/BLOCK_PX)) % nb_colors]
+			                   : (x + y) % 2 ? 0xFFFF : 0x0000;
+			out[2*(y*length + x)] = rgb_565 >> 8;
+			out[2*(y*length + x)+1] = rgb_565 & 0xFF;
+		}
+	}
+}
+
+/**
+ * @brief                runs the pipeline on frames that exceed the arena
+ *                       budget: color blocks (single frame and tiled) and a
+ *                       checkerboard (edges and regions)
+ * @return               true if the pipeline gave up on them within the
+ *                       budget
+ */
+static bool budget_check(void)
+{
+	static const struct {
+		const char* name;
+		bool blocks;
+		bool tiles;
+		bool regions;
+	} cases[] = {
+		{"blocks", true, false, false},
+		{"blocks tiled", true, true, false},
+		{"checkerboard", false, false, false},
+		{"checker regions", false, false, true},
+	};
+	bool within = true;
+	bool regions = use_regions;
+
+	printf("arena budget (%dx%d, %u B)\n", IM_LENGTH_PX, IM_HEIGHT_PX, ARENA_SIZE);
+	printf("  %-16s %12s %12s %8s\n", "frame", "path points", "peak [B]", "failed");
+	for (uint8_t c = 0; c < sizeof(cases)/sizeof(cases[0]); ++c) {
+		arena_peak_bytes = 0;
+		arena_failures = 0;
+		use_regions = cases[c].regions;
+		uint16_t path_length;
+		if (cases[c].tiles) {
+			fill_pattern(mosaic, MOSAIC_LENGTH_PX, MOSAIC_HEIGHT_PX, cases[c].blocks);
+			path_length = run_pipeline_tiled();
+		} else {
+			fill_pattern(frame, IM_LENGTH_PX, IM_HEIGHT_PX, cases[c].blocks);
+			path_length = run_pipeline();
+		}
+		run_done();
+		if (arena_peak_bytes > ARENA_SIZE)
+			within = false;
+		printf("  %-16s %12u %12zu %8u\n", cases[c].name, path_length,
+		       arena_peak_bytes, arena_failures);
+	}
+	use_regions = regions;
+	data_free();
+	printf("  %s\n\n", within ? "within budget" : "OVER BUDGET");
+	return within;
+}
+
+/**
+ * @brief                benchmarks one frame and prints its report
+ * @return               0 on success, -1 if the frame cannot be loaded, if
+ *                       the edge map is not consistent or if the arena
+ *                       budget is exceeded
+ */
+static int bench_frame(const char* filename, uint32_t runs)
+{
+	uint16_t length = use_tiles ? MOSAIC_LENGTH_PX : IM_LENGTH_PX;
+	uint16_t height = use_tiles ? MOSAIC_HEIGHT_PX : IM_HEIGHT_PX;
+	if (frame_load(filename, use_tiles ? mosaic : frame, length, height) != 0) {
+		fprintf(stderr, "bench: cannot load %s\n", filename);
+		return -1;
+	}
+
+	memset(report, 0, sizeof(report));
+	edge_count_ok = true;
+	arena_peak_bytes = 0;
+	arena_failures = 0;
+	uint16_t path_length = 0;
+	for (uint32_t i = 0; i < runs; ++i) {
+		path_length = use_tiles ? run_pipeline_tiled() : run_pipeline();
+		run_done();
+	}
+
+	uint32_t path_hash = FNV_OFFSET;
+	double draw = 0;
+	if (path_length > 0) {
+		path_hash = fnv1a(path_hash, data_get_pos(), path_length*sizeof(cartesian_coord));
+		path_hash = fnv1a(path_hash, data_get_color(), path_length);
+		draw = draw_length(path_length);
+	}
+
+	printf("%s (%ux%u, %u runs, %s", filename, length, height, runs,
+	       use_regions ? "region segmentation" :
+	       use_stream ? "streaming engine" : "full frame engine");
+	if (use_tiles)
+		printf(", %ux%u tiles, time per mosaic", TILES_X, TILES_Y);
+	printf(")\n");
+	printf("  %-14s %12s %8s %12s\n", "stage", "time [us]", "allocs", "peak [B]");
+	double total_us = 0;
+	for (uint8_t s = 0; s < NB_STAGES; ++s) {
+		if (report[s].runs == 0) {
+			printf("  %-14s %12s %8s %12s\n", stage_names[s], "-", "-", "-");
+			continue;
+		}
+		// a stage runs once per tile in the tiled pipeline
+		double time_us = report[s].time_ns/1000.0/(use_tiles ? runs : report[s].runs);
+		total_us += time_us;
+		printf("  %-14s %12.1f %8u %12zu\n", stage_names[s], time_us,
+		       report[s].allocs, report[s].peak_bytes);
+	}
+	printf("  %-14s %12.1f\n", "total", total_us);
+	printf("  edge pixels %u, edge components %u, path points %u\n", edge_pixels,
+	       nb_edge_components, path_length);
+	printf("  edge hash %08x, color hash %08x, path hash %08x\n", edge_hash,
+	       color_hash, path_hash);
+	planner_tracing tracing = planner_get_tracing();
+	const stage_report* trace = &report[STAGE_TRACING];
+	if (trace->runs > 0)
+		printf("  tracing: %u contours, %u points, %u steps, %.1f steps/us, %.2f B/point\n",
+		       tracing.contours, tracing.points, tracing.steps,
+		       tracing.steps*1000.0*trace->runs/trace->time_ns/(use_tiles ? NB_TILES : 1),
+		       tracing.points ? (double)tracing.store_bytes/tracing.points : 0.0);
+	planner_pruning pruning = planner_get_pruning();
+	printf("  pruning: %u of %u contours removed, %.1f s of drawing saved\n",
+	       pruning.contours, pruning.traced, pruning.time_ms/1000.0);
+	planner_ordering ordering = planner_get_ordering();
+	printf("  ordering: %u contours, pen up travel %u -> %u px (%u moves, %.0f px"
+	       " in the path), %.1f s of drawing saved\n", ordering.contours,
+	       ordering.travel_before, ordering.travel_after, ordering.moves,
+	       path_length > 0 ? travel_length(path_length) : 0.0, ordering.time_ms/1000.0);
+	if (!use_regions) {
+		canny_thresholds thr = canny_get_thresholds();
+		printf("  thresholds%s: high %u, low %u, max gradient %u\n",
+		       use_tiles ? " (last tile)" : "", thr.high, thr.low, thr.max);
+	}
+	printf("  edge map (%zu B) %s\n", sizeof(edge_map),
+	       edge_count_ok ? "consistent" : "NOT CONSISTENT");
+	printf("  arena peak %zu of %u B (%u failed allocs), %u heap allocs per run\n",
+	       arena_peak_bytes, ARENA_SIZE, arena_failures, heap_allocs);
+	if (path_length > 0)
+		color_report(path_length);
+	thinning_report(path_length, draw);
+	if (nb_row_groups > 0 && !use_tiles && !use_regions)
+		row_stream_report(runs);
+	if (use_fidelity && !use_tiles)
+		fidelity_report();
+	printf("\n");
+
+	if (use_accumulation && !use_tiles)
+		accumulation_report();
+	if (use_lighting && !use_tiles)
+		lighting_report();
+
+	data_free();
+	return edge_count_ok && arena_failures == 0 ? 0 : -1;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(int argc, char* argv[])
+{
+	uint32_t runs = DEFAULT_RUNS;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:srtalp:d:fo:")) != -1) {
+		switch (opt) {
+			case 'n':
+				runs = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				use_stream = true;
+				break;
+			case 'r':
+				use_regions = true;
+				break;
+			case 't':
+				use_tiles = true;
+				break;
+			case 'a':
+				use_accumulation = true;
+				break;
+			case 'l':
+				use_lighting = true;
+				break;
+			case 'p':
+				planner_set_min_stroke(strtoul(optarg, NULL, 10));
+				break;
+			case 'd':
+				nb_row_groups = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				use_fidelity = true;
+				break;
+			case 'o':
+				planner_set_ordering(strtoul(optarg, NULL, 10), now_ms);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n runs] [-s] [-r] [-t] [-a] [-l] [-p length] [-o budget] [-d groups] [-f] frame...\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc || runs == 0 || (use_regions && use_tiles)) {
+		fprintf(stderr, "usage: %s [-n runs] [-s] [-r] [-t] [-a] [-l] [-p length] [-o budget] [-d groups] [-f] frame...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int status = EXIT_SUCCESS;
+	if (!gaussian_check(runs) || !ordering_check(runs) || !budget_check())
+		status = EXIT_FAILURE;
+	for (int i = optind; i < argc; ++i) {
+		if (bench_frame(argv[i], runs) != 0)
+			status = EXIT_FAILURE;
+	}
+	return status;
+}
@@ -0,0 +1,197 @@
+/**
+ * @file    fidelity.c
+ * @brief   Chamfer distance between a path and an edge map for the host
+ *          benchmark.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Module headers
+
+#include <fidelity.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// 3-4 chamfer weights of an axial and of a diagonal step
+#define STEP_AXIAL         3
+#define STEP_DIAGONAL      4
+#define FAR                UINT16_MAX
+
+// rounding error of the scaled coordinates
+#define SCALE_EPSILON      0.001f
+
+#define NB_PIXELS          (IM_LENGTH_PX*IM_HEIGHT_PX)
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static edge_map drawn;
+
+// distances (in chamfer units) to the nearest edge and drawn pixels
+static uint16_t edge_distance[NB_PIXELS];
+static uint16_t drawn_distance[NB_PIXELS];
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                       image pixel of a canvas coordinate, inverse of
+ *                              the truncated scaling of the planner: the
+ *                              smallest pixel p with p*scale >= value (scale is
+ *                              at least 1)
+ */
+static img_coord to_pixel(uint16_t value, float scale, img_coord size)
+{
+	int32_t pixel = (int32_t)ceilf(value/scale - SCALE_EPSILON);
+	return pixel < size ? pixel : size - 1;
+}
+
+/**
+ * @brief                       sets the pixels of a segment (Bresenham)
+ */
+static void draw_segment(edge_map* map, img_coord x0, img_coord y0,
+                         img_coord x1, img_coord y1)
+{
+	int16_t dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+	int16_t dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+	int16_t error = dx + dy;
+	int16_t x = x0, y = y0;
+	for (;;) {
+		edge_map_set(map, edge_map_bit(x, y));
+		if (x == x1 && y == y1)
+			break;
+		int16_t twice = 2*error;
+		if (twice >= dy) {
+			error += dy;
+			x += sx;
+		}
+		if (twice <= dx) {
+			error += dx;
+			y += sy;
+		}
+	}
+}
+
+static inline uint16_t relax(uint16_t distance, uint16_t neighbour, uint16_t step)
+{
+	if (neighbour != FAR && neighbour + step < distance)
+		return neighbour + step;
+	return distance;
+}
+
+/**
+ * @brief                       two pass 3-4 chamfer distance transform
+ * @param[in]   map             pixels at distance 0
+ * @param[out]  distance        distance of each pixel to the nearest one of
+ *                              map, FAR if map is empty
+ */
+static void distance_transform(const edge_map* map, uint16_t* distance)
+{
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y)
+		for (img_coord x = 0; x < IM_LENGTH_PX; ++x)
+			distance[x + y*IM_LENGTH_PX] = edge_map_test(map, edge_map_bit(x, y)) ?
+			                               0 : FAR;
+
+	// forward pass: neighbours above and on the left
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y) {
+		for (img_coord x = 0; x < IM_LENGTH_PX; ++x) {
+			uint16_t* d = &distance[x + y*IM_LENGTH_PX];
+			if (x > 0)
+				*d = relax(*d, d[-1], STEP_AXIAL);
+			if (y > 0) {
+				*d = relax(*d, d[-IM_LENGTH_PX], STEP_AXIAL);
+				if (x > 0)
+					*d = relax(*d, d[-IM_LENGTH_PX-1], STEP_DIAGONAL);
+				if (x < IM_LENGTH_PX - 1)
+					*d = relax(*d, d[-IM_LENGTH_PX+1], STEP_DIAGONAL);
+			}
+		}
+	}
+
+	// backward pass: neighbours below and on the right
+	for (int16_t y = IM_HEIGHT_PX - 1; y >= 0; --y) {
+		for (int16_t x = IM_LENGTH_PX - 1; x >= 0; --x) {
+			uint16_t* d = &distance[x + y*IM_LENGTH_PX];
+			if (x < IM_LENGTH_PX - 1)
+				*d = relax(*d, d[1], STEP_AXIAL);
+			if (y < IM_HEIGHT_PX - 1) {
+				*d = relax(*d, d[IM_LENGTH_PX], STEP_AXIAL);
+				if (x < IM_LENGTH_PX - 1)
+					*d = relax(*d, d[IM_LENGTH_PX+1], STEP_DIAGONAL);
+				if (x > 0)
+					*d = relax(*d, d[IM_LENGTH_PX-1], STEP_DIAGONAL);
+			}
+		}
+	}
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+path_fidelity fidelity_measure(const edge_map* edges, const cartesian_coord* path,
+                               const uint8_t* color, uint16_t length, float scale)
+{
+	// rasterize the strokes, a segment ends on a point that is not white
+	edge_map_clear(&drawn);
+	for (uint16_t i = 1; i < length; ++i) {
+		if (color[i] == white)
+			continue;
+		draw_segment(&drawn,
+		             to_pixel(path[i-1].x, scale, IM_LENGTH_PX),
+		             to_pixel(path[i-1].y, scale, IM_HEIGHT_PX),
+		             to_pixel(path[i].x, scale, IM_LENGTH_PX),
+		             to_pixel(path[i].y, scale, IM_HEIGHT_PX));
+	}
+
+	distance_transform(edges, edge_distance);
+	distance_transform(&drawn, drawn_distance);
+
+	path_fidelity fidelity = {0};
+	uint32_t error_sum = 0;
+	uint32_t error_count = 0;
+	uint16_t error_max = 0;
+	uint16_t tolerance = FIDELITY_TOLERANCE_PX*STEP_DIAGONAL;
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y) {
+		for (img_coord x = 0; x < IM_LENGTH_PX; ++x) {
+			uint16_t bit = edge_map_bit(x, y);
+			uint16_t pixel = x + y*IM_LENGTH_PX;
+			// distances of an edge pixel to the drawing, of a drawn pixel to
+			// the edges
+			uint16_t distances[2] = {FAR, FAR};
+			if (edge_map_test(edges, bit)) {
+				++fidelity.edge_pixels;
+				distances[0] = drawn_distance[pixel];
+				fidelity.missed_pixels += distances[0] > tolerance;
+			}
+			if (edge_map_test(&drawn, bit)) {
+				++fidelity.drawn_pixels;
+				distances[1] = edge_distance[pixel];
+				fidelity.absent_pixels += distances[1] > tolerance;
+			}
+			for (uint8_t i = 0; i < 2; ++i) {
+				if (distances[i] == FAR)
+					continue;
+				error_sum += distances[i];
+				++error_count;
+				if (distances[i] > error_max)
+					error_max = distances[i];
+			}
+		}
+	}
+
+	if (error_count) {
+		fidelity.mean_error = (float)error_sum/error_count/STEP_AXIAL;
+		fidelity.max_error = (float)error_max/STEP_AXIAL;
+	}
+	return fidelity;
+}
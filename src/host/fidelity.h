@@ -0,0 +1,64 @@
+/**
+ * @file    fidelity.h
+ * @brief   Fidelity of a path to the edges it was planned from, for the
+ *          host benchmark.
+ * @note    The strokes of the path (pen down moves) are rasterized back onto
+ *          the pixels of the image and compared with the edge map through
+ *          3-4 chamfer distance transforms of both.
+ */
+
+#ifndef _FIDELITY_H_
+#define _FIDELITY_H_
+
+// C standard header files
+
+#include <stdint.h>
+
+// Module headers
+
+#include <edge_map.h>
+#include <tools.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// A pixel is matched if the other raster has a pixel among its 8 neighbours
+#define FIDELITY_TOLERANCE_PX 1
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef struct path_fidelity {
+	float mean_error;       // mean chamfer distance in pixels, of the drawn
+	                        // pixels to the edges and of the edge pixels to
+	                        // the drawing
+	float max_error;        // largest of these distances
+	uint16_t edge_pixels;   // pixels of the edge map
+	uint16_t drawn_pixels;  // pixels of the rasterized strokes
+	uint16_t missed_pixels; // edge pixels that are not drawn
+	uint16_t absent_pixels; // drawn pixels that are not edges
+} path_fidelity;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                compares a path with the edges of an image
+ * @param[in]   edges    edge map of the image (before the thinning)
+ * @param[in]   path     path in canvas coordinates (mod_data)
+ * @param[in]   color    color of each point, white for a pen up move to it
+ * @param[in]   length   number of points
+ * @param[in]   scale    canvas pixels per image pixel (planner_get_scale())
+ * @return               fidelity of the path
+ * @note                 The pixels farther than FIDELITY_TOLERANCE_PX from
+ *                       the other raster are missed (absent), the errors
+ *                       only average the pixels of a raster whose
+ *                       counterpart is not empty.
+ */
+path_fidelity fidelity_measure(const edge_map* edges, const cartesian_coord* path,
+                               const uint8_t* color, uint16_t length, float scale);
+
+#endif /* _FIDELITY_H_ */
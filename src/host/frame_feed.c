@@ -0,0 +1,111 @@
+/**
+ * @file    frame_feed.c
+ * @brief   Row group delivery of recorded frames for the host benchmark
+ *          (stand-in of the DCMI camera).
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// POSIX threads
+
+#include <pthread.h>
+
+// Module headers
+
+#include <frame_feed.h>
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+// frame being delivered
+static const uint8_t* feed_frame;
+static uint8_t* feed_buffer;
+static uint32_t feed_size;
+static uint8_t feed_groups;
+static uint32_t feed_group_us;
+
+// bytes landed, protected by feed_lock
+static uint32_t bytes_received;
+static uint64_t last_group_ns;
+
+static pthread_t feeder;
+static pthread_mutex_t feed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t feed_landed = PTHREAD_COND_INITIALIZER;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                monotonic time in ns
+ */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief                feeder thread: copies the row groups at the camera
+ *                       pace and notifies each of them
+ */
+static void* feed_thread(void* arg)
+{
+	(void)arg;
+	uint32_t start = 0;
+	for (uint8_t group = 1; group <= feed_groups; ++group) {
+		struct timespec pace = {feed_group_us / 1000000, (feed_group_us % 1000000)*1000};
+		nanosleep(&pace, NULL);
+
+		// same boundaries as the DMA: half of the frame for 2 groups
+		uint32_t end = (uint64_t)feed_size*group/feed_groups;
+		memcpy(&feed_buffer[start], &feed_frame[start], end - start);
+		start = end;
+
+		pthread_mutex_lock(&feed_lock);
+		bytes_received = end;
+		if (group == feed_groups)
+			last_group_ns = now_ns();
+		pthread_cond_broadcast(&feed_landed);
+		pthread_mutex_unlock(&feed_lock);
+	}
+	return NULL;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+void frame_feed_start(const uint8_t* frame, uint8_t* buffer, uint32_t size,
+                      uint8_t nb_groups, uint32_t group_us)
+{
+	feed_frame = frame;
+	feed_buffer = buffer;
+	feed_size = size;
+	feed_groups = nb_groups ? nb_groups : 1;
+	feed_group_us = group_us;
+	bytes_received = 0;
+	pthread_create(&feeder, NULL, feed_thread, NULL);
+}
+
+uint32_t frame_feed_wait_bytes_received(uint32_t bytes)
+{
+	pthread_mutex_lock(&feed_lock);
+	while (bytes_received <= bytes)
+		pthread_cond_wait(&feed_landed, &feed_lock);
+	uint32_t received = bytes_received;
+	pthread_mutex_unlock(&feed_lock);
+	return received;
+}
+
+uint64_t frame_feed_join(void)
+{
+	pthread_join(feeder, NULL);
+	return last_group_ns;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file    frame_feed.h
+ * @brief   Stand-in of the DCMI camera for the host benchmark: a recorded
+ *          frame is copied into a frame buffer one row group after the other
+ *          by a feeder thread, as the DMA fills the buffer of a capture.
+ * @note    frame_feed_wait_bytes_received() has the contract of
+ *          dcmi_wait_bytes_received(), so that the code processing the rows
+ *          as they land runs unchanged on the host.
+ */
+
+#ifndef _FRAME_FEED_H_
+#define _FRAME_FEED_H_
+
+// C standard header files
+
+#include <stdint.h>
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                Starts the delivery of a frame.
+ * @param[in]   frame    Recorded frame
+ * @param[out]  buffer   Frame buffer, filled in row groups
+ * @param[in]   size     Size in bytes of the frame
+ * @param[in]   nb_groups Number of row groups (2: DMA half transfer and
+ *                       frame end)
+ * @param[in]   group_us Time in us between two row groups (camera pace)
+ * @return               none
+ * @note                 A single frame is delivered at a time,
+ *                       frame_feed_join() must be called before the next one.
+ */
+void frame_feed_start(const uint8_t* frame, uint8_t* buffer, uint32_t size,
+                      uint8_t nb_groups, uint32_t group_us);
+
+/**
+ * @brief                Waits until more than a number of bytes of the frame
+ *                       have landed in the buffer.
+ * @param[in]   bytes    Bytes already known to be received, 0 after
+ *                       frame_feed_start()
+ * @return               Bytes of the frame received
+ */
+uint32_t frame_feed_wait_bytes_received(uint32_t bytes);
+
+/**
+ * @brief                Waits for the end of the delivery.
+ * @return               Time in ns (CLOCK_MONOTONIC) at which the last row
+ *                       group landed
+ */
+uint64_t frame_feed_join(void);
+
+#endif /* _FRAME_FEED_H_ */
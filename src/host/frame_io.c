@@ -0,0 +1,112 @@
+/**
+ * @file    frame_io.c
+ * @brief   Loading of PNG and raw RGB565 frames for the host benchmark.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// libpng
+
+#include <png.h>
+
+// Module headers
+
+#include <frame_io.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define RGB_CHANNELS       3
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                converts an RGB888 pixel to big endian RGB565
+ * @param[in]   rgb      pointer to the red, green and blue bytes
+ * @param[out]  out      pointer to the 2 output bytes
+ * @return               none
+ */
+static void rgb888_to_rgb565(const uint8_t* rgb, uint8_t* out)
+{
+	uint16_t rgb_565 = ((uint16_t)(rgb[0] >> 3) << 11)
+	                   | ((uint16_t)(rgb[1] >> 2) << 5)
+	                   | (rgb[2] >> 3);
+	out[0] = rgb_565 >> 8;
+	out[1] = rgb_565 & 0xFF;
+}
+
+/**
+ * @brief                loads a PNG file and resamples it (nearest neighbour)
+ * @return               0 on success, -1 otherwise
+ */
+static int8_t load_png(const char* filename, uint8_t* rgb565, uint16_t width,
+                       uint16_t height)
+{
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+
+	if (!png_image_begin_read_from_file(&image, filename))
+		return -1;
+
+	image.format = PNG_FORMAT_RGB;
+	uint8_t* rgb = malloc(PNG_IMAGE_SIZE(image));
+	if (rgb == NULL) {
+		png_image_free(&image);
+		return -1;
+	}
+	if (!png_image_finish_read(&image, NULL, rgb, 0, NULL)) {
+		free(rgb);
+		return -1;
+	}
+
+	for (uint32_t y = 0; y < height; ++y) {
+		uint32_t src_y = y*image.height/height;
+		for (uint32_t x = 0; x < width; ++x) {
+			uint32_t src_x = x*image.width/width;
+			rgb888_to_rgb565(&rgb[(src_y*image.width + src_x)*RGB_CHANNELS],
+			                 &rgb565[(y*width + x)*2]);
+		}
+	}
+	free(rgb);
+	return 0;
+}
+
+/**
+ * @brief                loads a raw RGB565 dump (as sent by the e-puck)
+ * @return               0 on success, -1 otherwise
+ */
+static int8_t load_raw(const char* filename, uint8_t* rgb565, uint16_t width,
+                       uint16_t height)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return -1;
+	size_t size = (size_t)width*height*2;
+	size_t read = fread(rgb565, 1, size, file);
+	bool trailing = fgetc(file) != EOF;
+	fclose(file);
+	return (read == size && !trailing) ? 0 : -1;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+int8_t frame_load(const char* filename, uint8_t* rgb565, uint16_t width,
+                  uint16_t height)
+{
+	const char* ext = strrchr(filename, '.');
+	if (ext != NULL && strcmp(ext, ".png") == 0)
+		return load_png(filename, rgb565, width, height);
+	return load_raw(filename, rgb565, width, height);
+}
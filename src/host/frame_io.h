@@ -0,0 +1,32 @@
+/**
+ * @file    frame_io.h
+ * @brief   Loading of test frames for the host benchmark.
+ */
+
+#ifndef _FRAME_IO_H_
+#define _FRAME_IO_H_
+
+// C standard header files
+
+#include <stdint.h>
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                Loads a frame in the format delivered by the camera
+ *                       (RGB565, big endian, 2 bytes per pixel).
+ * @param[in]   filename PNG file (resampled to width x height if needed) or
+ *                       raw RGB565 dump of exactly width*height*2 bytes
+ * @param[out]  rgb565   Buffer of width*height*2 bytes
+ * @param[in]   width    Frame width in pixels
+ * @param[in]   height   Frame height in pixels
+ * @return               The operation status.
+ * @retval 0             if the frame was loaded.
+ * @retval -1            if the file cannot be read or has the wrong size.
+ */
+int8_t frame_load(const char* filename, uint8_t* rgb565, uint16_t width,
+                  uint16_t height);
+
+#endif /* _FRAME_IO_H_ */
@@ -0,0 +1,211 @@
+/**
+ * @file    gen_color_lut.c
+ * @brief   Generates color_lut.h, the lookup tables of the grayscale
+ *          conversion and color classification of RGB565 pixels.
+ * @details Built and run on the build machine by the firmware and host
+ *          Makefiles, the tables follow the parameters of color_params.h.
+ *
+ *          usage: gen_color_lut > color_lut.h
+ *
+ *          The luma of a pixel is the sum of one entry of each luma table,
+ *          in fixed point. The color class of a pixel is found from the AND
+ *          of its three channel pair tables, which hold one flag per
+ *          condition of classify_color(), and from its channel sum (black).
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Module headers
+
+#include <color_params.h>
+#include <mod_data.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define RED_LEVELS         32
+#define GREEN_LEVELS       64
+#define BLUE_LEVELS        32
+
+#define RED_SHIFT          11
+#define GREEN_SHIFT        5
+
+#define LUMA_FP_SHIFT      16
+
+// flags of the pair tables, a flag that does not depend on the pair is set
+#define FLAG_RED           0x01
+#define FLAG_GREEN         0x02
+#define FLAG_BLUE          0x04
+#define FLAG_BLACK         0x08
+#define NB_FLAGS           4
+
+#define VALUES_PER_LINE    16
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                converts channel levels to range 0-255, like the
+ *                       unpacking of an RGB565 pixel
+ */
+static uint8_t red_value(uint8_t level)
+{
+	return ((uint16_t)(level << RED_SHIFT) & RED_MASK) >> RGB_RED_POS;
+}
+
+static uint8_t green_value(uint8_t level)
+{
+	return ((uint16_t)(level << GREEN_SHIFT) & GREEN_MASK) >> RGB_GREEN_POS;
+}
+
+static uint8_t blue_value(uint8_t level)
+{
+	return (level & BLUE_MASK) << RGB_BLUE_POS;
+}
+
+/**
+ * @brief                conditions of the color classification, same
+ *                       expressions as the original float classification
+ */
+static uint8_t red_green_flags(uint8_t red, uint8_t green)
+{
+	uint8_t flags = FLAG_BLUE;
+	if (red > RED_COEFF*green)
+		flags |= FLAG_RED;
+	if (green > GREEN_COEFF*red)
+		flags |= FLAG_GREEN;
+	return flags;
+}
+
+static uint8_t red_blue_flags(uint8_t red, uint8_t blue)
+{
+	uint8_t flags = FLAG_GREEN;
+	if (red > RED_COEFF*blue)
+		flags |= FLAG_RED;
+	if (blue > red)
+		flags |= FLAG_BLUE;
+	return flags;
+}
+
+static uint8_t green_blue_flags(uint8_t green, uint8_t blue)
+{
+	uint8_t flags = FLAG_RED;
+	if (abs((int16_t)blue - (int16_t)green) < GREEN_BLUE_DIFF)
+		flags |= FLAG_GREEN;
+	if (blue > green && blue > BLUE_MIN_VALUE)
+		flags |= FLAG_BLUE;
+	return flags;
+}
+
+/**
+ * @brief                color of a combination of flags, in the priority
+ *                       order of the classification
+ */
+static uint8_t flags_color(uint8_t flags)
+{
+	if (flags & FLAG_RED)
+		return red;
+	else if (flags & FLAG_GREEN)
+		return green;
+	else if (flags & FLAG_BLUE)
+		return blue;
+	else if (flags & FLAG_BLACK)
+		return black;
+	else
+		return white;
+}
+
+/**
+ * @brief                contribution of a channel to the luma
+ */
+static uint32_t luma_value(float coeff, uint8_t value)
+{
+	return (uint32_t)((double)coeff*value*(1 << LUMA_FP_SHIFT) + 0.5);
+}
+
+/**
+ * @brief                prints the values of a table, VALUES_PER_LINE per line
+ */
+static void print_values(const uint32_t* values, uint16_t size)
+{
+	for (uint16_t i = 0; i < size; ++i) {
+		printf("%s%u,", i % VALUES_PER_LINE ? " " : "\n\t", values[i]);
+	}
+	printf("\n");
+}
+
+static void print_table(const char* type, const char* name, const uint32_t* values,
+                        uint16_t rows, uint16_t cols)
+{
+	if (rows == 1) {
+		printf("\nstatic const %s %s[%u] = {", type, name, cols);
+		print_values(values, cols);
+	} else {
+		printf("\nstatic const %s %s[%u][%u] = {\n", type, name, rows, cols);
+		for (uint16_t r = 0; r < rows; ++r) {
+			printf("{");
+			print_values(&values[r*cols], cols);
+			printf("},\n");
+		}
+	}
+	printf("};\n");
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	static uint32_t values[GREEN_LEVELS*BLUE_LEVELS];
+
+	printf("/**\n"
+	       " * @file    color_lut.h\n"
+	       " * @brief   Lookup tables of the grayscale conversion and color\n"
+	       " *          classification of RGB565 pixels.\n"
+	       " * @note    Generated by gen_color_lut from color_params.h, do not edit.\n"
+	       " */\n\n"
+	       "#ifndef _COLOR_LUT_H_\n"
+	       "#define _COLOR_LUT_H_\n\n"
+	       "#include <stdint.h>\n\n"
+	       "#define LUMA_FP_SHIFT      %u\n\n"
+	       "#define COLOR_FLAG_BLACK   0x%02x\n"
+	       "#define BLACK_LEVEL_SUM    %u\n",
+	       LUMA_FP_SHIFT, FLAG_BLACK, NUMBER_COLORS*BLACK_THRESHOLD);
+
+	for (uint8_t r = 0; r < RED_LEVELS; ++r)
+		values[r] = luma_value(LUMA_RED_COEFF, red_value(r));
+	print_table("uint32_t", "luma_red_lut", values, 1, RED_LEVELS);
+	for (uint8_t g = 0; g < GREEN_LEVELS; ++g)
+		values[g] = luma_value(LUMA_GREEN_COEFF, green_value(g));
+	print_table("uint32_t", "luma_green_lut", values, 1, GREEN_LEVELS);
+	for (uint8_t b = 0; b < BLUE_LEVELS; ++b)
+		values[b] = luma_value(LUMA_BLUE_COEFF, blue_value(b));
+	print_table("uint32_t", "luma_blue_lut", values, 1, BLUE_LEVELS);
+
+	for (uint8_t r = 0; r < RED_LEVELS; ++r)
+		for (uint8_t g = 0; g < GREEN_LEVELS; ++g)
+			values[r*GREEN_LEVELS + g] = red_green_flags(red_value(r), green_value(g));
+	print_table("uint8_t", "color_rg_lut", values, RED_LEVELS, GREEN_LEVELS);
+	for (uint8_t r = 0; r < RED_LEVELS; ++r)
+		for (uint8_t b = 0; b < BLUE_LEVELS; ++b)
+			values[r*BLUE_LEVELS + b] = red_blue_flags(red_value(r), blue_value(b));
+	print_table("uint8_t", "color_rb_lut", values, RED_LEVELS, BLUE_LEVELS);
+	for (uint8_t g = 0; g < GREEN_LEVELS; ++g)
+		for (uint8_t b = 0; b < BLUE_LEVELS; ++b)
+			values[g*BLUE_LEVELS + b] = green_blue_flags(green_value(g), blue_value(b));
+	print_table("uint8_t", "color_gb_lut", values, GREEN_LEVELS, BLUE_LEVELS);
+
+	for (uint8_t flags = 0; flags < (1 << NB_FLAGS); ++flags)
+		values[flags] = flags_color(flags);
+	print_table("uint8_t", "color_class_lut", values, 1, 1 << NB_FLAGS);
+
+	printf("\n#endif /* _COLOR_LUT_H_ */\n");
+	return EXIT_SUCCESS;
+}
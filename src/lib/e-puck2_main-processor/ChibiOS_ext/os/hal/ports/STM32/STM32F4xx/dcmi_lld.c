@@ -66,7 +66,10 @@ static void dcmi_lld_serve_dma_rx_interrupt(DCMIDriver *dcmip, uint32_t flags) {
 	if ((flags & (STM32_DMA_ISR_TEIF | STM32_DMA_ISR_DMEIF)) != 0) {
 		_dcmi_isr_error_code(dcmip, DCMI_ERR_DMAFAILURE);
 	}
-	if( dcmip->config->transfer_complete_cb != NULL ) {
+	if ((flags & STM32_DMA_ISR_HTIF) != 0 && dcmip->config->half_transfer_cb != NULL) {
+		dcmip->config->half_transfer_cb(dcmip);
+	}
+	if ((flags & STM32_DMA_ISR_TCIF) != 0 && dcmip->config->transfer_complete_cb != NULL) {
 		dcmip->config->transfer_complete_cb(dcmip);
 	}
 
@@ -115,6 +118,7 @@ void dcmi_lld_init(void) {
                     STM32_DMA_CR_PL(STM32_DCMI_DMA_PRIORITY) |	// High priority level.
                     STM32_DMA_CR_DIR_P2M |						// Peripheral to memory.
                     STM32_DMA_CR_TCIE |							// Transfer complete interrupt enabled.
+                    STM32_DMA_CR_HTIE |							// Half transfer interrupt enabled.
                     STM32_DMA_CR_DMEIE |						// Direct mode error interrupt enabled.
                     STM32_DMA_CR_TEIE |							// Transfer error interrupt enabled.
                     STM32_DMA_CR_PBURST_SINGLE |				// Single transfer (no burst).
@@ -123,7 +127,6 @@ void dcmi_lld_init(void) {
                     STM32_DMA_CR_MSIZE_WORD |					// Memory data size = 4 bytes.
                     STM32_DMA_CR_MINC |							// Increment memory address after each data transfer.
                     STM32_DMA_CR_CIRC;							// Circular mode.
-                    //STM32_DMA_CR_HTIE |						// Half transfer interrupt enabled.
 }
 
 /**
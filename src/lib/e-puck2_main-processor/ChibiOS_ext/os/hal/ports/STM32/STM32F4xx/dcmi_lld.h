@@ -179,6 +179,11 @@ typedef struct {
    * @brief DMA transfer complete callback or @p NULL.
    */
   dcmicallback_t			transfer_complete_cb;
+  /**
+   * @brief DMA half transfer callback or @p NULL, the first half of the
+   *        receive buffer has been filled.
+   */
+  dcmicallback_t			half_transfer_cb;
   /**
    * @brief Error callback or @p NULL.
    */
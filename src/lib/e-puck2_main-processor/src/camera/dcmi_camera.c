@@ -5,11 +5,13 @@
 
 void frameEndCb(DCMIDriver* dcmip);
 void dmaTransferEndCb(DCMIDriver* dcmip);
+void dmaHalfTransferCb(DCMIDriver* dcmip);
 void dcmiErrorCb(DCMIDriver* dcmip, dcmierror_t err);
 
 const DCMIConfig dcmicfg = {
     frameEndCb,
     dmaTransferEndCb,
+    dmaHalfTransferCb,
 	dcmiErrorCb,
     DCMI_CR_PCKPOL
 };
@@ -21,6 +23,11 @@ static uint8_t double_buffering = 0;
 static uint8_t image_ready = 0;
 static uint8_t dcmiErrorFlag = 0;
 static uint8_t dcmi_prepared = 0;
+static uint32_t frame_size = 0;
+// bytes of the frame being captured that have landed in its buffer
+static volatile uint32_t bytes_received = 0;
+// thread waiting for the next row group, see dcmi_wait_bytes_received()
+static thread_reference_t rows_thread = NULL;
 
 
 //conditional variable
@@ -37,17 +44,29 @@ void frameEndCb(DCMIDriver* dcmip) {
     image_ready = 1;
     chSysLockFromISR();
 	chCondBroadcastI(&dcmi_condvar);
+	bytes_received = frame_size;
+	chThdResumeI(&rows_thread, MSG_OK);
 	chSysUnlockFromISR();
 }
 
 // This is called at each DMA transfer completion.
-// In our case it is called at each frame end since "half-transfer" interrupt is disabled.
+// In our case it is called at each frame end, each frame fills a whole buffer.
 void dmaTransferEndCb(DCMIDriver* dcmip) {
    (void) dcmip;
     //palTogglePad(GPIOD, 15); // Blue.
 	//osalEventBroadcastFlagsI(&ss_event, 0);
 }
 
+// This is called when the first half of a frame has been transferred: its
+// first rows can be processed while the other ones are received.
+void dmaHalfTransferCb(DCMIDriver* dcmip) {
+	(void) dcmip;
+	chSysLockFromISR();
+	bytes_received = frame_size/2;
+	chThdResumeI(&rows_thread, MSG_OK);
+	chSysUnlockFromISR();
+}
+
 void dcmiErrorCb(DCMIDriver* dcmip, dcmierror_t err) {
    (void) dcmip;
    (void) err;
@@ -125,6 +144,7 @@ int8_t dcmi_prepare(void) {
 			return -1;
 		}
 	}
+	frame_size = image_size;
 	// Prepare the DCMI and enable the DMA.
 	dcmiPrepare(&DCMID, &dcmicfg, image_size, (uint32_t*)image_buff1, (uint32_t*)image_buff2);
 	dcmi_prepared = 1;
@@ -150,6 +170,18 @@ void wait_image_ready(void) {
     chMtxUnlock(&dcmi_lock);
 }
 
+uint32_t dcmi_wait_bytes_received(uint32_t bytes) {
+	uint32_t received;
+	// the callbacks resume the thread with the system locked, no event is lost
+	chSysLock();
+	while (bytes_received <= bytes) {
+		chThdSuspendS(&rows_thread);
+	}
+	received = bytes_received;
+	chSysUnlock();
+	return received;
+}
+
 uint8_t dcmi_double_buffering_enabled(void) {
 	return double_buffering;
 }
@@ -226,6 +258,7 @@ uint8_t* dcmi_get_second_buffer_ptr(void) {
 }
 
 void dcmi_capture_start(void) {
+	bytes_received = 0;
 	if(capture_mode == CAPTURE_ONE_SHOT) {
 		dcmi_start_one_shot(&DCMID);
 	} else {
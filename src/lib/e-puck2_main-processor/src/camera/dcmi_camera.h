@@ -5,8 +5,9 @@
 #include <hal.h>
 #include "dcmi.h"
 #include "po8030.h"
+#include <mod_img_processing.h>
 
-#define MAX_BUFF_SIZE 19200 //76800 // This means 2 color QQVGA images: (160x120x2)x2; or a single greyscale QVGA image: 320x240.
+#define MAX_BUFF_SIZE (2*FRAME_BYTES) // This means 2 color images of the resolution profile with double buffering: (100x90x2)x2.
 
 typedef enum {
 	CAPTURE_ONE_SHOT = 0,
@@ -62,6 +63,20 @@ uint8_t image_is_ready(void);
  */
 void wait_image_ready(void);
 
+/**
+ * @brief 		Put the thread invoking this function in sleep until more
+ * 				than a number of bytes of the frame being captured have
+ * 				been received (row-group notification): the first half of
+ * 				the frame (DMA half transfer) or the whole frame (frame end).
+ *
+ * @param bytes	bytes already known to be received, 0 after dcmi_capture_start
+ *
+ * @return		Bytes of the frame received, from the start of its buffer
+ * @note		A single thread may wait for the rows.
+ *
+ */
+uint32_t dcmi_wait_bytes_received(uint32_t bytes);
+
 /**
  * @brief 		Returns if double buffering is enabled.
  *
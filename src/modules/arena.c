@@ -0,0 +1,223 @@
+/**
+ * @file    arena.c
+ * @brief   Static per-frame memory arena of the image pipeline.
+ * @note    This module does not depend on ChibiOS, it is shared by the
+ *          e-puck firmware and the host benchmark harness.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Module headers
+
+#include <arena.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define ARENA_ALIGN        8
+#define NO_BLOCK           UINT32_MAX
+
+// Flag of the freed blocks in the size field of their header
+#define BLOCK_FREE         0x80000000
+
+// The CCM section is not cleared at startup, the blocks are never read
+// before they are written (arena_calloc() clears its blocks)
+#if ARENA_IN_CCM
+#if ARENA_SIZE > CCM_SIZE
+#error "the arena of the profile does not fit in the CCM"
+#endif
+#define ARENA_PLACEMENT    __attribute__((section(".ram4")))
+#else
+#define ARENA_PLACEMENT
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+// Stored in front of each block, links it to the block below
+typedef struct block_header {
+	uint32_t prev;          // offset of the previous block, NO_BLOCK if none
+	uint32_t size;          // size of the data, BLOCK_FREE once freed
+} block_header;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static union {
+	uint8_t bytes[ARENA_SIZE];
+	uint64_t align;
+} arena ARENA_PLACEMENT;
+
+static uint32_t top = 0;            // first free byte
+static uint32_t last = NO_BLOCK;    // header of the block at the top
+static uint32_t high_size = 0;      // size of the block at the high end
+static arena_stats stats;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static inline block_header* header_at(uint32_t offset)
+{
+	return (block_header*)&arena.bytes[offset];
+}
+
+static inline uint32_t header_offset(void* ptr)
+{
+	return (uint8_t*)ptr - arena.bytes - sizeof(block_header);
+}
+
+static inline size_t align_size(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/**
+ * @brief                       bytes left between the top and the high block
+ */
+static inline size_t free_bytes(uint32_t from)
+{
+	return ARENA_SIZE - high_size - from;
+}
+
+/**
+ * @brief                       updates the bytes used and the peaks
+ * @return                      none
+ */
+static void update_usage(void)
+{
+	stats.used_bytes = top + high_size;
+	if (stats.used_bytes > stats.peak_bytes)
+		stats.peak_bytes = stats.used_bytes;
+	if (stats.used_bytes > stats.frame_peak_bytes)
+		stats.frame_peak_bytes = stats.used_bytes;
+}
+
+/**
+ * @brief                       moves the top of the arena
+ * @param[in]   new_top         first free byte
+ * @return                      none
+ */
+static void set_top(uint32_t new_top)
+{
+	top = new_top;
+	update_usage();
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+void arena_reset(void)
+{
+	top = 0;
+	last = NO_BLOCK;
+	high_size = 0;
+	stats.used_bytes = 0;
+	stats.peak_bytes = 0;
+	stats.frame_peak_bytes = 0;
+	stats.failures = 0;
+}
+
+void* arena_malloc(size_t size)
+{
+	size = align_size(size);
+	if (size + sizeof(block_header) > free_bytes(top)) {
+		++stats.failures;
+		return NULL;
+	}
+
+	block_header* header = header_at(top);
+	header->prev = last;
+	header->size = size;
+	last = top;
+	++stats.allocs;
+	set_top(top + sizeof(block_header) + size);
+	return header + 1;
+}
+
+void* arena_calloc(size_t nmemb, size_t size)
+{
+	void* ptr = arena_malloc(nmemb*size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb*size);
+	return ptr;
+}
+
+void* arena_realloc(void* ptr, size_t size)
+{
+	if (ptr == NULL)
+		return arena_malloc(size);
+
+	uint32_t offset = header_offset(ptr);
+	block_header* header = header_at(offset);
+	size = align_size(size);
+
+	if (offset == last) {
+		if (size + sizeof(block_header) > free_bytes(offset)) {
+			++stats.failures;
+			return NULL;
+		}
+		header->size = size;
+		set_top(offset + sizeof(block_header) + size);
+		return ptr;
+	}
+	if (size <= header->size)
+		return ptr;
+
+	void* new_ptr = arena_malloc(size);
+	if (new_ptr == NULL)
+		return NULL;
+	memcpy(new_ptr, ptr, header->size);
+	arena_free(ptr);
+	return new_ptr;
+}
+
+void arena_free(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+	header_at(header_offset(ptr))->size |= BLOCK_FREE;
+
+	// the freed blocks at the top are reclaimed
+	uint32_t new_top = top;
+	while (last != NO_BLOCK && (header_at(last)->size & BLOCK_FREE)) {
+		new_top = last;
+		last = header_at(last)->prev;
+	}
+	set_top(new_top);
+}
+
+void* arena_realloc_high(void* ptr, size_t size)
+{
+	size = align_size(size);
+	if (size > high_size && size - high_size > free_bytes(top)) {
+		++stats.failures;
+		return NULL;
+	}
+
+	uint8_t* block = &arena.bytes[ARENA_SIZE - size];
+	if (ptr != NULL && size > 0)
+		memmove(block, ptr, size < high_size ? size : high_size);
+	high_size = size;
+	update_usage();
+	return size > 0 ? block : NULL;
+}
+
+void arena_mark(void)
+{
+	stats.allocs = 0;
+	stats.peak_bytes = stats.used_bytes;
+}
+
+arena_stats arena_get_stats(void)
+{
+	return stats;
+}
@@ -0,0 +1,1479 @@
+/**
+ * @file    canny.c
+ * @brief   Canny edge detection and color classification of an RGB565 image.
+ * @details The thresholds of the hysteresis adapt to each frame: the sobel
+ *          filter builds a histogram of the gradient intensity on the fly and
+ *          the thresholds are two of its percentiles, read in one walk over
+ *          its bins. The hysteresis labels the runs of strong and weak pixels
+ *          row by row with a union-find of their labels and writes the kept
+ *          components to a 1 bit per pixel edge map.
+ *
+ *          The streaming engine runs the grayscale conversion, the gaussian
+ *          filter and the gradient histogram on the rows of a frame as they
+ *          land from the camera, only the thresholds, the non-maximum
+ *          suppression and the hysteresis wait for the whole frame.
+ *
+ *          In the flat-color mode, the regions of pixels of the same color
+ *          class are labeled with the same runs and union-find, and their
+ *          outlines replace the edges. A multi-frame capture sums the
+ *          grayscale images of several frames and detects the edges of their
+ *          average.
+ * @note    This module does not depend on ChibiOS, it is shared by the
+ *          e-puck firmware and the host benchmark harness.
+ */
+
+// C standard header files
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Module headers
+
+#include <canny.h>
+#include <edge_map.h>
+#include <arena.h>
+#include <color_params.h>
+#include <color_lut.h>
+#include <gaussian.h>
+#include <mod_img_processing.h>
+#include <mod_data.h>
+#include <tools.h>
+
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Convolution offsets
+
+#define XY_OFFSET_3x3      1
+
+// Gradient intensity, scaled L2 norm approximated by
+// max(|Ix|,|Iy|) + 1/2 min(|Ix|,|Iy|) - 1/8 max(|Ix|,|Iy|), at least max:
+// error within [-3%, +1%], intensity up to 8*1030 fits in 16 bits
+
+#define MAG_SCALE          8
+#define MAG_MAX_COEFF      7
+#define MAG_MIN_COEFF      4
+
+// Octant limits: tan(22.5 deg) in fixed point
+
+#define TAN_22_5_FP        27146    // tan(22.5 deg) * TAN_FP_ONE
+#define TAN_FP_ONE         65536
+
+// Adaptive thresholds: percentiles of the gradient intensity of the image,
+// read from a histogram built by the sobel filter (bins of 2^HIST_SHIFT
+// intensities, the last one holds all the higher ones). They do not go below
+// fixed fractions of the maximum gradient (per mille), so that the noise of
+// large flat areas is not taken for edges.
+
+#define HIGH_PERCENTILE    70
+#define LOW_PERCENTILE     50
+#define HIGH_THRESHOLD_MIN 100
+#define LOW_THRESHOLD_MIN  30
+#define HIST_SHIFT         5
+#define HIST_BINS          256
+#define HIST_PIXELS        ((IM_LENGTH_PX - 2*XY_OFFSET_3x3)*(IM_HEIGHT_PX - 2*XY_OFFSET_3x3))
+
+#define WEAK_PIXEL         100
+#define BG_PIXEL           0
+
+// If the maximum of all pixels in I_mag is under this value,
+// the picture is considered pitch black
+
+#define MIN_I_MAG          (100*MAG_SCALE)
+
+// Channel levels of an RGB565 pixel
+
+#define RED_LEVEL_POS      11
+#define GREEN_LEVEL_POS    5
+
+// Streaming engine
+
+#define RING_ROWS          3        // rows kept for each 3x3 window
+
+// Connected component labeling of the hysteresis
+
+#define NO_LABEL           0
+#define LABELS_INIT        64       // initial size of the label table
+#define MAX_ROW_RUNS       (IM_LENGTH_PX - 2*MARGIN_PX) // runs of the regions
+                                    // may be adjacent
+
+// Smallest components kept (pixels): isolated edge pixels are removed, color
+// regions smaller than MIN_REGION_PX are not outlined
+
+#define MIN_EDGE_PX        2
+#define MIN_REGION_PX      16
+
+// Flags stored in the color buffer for strong pixels until their color is
+// resolved (see resolve_strong_colors)
+
+#define COLOR_STRONG       0x80
+#define COLOR_RESOLVED     0x40
+#define COLOR_OCTANT_POS   3
+#define COLOR_VALUE_MASK   0x07
+
+const int8_t Kx[] = { -1,  0,  1,
+                      -2,  0,  2,
+                      -1,  0,  1 };
+
+const int8_t Ky[] = { 1,  2,  1,
+                      0,  0,  0,
+                     -1, -2, -1 };
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+// Rolling rows of the streaming engine, row y is stored at index y%RING_ROWS
+typedef struct canny_rows {
+	uint16_t hpass[GAUSSIAN_TAPS][IM_LENGTH_PX];
+	uint8_t gauss[RING_ROWS][IM_LENGTH_PX];
+	uint16_t mag[RING_ROWS][IM_LENGTH_PX];
+	uint8_t octant[RING_ROWS][IM_LENGTH_PX];
+} canny_rows;
+
+// Horizontal run of strong and weak pixels, columns [start, end[
+typedef struct edge_run {
+	img_coord start;
+	img_coord end;
+	uint16_t label;
+} edge_run;
+
+// Runs of one row
+typedef struct run_row {
+	edge_run runs[MAX_ROW_RUNS];
+	img_coord nb_runs;
+} run_row;
+
+// Provisional label of the hysteresis, the statistics are those of the
+// pixels labeled with it until the labels are merged into their root
+typedef struct label_info {
+	uint16_t parent;       // union-find parent, itself for a root
+	uint16_t nb_pixels;
+	img_coord x_min;
+	img_coord x_max;
+	img_coord y_min;
+	img_coord y_max;
+	bool strong;           // at least one strong pixel
+	bool keep;             // root only: the component is an edge
+} label_info;
+
+// Frame fed to the streaming engine as its rows land (canny_stream_rows())
+typedef struct canny_stream_state {
+	const gray_sum* average;
+	uint8_t* color;
+	stage_hook hook;
+	canny_rows* rows;
+	img_coord gray_rows;   // rows converted to grayscale
+	img_coord gauss_rows;  // rows through the first gaussian and sobel pass
+	uint16_t max;          // maximum gradient of the rows passed
+} canny_stream_state;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static uint8_t *img_buffer;
+static uint8_t *img_temp_buffer;
+
+static uint8_t *sobel_angle_state;
+static uint16_t *I_mag;
+
+// gradient histogram of the image, and thresholds derived from it (scaled
+// like the output of the local max suppression)
+static img_index *gradient_hist;
+static uint8_t high_threshold;
+static uint8_t low_threshold;
+static canny_thresholds thresholds;
+
+// strong and weak pixels (candidates of the hysteresis) then edges, and
+// strong pixels only
+static edge_map *edges;
+static edge_map *strong_map;
+
+static label_info *labels;
+static uint16_t labels_size;
+
+// components of the last edge image
+static edge_component *components = NULL;
+static uint16_t nb_components = 0;
+
+static canny_stream_state stream;
+
+// offset to the neighbour each octant points to, first_octant at index 0
+static const int16_t octant_offset[] = {
+	1, 1 - IM_LENGTH_PX, -IM_LENGTH_PX, -1 - IM_LENGTH_PX,
+	-1, -1 + IM_LENGTH_PX, IM_LENGTH_PX, 1 + IM_LENGTH_PX
+};
+
+// neighbour compared by the local max suppression, the opposed neighbour is
+// at (-dx, -dy), first_octant at index 0
+static const int8_t nms_dx[] = {-1, 1, 0, -1, -1, 1, 0, -1};
+static const int8_t nms_dy[] = { 0, -1, -1, -1, 0, -1, -1, -1};
+
+// octant of a gradient from the signs of Iy and Ix (index 2*(Iy<0) + (Ix<0))
+// and from its sector: 0 along the Iy axis, 1 diagonal, 2 along the Ix axis
+static const uint8_t octant_lut[] = {
+	first_octant, second_octant, third_octant,
+	first_octant, eighth_octant, seventh_octant,
+	fifth_octant, fourth_octant, third_octant,
+	fifth_octant, sixth_octant, seventh_octant
+};
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                       grayscale level of an rgb565 pixel
+ * @param[in]   red_px, green_px, blue_px 5/6/5 channel levels
+ * @return                      luma in range 0-255
+ */
+static inline uint8_t luma(uint8_t red_px, uint8_t green_px, uint8_t blue_px)
+{
+	return (luma_red_lut[red_px] + luma_green_lut[green_px]
+	        + luma_blue_lut[blue_px]) >> LUMA_FP_SHIFT;
+}
+
+/**
+ * @brief                       converts an rgb565 color to a grayscale image
+ *                              and classifies image colors
+ * @param[in]   average         running sum of several frames whose average
+ *                              replaces the grayscale image (may be NULL)
+ * @param[out]  color           pointer to buffer containing path color
+ * @param[in]   start, end      pixels [start, end[ converted, in place: the
+ *                              pixels from end on keep their rgb565 value
+ * @return                      none
+ * @note                        Only table lookups and additions, the tables
+ *                              are generated from color_params.h (see
+ *                              gen_color_lut.c).
+ */
+static void set_grayscale_filter_colors(const gray_sum* average, uint8_t* color,
+                                        img_index start, img_index end)
+{
+	bool averaged = average != NULL && average->nb_frames != 0;
+	uint16_t half = averaged ? average->nb_frames/2 : 0;
+
+	for (img_index i = start; i < end; ++i) {
+
+		// extract the 5/6/5 channel levels
+		uint16_t rgb_565 = ((uint16_t)img_buffer[2*i] << 8) | img_buffer[2*i+1];
+		uint8_t red_px = rgb_565 >> RED_LEVEL_POS;
+		uint8_t green_px = (rgb_565 & GREEN_MASK) >> GREEN_LEVEL_POS;
+		uint8_t blue_px = rgb_565 & BLUE_MASK;
+
+		// classify pixel color (black, red, green, blue, background (white))
+		uint8_t flags = color_rg_lut[red_px][green_px] & color_rb_lut[red_px][blue_px]
+		                & color_gb_lut[green_px][blue_px];
+		uint16_t sum = ((rgb_565 & RED_MASK) >> RGB_RED_POS)
+		               + ((rgb_565 & GREEN_MASK) >> RGB_GREEN_POS)
+		               + ((rgb_565 & BLUE_MASK) << RGB_BLUE_POS);
+		if (sum < BLACK_LEVEL_SUM)
+			flags |= COLOR_FLAG_BLACK;
+		color[i] = color_class_lut[flags];
+
+		// convert img_buffer to grayscale
+		if (averaged)
+			img_buffer[i] = (average->px[i] + half) / average->nb_frames;
+		else
+			img_buffer[i] = luma(red_px, green_px, blue_px);
+	}
+}
+
+/**
+ * @brief                       Gaussian filter of one image row.
+ * @param[in]   y               row to filter, rows are filtered in order from
+ *                              0. Row y+2 of img_buffer must still hold the
+ *                              grayscale image.
+ * @param[in,out] hpass         horizontal passes of the last GAUSSIAN_TAPS
+ *                              rows, row y is stored at index y%GAUSSIAN_TAPS
+ * @param[out]  out             filtered row
+ * @return                      none
+ */
+static void gaussian_row(img_coord y, uint16_t hpass[GAUSSIAN_TAPS][IM_LENGTH_PX],
+                         uint8_t* out)
+{
+	if (y == 0) {
+		for (uint8_t i = 0; i < GAUSSIAN_RADIUS && i < IM_HEIGHT_PX; ++i)
+			gaussian_hpass(&img_buffer[position(0, i)], hpass[i], IM_LENGTH_PX);
+	}
+	if (y + GAUSSIAN_RADIUS < IM_HEIGHT_PX) {
+		gaussian_hpass(&img_buffer[position(0, y + GAUSSIAN_RADIUS)],
+		               hpass[(y + GAUSSIAN_RADIUS) % GAUSSIAN_TAPS], IM_LENGTH_PX);
+	}
+
+	const uint8_t* row = &img_buffer[position(0, y)];
+	if (y < GAUSSIAN_RADIUS || y + GAUSSIAN_RADIUS >= IM_HEIGHT_PX) {
+		for (img_coord x = 0; x < IM_LENGTH_PX; ++x)
+			out[x] = row[x];
+		return;
+	}
+
+	const uint16_t* h[GAUSSIAN_TAPS];
+	for (uint8_t i = 0; i < GAUSSIAN_TAPS; ++i)
+		h[i] = hpass[(y + i + GAUSSIAN_TAPS - GAUSSIAN_RADIUS) % GAUSSIAN_TAPS];
+	gaussian_vpass(h, row, out, IM_LENGTH_PX);
+}
+
+/**
+ * @brief                       Filters out obvious noise and smoothens the image.
+ * @return                      false if the arena budget is exceeded
+ * @note                        A separable 5x5 Gaussian filter was chosen with
+ *                              a standard deviation of 1.
+ */
+static bool gaussian_filter(void)
+{
+	uint16_t (*hpass)[IM_LENGTH_PX] = arena_calloc(GAUSSIAN_TAPS, sizeof(*hpass));
+	if (hpass == NULL)
+		return false;
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y)
+		gaussian_row(y, hpass, &img_temp_buffer[position(0, y)]);
+	arena_free(hpass);
+	return true;
+}
+
+/**
+ * @brief                       Finds in which octant the gradient points.
+ * @param[in]   Ix              gradient computed with the Kx kernel
+ * @param[in]   Iy              gradient computed with the Ky kernel
+ * @return                      octant (enum Octants)
+ * @note                        The angle is atan2(Ix, Iy): the octant is found
+ *                              from the signs and from the comparison of
+ *                              |Ix| and |Iy| with tan(22.5 deg), without
+ *                              branches.
+ */
+static uint8_t gradient_octant(int16_t Ix, int16_t Iy)
+{
+	int32_t abs_ix = Ix < 0 ? -Ix : Ix;
+	int32_t abs_iy = Iy < 0 ? -Iy : Iy;
+	uint8_t sector = (abs_ix*TAN_FP_ONE > abs_iy*TAN_22_5_FP)
+	                 + (abs_iy*TAN_FP_ONE < abs_ix*TAN_22_5_FP);
+	return octant_lut[((Iy < 0) << 1 | (Ix < 0))*3 + sector];
+}
+
+/**
+ * @brief                       Computes the gradient intensity.
+ * @param[in]   Ix              gradient computed with the Kx kernel
+ * @param[in]   Iy              gradient computed with the Ky kernel
+ * @return                      intensity, MAG_SCALE times the L2 norm
+ */
+static uint16_t gradient_magnitude(int16_t Ix, int16_t Iy)
+{
+	uint16_t ax = Ix < 0 ? -Ix : Ix;
+	uint16_t ay = Iy < 0 ? -Iy : Iy;
+	uint16_t max = ax > ay ? ax : ay;
+	uint16_t min = ax > ay ? ay : ax;
+	uint16_t mag = MAG_MAX_COEFF*max + MAG_MIN_COEFF*min;
+	return mag > MAG_SCALE*max ? mag : MAG_SCALE*max;
+}
+
+/**
+ * @brief                       Suppresses a pixel that is not a local maximum
+ *                              of the gradient intensity.
+ * @param[in]   mag             gradient intensity of the pixel
+ * @param[in]   mag_octant      gradient intensity of the neighbour in the
+ *                              gradient direction
+ * @param[in]   mag_opposed     gradient intensity of the opposed neighbour
+ * @param[in]   max             maximum gradient intensity of the image
+ * @return                      intensity scaled to STRONG_PIXEL, or BG_PIXEL
+ */
+static uint8_t local_max_value(uint16_t mag, uint16_t mag_octant,
+                               uint16_t mag_opposed, uint16_t max)
+{
+	if ((mag >= mag_octant) && (mag >= mag_opposed))
+		return (uint32_t)mag*STRONG_PIXEL/max;
+	else
+		return BG_PIXEL;
+}
+
+/**
+ * @brief                       Separates a pixel into Strong, Weak or
+ *                              Background pixel.
+ * @param[in]   value           output of the local max suppression
+ * @return                      STRONG_PIXEL, WEAK_PIXEL or BG_PIXEL
+ */
+static uint8_t threshold_value(uint8_t value)
+{
+	if (value > high_threshold)
+		return STRONG_PIXEL;
+	else if (value > low_threshold)
+		return WEAK_PIXEL;
+	else
+		return BG_PIXEL;
+}
+
+/**
+ * @brief                       Counts a gradient intensity in the histogram.
+ * @param[in]   mag             gradient intensity
+ * @return                      none
+ */
+static inline void histogram_add(uint16_t mag)
+{
+	uint16_t bin = mag >> HIST_SHIFT;
+	++gradient_hist[bin < HIST_BINS ? bin : HIST_BINS - 1];
+}
+
+/**
+ * @brief                       Returns the gradient intensity under which a
+ *                              percentage of the pixels are, interpolated
+ *                              inside its bin of the histogram.
+ * @param[in]   percent         percentile
+ * @return                      gradient intensity
+ */
+static uint16_t histogram_percentile(uint8_t percent)
+{
+	img_index target = (uint32_t)HIST_PIXELS*percent/100;
+	img_index below = 0;
+	for (uint16_t bin = 0; bin < HIST_BINS; ++bin) {
+		if (below + gradient_hist[bin] > target)
+			return (bin << HIST_SHIFT)
+			       + ((uint32_t)(target - below) << HIST_SHIFT)/gradient_hist[bin];
+		below += gradient_hist[bin];
+	}
+	return HIST_BINS << HIST_SHIFT;
+}
+
+/**
+ * @brief                       Derives the thresholds of the image from its
+ *                              gradient histogram, in O(HIST_BINS).
+ * @param[in]   max             maximum gradient intensity of the image
+ * @return                      none
+ */
+static void set_thresholds(uint16_t max)
+{
+	uint16_t high = histogram_percentile(HIGH_PERCENTILE);
+	uint16_t low = histogram_percentile(LOW_PERCENTILE);
+	uint16_t high_min = (uint32_t)max*HIGH_THRESHOLD_MIN/1000;
+	uint16_t low_min = (uint32_t)max*LOW_THRESHOLD_MIN/1000;
+	if (high < high_min)
+		high = high_min;
+	if (high > max)
+		high = max;
+	if (low < low_min)
+		low = low_min;
+	if (low > high)
+		low = high;
+
+	high_threshold = max > 0 ? (uint32_t)high*STRONG_PIXEL/max : STRONG_PIXEL;
+	low_threshold = max > 0 ? (uint32_t)low*STRONG_PIXEL/max : STRONG_PIXEL;
+	thresholds.max = max/MAG_SCALE;
+	thresholds.high = high/MAG_SCALE;
+	thresholds.low = low/MAG_SCALE;
+}
+
+/**
+ * @brief                       The sobel filter emphasizes edges by computing
+ *                              the norm of the gradient of the image intensity
+ *                              for each pixel. From these values, we can also
+ *                              extract the gradient's angle from this function
+ *                              and use it later for edge thinning. The
+ *                              gradient histogram is built on the way.
+ * @return        max           The maximum gradient intensity computed for an image.
+ */
+static uint16_t sobel_filter(void)
+{
+	uint16_t max = 0;
+	img_index pos = 0;
+	for (img_coord y = XY_OFFSET_3x3; y < IM_HEIGHT_PX-XY_OFFSET_3x3; ++y) {
+		for (img_coord x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
+			pos = position(x,y);
+			int16_t Ix = 10;
+			int16_t Iy = 0;
+			uint16_t k = 0;
+			for (int8_t x_ker = -XY_OFFSET_3x3; x_ker <= XY_OFFSET_3x3; ++x_ker) {
+				for (int8_t y_ker = -XY_OFFSET_3x3; y_ker <= XY_OFFSET_3x3; ++y_ker) {
+					Ix += img_temp_buffer[pos + x_ker +(y_ker * IM_LENGTH_PX)]*Kx[k];
+					Iy += img_temp_buffer[pos+ x_ker +(y_ker * IM_LENGTH_PX)]*Ky[k];
+					++k;
+				}
+			}
+			I_mag[pos] = gradient_magnitude(Ix, Iy);
+			if (I_mag[pos]>max)
+				max = I_mag[pos];
+			histogram_add(I_mag[pos]);
+
+			sobel_angle_state[pos] = gradient_octant(Ix, Iy);
+		}
+	}
+	return max;
+}
+
+/**
+ * @brief                       Gives strong pixels the color of the neighbour
+ *                              their gradient points to, in row-major order.
+ * @param[in,out] color         color buffer with flagged strong pixels
+ * @return                      none
+ * @details                     A strong neighbour in octants 3 to 6 hands
+ *                              over its new color, any other neighbour its
+ *                              own color, as if the image was visited column
+ *                              by column and the colors copied in place.
+ *                              Following these chains gives the same colors
+ *                              in any visiting order. Each strong pixel keeps
+ *                              its own color in the low bits until every
+ *                              chain is resolved.
+ */
+static void resolve_strong_colors(uint8_t* color)
+{
+	for (img_index pos = 0; pos < IM_LENGTH_PX*IM_HEIGHT_PX; ++pos) {
+		if (!(color[pos] & COLOR_STRONG))
+			continue;
+
+		// find the color at the end of the chain
+		uint16_t p = pos;
+		uint8_t value = 0;
+		while (1) {
+			uint8_t c = color[p];
+			if (c & COLOR_RESOLVED) {
+				value = (c >> COLOR_OCTANT_POS) & COLOR_VALUE_MASK;
+				break;
+			}
+			uint8_t octant = ((c >> COLOR_OCTANT_POS) & COLOR_VALUE_MASK) + 1;
+			uint16_t q = p + octant_offset[octant-1];
+			if ((color[q] & COLOR_STRONG) && octant >= third_octant
+			    && octant <= sixth_octant) {
+				p = q;
+			} else {
+				value = color[q] & COLOR_VALUE_MASK;
+				break;
+			}
+		}
+
+		// every pixel of the chain takes this color
+		p = pos;
+		while (!(color[p] & COLOR_RESOLVED)) {
+			uint8_t c = color[p];
+			uint8_t octant = ((c >> COLOR_OCTANT_POS) & COLOR_VALUE_MASK) + 1;
+			uint16_t q = p + octant_offset[octant-1];
+			color[p] = COLOR_STRONG | COLOR_RESOLVED | value << COLOR_OCTANT_POS
+			           | (c & COLOR_VALUE_MASK);
+			if ((color[q] & COLOR_STRONG) && octant >= third_octant
+			    && octant <= sixth_octant)
+				p = q;
+			else
+				break;
+		}
+	}
+
+	for (img_index pos = 0; pos < IM_LENGTH_PX*IM_HEIGHT_PX; ++pos) {
+		if (color[pos] & COLOR_STRONG)
+			color[pos] = (color[pos] >> COLOR_OCTANT_POS) & COLOR_VALUE_MASK;
+	}
+}
+
+/**
+ * @brief                       Sets the color at the edge to the color inside
+ *                              the shape that the edge is encircling.
+ * @note                        The sobel_angle_state buffer tells us in which
+ *                              octant the interior of a shape is, in relation
+ *                              to the corresponding pixel
+ * @param[out]     color        Pointer to buffer containing path color
+ * @return                      none
+ */
+static void set_strong_pixel_colors(uint8_t* color)
+{
+	img_index pos = 0;
+	for (img_coord y = 1; y < IM_HEIGHT_PX-1; ++y) {
+		for (img_coord x = 1; x < IM_LENGTH_PX-1; ++x) {
+			pos = position(x,y);
+			if (edge_map_test(edges, edge_map_bit(x, y)))
+				color[pos] |= COLOR_STRONG
+				              | (sobel_angle_state[pos] - 1) << COLOR_OCTANT_POS;
+		}
+	}
+	resolve_strong_colors(color);
+}
+
+
+/**
+ * @brief                       Depending on the gradient's angle, we know in which
+ *                              direction an edge thickens for all pixels.
+ *                              Given that, we check if a pixel's gradient intensity
+ *                              is higher than both pixels located in its
+ *                              corresponding octants. If it is the case, then
+ *                              we keep its value. If not, then we put it to 0.
+ * @param[in]      max          The maximum gradient intensity computed for an image.
+ * @return                      none
+ */
+static void local_max_supression(uint16_t max)
+{
+	img_index pos = 0;
+	for (img_coord y = XY_OFFSET_3x3; y < IM_HEIGHT_PX-XY_OFFSET_3x3; ++y) {
+		for (img_coord x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
+			pos = position(x,y);
+			uint8_t octant = sobel_angle_state[pos] - 1;
+			int16_t offset = nms_dx[octant] + nms_dy[octant]*IM_LENGTH_PX;
+			img_buffer[pos] = local_max_value(I_mag[pos], I_mag[pos + offset],
+			                                  I_mag[pos - offset], max);
+		}
+	}
+}
+
+/**
+ * @brief                       Sets the bits of a pixel in the edge maps of
+ *                              the hysteresis.
+ * @param[in]   x, y            pixel coordinates
+ * @param[in]   value           Strong, Weak or Background pixel
+ * @return                      none
+ */
+static void set_threshold_bits(img_coord x, img_coord y, uint8_t value)
+{
+	uint16_t bit = edge_map_bit(x, y);
+	if (value != BG_PIXEL)
+		edge_map_set(edges, bit);
+	if (value == STRONG_PIXEL)
+		edge_map_set(strong_map, bit);
+}
+
+/**
+ * @brief                       Compares the gradient intensity of all pixels to
+ *                              selected threshold values and
+ *                              separates them into 3 categories : Strong pixels,
+ *                              Weak pixels and Background pixels.
+ * @return   none
+ * @note                        Strong and weak pixels are set in edges, strong
+ *                              pixels in strong_map.
+ */
+static void double_threshold(void)
+{
+	for (img_coord y = 0; y < IM_HEIGHT_PX; y++) {
+		for (img_coord x = 0; x < IM_LENGTH_PX; x++)
+			set_threshold_bits(x, y, threshold_value(img_buffer[position(x,y)]));
+	}
+}
+
+
+/**
+ * @brief                       Returns the root of a label and compresses the
+ *                              path to it.
+ * @param[in]   label           provisional label
+ * @return                      root label
+ */
+static uint16_t find_root(uint16_t label)
+{
+	uint16_t root = label;
+	while (labels[root].parent != root)
+		root = labels[root].parent;
+	while (labels[label].parent != root) {
+		uint16_t next = labels[label].parent;
+		labels[label].parent = root;
+		label = next;
+	}
+	return root;
+}
+
+/**
+ * @brief                       Merges the components of two labels, the
+ *                              smallest root becomes the root of both.
+ * @return                      none
+ */
+static void union_labels(uint16_t a, uint16_t b)
+{
+	a = find_root(a);
+	b = find_root(b);
+	if (a < b)
+		labels[b].parent = a;
+	else if (b < a)
+		labels[a].parent = b;
+}
+
+/**
+ * @brief                       Creates a label, the label table grows as needed.
+ * @param[in]   label           new label, one more than the last one
+ * @param[in]   x, y            first pixel of the label
+ * @return                      false if the table cannot grow (arena budget
+ *                              exceeded or labels out of range), the label is
+ *                              not created
+ */
+static bool init_label(uint16_t label, img_coord x, img_coord y)
+{
+	if (label >= labels_size) {
+		if (labels_size > UINT16_MAX/2)
+			return false;
+		label_info* grown = arena_realloc(labels, 2*labels_size*sizeof(label_info));
+		if (grown == NULL)
+			return false;
+		labels = grown;
+		labels_size *= 2;
+	}
+	labels[label].parent = label;
+	labels[label].nb_pixels = 0;
+	labels[label].x_min = labels[label].x_max = x;
+	labels[label].y_min = labels[label].y_max = y;
+	labels[label].strong = false;
+	labels[label].keep = false;
+	return true;
+}
+
+/**
+ * @brief                       Finds the runs of strong and weak pixels of one
+ *                              row and labels them. A run takes the label of
+ *                              the first run of the row above it touches
+ *                              (8-connectivity) or a new label.
+ * @param[in]   y               row index
+ * @param[in]   above           labeled runs of row y-1
+ * @param[out]  row             labeled runs of row y
+ * @param[in]   first_pass      true: labels are created, the labels of
+ *                              touching runs are merged and the pixels counted.
+ *                              false: the labels are given again, in the same
+ *                              order as in the first pass.
+ * @param[in,out] next_label    label given to the next new component
+ * @return                      false if a label cannot be created (first
+ *                              pass only), the row is left incomplete
+ * @note                        The runs are found a word of the edge map at a
+ *                              time, the runs of both rows are sorted so that
+ *                              the touching runs are found in one sweep.
+ */
+static bool label_runs(img_coord y, const run_row* above, run_row* row, bool first_pass,
+                       uint16_t* next_label)
+{
+	img_coord first_above = 0;
+	img_coord start, end;
+
+	row->nb_runs = 0;
+	for (img_coord x = 0; (start = edge_map_next_run(edges, y, x, &end)) < IM_LENGTH_PX;
+	     x = end) {
+		// runs of the row above that end before the pixel left of this run
+		// cannot touch the following runs either
+		while (first_above < above->nb_runs && above->runs[first_above].end < start)
+			++first_above;
+
+		uint16_t label = NO_LABEL;
+		for (img_coord i = first_above; i < above->nb_runs
+		     && above->runs[i].start <= end; ++i) {
+			uint16_t neighbour = above->runs[i].label;
+			if (neighbour == label)
+				continue;
+			if (label == NO_LABEL)
+				label = neighbour;
+			else if (first_pass)
+				union_labels(label, neighbour);
+		}
+		if (label == NO_LABEL) {
+			label = (*next_label)++;
+			if (first_pass && !init_label(label, start, y))
+				return false;
+		}
+
+		edge_run* run = &row->runs[row->nb_runs++];
+		run->start = start;
+		run->end = end;
+		run->label = label;
+
+		if (first_pass) {
+			label_info* info = &labels[label];
+			info->nb_pixels += end - start;
+			if (start < info->x_min)
+				info->x_min = start;
+			if (end - 1 > info->x_max)
+				info->x_max = end - 1;
+			info->y_max = y;
+			if (!info->strong && edge_map_any(strong_map, y, start, end))
+				info->strong = true;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief                       Forgets the components of the previous image.
+ * @return                      none
+ * @note                        They are not freed: the arena may have been
+ *                              reset since, it reclaims them with the frame.
+ */
+static void drop_components(void)
+{
+	components = NULL;
+	nb_components = 0;
+}
+
+/**
+ * @brief                       Gives up the edges of the image when the arena
+ *                              budget is exceeded: the edge map is cleared and
+ *                              the components are freed.
+ * @return                      none
+ */
+static void drop_edges(void)
+{
+	arena_free(components);
+	drop_components();
+	edge_map_clear(edges);
+}
+
+/**
+ * @brief                       Merges the statistics of every label into its
+ *                              root, decides which components are kept and
+ *                              lists them in components.
+ * @param[in]   nb_labels       number of labels (including NO_LABEL)
+ * @param[in]   min_pixels      smallest component kept
+ * @return                      false if the arena budget is exceeded
+ * @note                        A component is kept if it has a strong pixel
+ *                              and at least min_pixels pixels.
+ */
+static bool merge_labels(uint16_t nb_labels, uint16_t min_pixels)
+{
+	// roots are smaller than the labels of their component
+	for (uint16_t label = 1; label < nb_labels; ++label) {
+		uint16_t root = find_root(label);
+		if (root == label)
+			continue;
+		label_info* info = &labels[label];
+		label_info* root_info = &labels[root];
+		root_info->nb_pixels += info->nb_pixels;
+		if (info->x_min < root_info->x_min)
+			root_info->x_min = info->x_min;
+		if (info->x_max > root_info->x_max)
+			root_info->x_max = info->x_max;
+		if (info->y_min < root_info->y_min)
+			root_info->y_min = info->y_min;
+		if (info->y_max > root_info->y_max)
+			root_info->y_max = info->y_max;
+		root_info->strong |= info->strong;
+	}
+
+	uint16_t nb_kept = 0;
+	for (uint16_t label = 1; label < nb_labels; ++label) {
+		label_info* info = &labels[label];
+		info->keep = info->parent == label && info->strong && info->nb_pixels >= min_pixels;
+		nb_kept += info->keep;
+	}
+
+	components = arena_malloc(nb_kept*sizeof(edge_component));
+	if (components == NULL && nb_kept > 0)
+		return false;
+	for (uint16_t label = 1; label < nb_labels; ++label) {
+		label_info* info = &labels[label];
+		if (!info->keep)
+			continue;
+		edge_component* component = &components[nb_components++];
+		component->nb_pixels = info->nb_pixels;
+		component->x_min = info->x_min;
+		component->x_max = info->x_max;
+		component->y_min = info->y_min;
+		component->y_max = info->y_max;
+	}
+	return true;
+}
+
+/**
+ * @brief                       Hysteresis: keeps the connected components
+ *                              (8-connectivity) of strong and weak pixels
+ *                              that contain a strong pixel. The image borders
+ *                              (width = MARGIN_PX) and isolated pixels are
+ *                              removed.
+ * @return                      none
+ * @note                        edges holds the strong and weak pixels and
+ *                              receives the edges in place, strong_map holds
+ *                              the strong pixels. No edge is kept if the
+ *                              arena budget is exceeded.
+ * @details                     Two-pass labeling of the horizontal runs with
+ *                              union-find. The labels are not stored: the
+ *                              second pass gives them again row by row and
+ *                              clears the runs of the removed components, so
+ *                              that only two rows of runs and the label table
+ *                              are needed.
+ */
+static void edge_track_hyst(void)
+{
+	run_row* rows = arena_calloc(2, sizeof(run_row));
+	labels_size = LABELS_INIT;
+	labels = arena_malloc(labels_size*sizeof(label_info));
+	if (rows == NULL || labels == NULL) {
+		arena_free(labels);
+		arena_free(rows);
+		drop_edges();
+		return;
+	}
+
+	// only the pixels inside the margins are labeled
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y) {
+		if (y < MARGIN_PX || y >= IM_HEIGHT_PX - MARGIN_PX) {
+			edge_map_clear_run(edges, y, 0, IM_LENGTH_PX);
+		} else {
+			edge_map_clear_run(edges, y, 0, MARGIN_PX);
+			edge_map_clear_run(edges, y, IM_LENGTH_PX - MARGIN_PX, IM_LENGTH_PX);
+		}
+	}
+
+	uint16_t next_label = NO_LABEL + 1;
+	bool labeled = true;
+	for (img_coord y = MARGIN_PX; y < IM_HEIGHT_PX - MARGIN_PX && labeled; ++y)
+		labeled = label_runs(y, &rows[(y+1) % 2], &rows[y % 2], true, &next_label);
+	if (!labeled || !merge_labels(next_label, MIN_EDGE_PX)) {
+		arena_free(labels);
+		arena_free(rows);
+		drop_edges();
+		return;
+	}
+
+	rows[MARGIN_PX % 2].nb_runs = rows[(MARGIN_PX + 1) % 2].nb_runs = 0;
+
+	next_label = NO_LABEL + 1;
+	for (img_coord y = MARGIN_PX; y < IM_HEIGHT_PX - MARGIN_PX; ++y) {
+		run_row* row = &rows[y % 2];
+		label_runs(y, &rows[(y+1) % 2], row, false, &next_label);
+		for (img_coord i = 0; i < row->nb_runs; ++i) {
+			const edge_run* run = &row->runs[i];
+			if (!labels[labels[run->label].parent].keep)
+				edge_map_clear_run(edges, y, run->start, run->end);
+		}
+	}
+
+	arena_free(labels);
+	arena_free(rows);
+}
+
+/**
+ * @brief                       Finds the next run of pixels of the same color
+ *                              (background excluded) in a row, inside the
+ *                              margins.
+ * @param[in]   color           color of each pixel
+ * @param[in]   y               row
+ * @param[in]   x               first column searched
+ * @param[out]  end             column following the run
+ * @return                      first column of the run, IM_LENGTH_PX if there
+ *                              is none
+ */
+static img_coord next_region_run(const uint8_t* color, img_coord y, img_coord x,
+                                 img_coord* end)
+{
+	const uint8_t* row = &color[position(0, y)];
+	while (x < IM_LENGTH_PX - MARGIN_PX && row[x] == white)
+		++x;
+	if (x >= IM_LENGTH_PX - MARGIN_PX)
+		return *end = IM_LENGTH_PX;
+
+	img_coord start = x;
+	while (x < IM_LENGTH_PX - MARGIN_PX && row[x] == row[start])
+		++x;
+	*end = x;
+	return start;
+}
+
+/**
+ * @brief                       Same as label_runs() for the runs of the color
+ *                              regions: a run takes the label of the first
+ *                              run of the row above of the same color it
+ *                              touches (4-connectivity) or a new label.
+ * @param[in]   color           color of each pixel
+ * @param[in]   y               row index
+ * @param[in]   above           labeled runs of row y-1
+ * @param[out]  row             labeled runs of row y
+ * @param[in]   first_pass      see label_runs()
+ * @param[in,out] next_label    label given to the next new region
+ * @return                      see label_runs()
+ */
+static bool label_region_runs(const uint8_t* color, img_coord y, const run_row* above,
+                              run_row* row, bool first_pass, uint16_t* next_label)
+{
+	img_coord first_above = 0;
+	img_coord start, end;
+
+	row->nb_runs = 0;
+	for (img_coord x = MARGIN_PX;
+	     (start = next_region_run(color, y, x, &end)) < IM_LENGTH_PX; x = end) {
+		uint8_t value = color[position(start, y)];
+
+		// runs of the row above that end before this run cannot overlap the
+		// following runs either
+		while (first_above < above->nb_runs && above->runs[first_above].end <= start)
+			++first_above;
+
+		uint16_t label = NO_LABEL;
+		for (img_coord i = first_above; i < above->nb_runs
+		     && above->runs[i].start < end; ++i) {
+			uint16_t neighbour = above->runs[i].label;
+			if (neighbour == label
+			    || color[position(above->runs[i].start, y - 1)] != value)
+				continue;
+			if (label == NO_LABEL)
+				label = neighbour;
+			else if (first_pass)
+				union_labels(label, neighbour);
+		}
+		if (label == NO_LABEL) {
+			label = (*next_label)++;
+			if (first_pass && !init_label(label, start, y))
+				return false;
+		}
+
+		edge_run* run = &row->runs[row->nb_runs++];
+		run->start = start;
+		run->end = end;
+		run->label = label;
+
+		if (first_pass) {
+			label_info* info = &labels[label];
+			info->nb_pixels += end - start;
+			if (start < info->x_min)
+				info->x_min = start;
+			if (end - 1 > info->x_max)
+				info->x_max = end - 1;
+			info->y_max = y;
+			info->strong = true;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief                       Sets the outline pixels of a run in edges: its
+ *                              ends and the pixels whose neighbour above or
+ *                              below has another color or is in the margins.
+ * @param[in]   color           color of each pixel
+ * @param[in]   y               row of the run
+ * @param[in]   run             run of a region
+ * @return                      number of outline pixels
+ */
+static img_coord set_run_outline(const uint8_t* color, img_coord y, const edge_run* run)
+{
+	const uint8_t* row = &color[position(0, y)];
+	uint8_t value = row[run->start];
+	bool border = y == MARGIN_PX || y == IM_HEIGHT_PX - MARGIN_PX - 1;
+	img_coord count = 0;
+
+	for (img_coord x = run->start; x < run->end; ++x) {
+		if (border || x == run->start || x == run->end - 1
+		    || row[x - IM_LENGTH_PX] != value || row[x + IM_LENGTH_PX] != value) {
+			edge_map_set(edges, edge_map_bit(x, y));
+			++count;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief                       Region segmentation: labels the connected
+ *                              regions (4-connectivity) of pixels of the same
+ *                              color and sets the outline of each region of
+ *                              at least MIN_REGION_PX pixels in edges.
+ * @param[in]   color           color of each pixel
+ * @return                      none
+ * @note                        The components are the outlines, with the
+ *                              bounding box of their region. No region is
+ *                              outlined if the arena budget is exceeded.
+ * @details                     Same two-pass labeling of the runs as the
+ *                              hysteresis: the second pass gives the labels
+ *                              again and outlines the runs of the kept
+ *                              regions.
+ */
+static void segment_regions(const uint8_t* color)
+{
+	run_row* rows = arena_calloc(2, sizeof(run_row));
+	labels_size = LABELS_INIT;
+	labels = arena_malloc(labels_size*sizeof(label_info));
+	if (rows == NULL || labels == NULL) {
+		arena_free(labels);
+		arena_free(rows);
+		return;
+	}
+
+	uint16_t next_label = NO_LABEL + 1;
+	bool labeled = true;
+	for (img_coord y = MARGIN_PX; y < IM_HEIGHT_PX - MARGIN_PX && labeled; ++y)
+		labeled = label_region_runs(color, y, &rows[(y+1) % 2], &rows[y % 2], true,
+		                            &next_label);
+	if (!labeled || !merge_labels(next_label, MIN_REGION_PX)) {
+		arena_free(labels);
+		arena_free(rows);
+		drop_edges();
+		return;
+	}
+
+	// the roots now count the pixels of the outlines
+	for (uint16_t label = 1; label < next_label; ++label) {
+		if (labels[label].keep)
+			labels[label].nb_pixels = 0;
+	}
+
+	rows[MARGIN_PX % 2].nb_runs = rows[(MARGIN_PX + 1) % 2].nb_runs = 0;
+
+	uint16_t nb_labels = next_label;
+	next_label = NO_LABEL + 1;
+	for (img_coord y = MARGIN_PX; y < IM_HEIGHT_PX - MARGIN_PX; ++y) {
+		run_row* row = &rows[y % 2];
+		label_region_runs(color, y, &rows[(y+1) % 2], row, false, &next_label);
+		for (img_coord i = 0; i < row->nb_runs; ++i) {
+			const edge_run* run = &row->runs[i];
+			label_info* root = &labels[labels[run->label].parent];
+			if (root->keep)
+				root->nb_pixels += set_run_outline(color, y, run);
+		}
+	}
+
+	// components are listed in the order of their roots
+	edge_component* component = components;
+	for (uint16_t label = 1; label < nb_labels; ++label) {
+		if (labels[label].keep)
+			(component++)->nb_pixels = labels[label].nb_pixels;
+	}
+
+	arena_free(labels);
+	arena_free(rows);
+}
+
+/**
+ * @brief                       Sobel gradient of one pixel (streaming).
+ * @param[in]   gauss           filtered rows y-1, y and y+1
+ * @param[in]   x               column of the pixel
+ * @param[out]  Ix              gradient computed with the Kx kernel
+ * @param[out]  Iy              gradient computed with the Ky kernel
+ * @return                      none
+ */
+static void sobel_gradient(const uint8_t* gauss[RING_ROWS], img_coord x,
+                           int16_t* Ix, int16_t* Iy)
+{
+	*Ix = 10;
+	*Iy = 0;
+	uint16_t k = 0;
+	for (int8_t x_ker = -XY_OFFSET_3x3; x_ker <= XY_OFFSET_3x3; ++x_ker) {
+		for (int8_t y_ker = -XY_OFFSET_3x3; y_ker <= XY_OFFSET_3x3; ++y_ker) {
+			*Ix += gauss[y_ker+XY_OFFSET_3x3][x + x_ker]*Kx[k];
+			*Iy += gauss[y_ker+XY_OFFSET_3x3][x + x_ker]*Ky[k];
+			++k;
+		}
+	}
+}
+
+/**
+ * @brief                       Sobel filter of one image row (streaming).
+ * @param[in]   gauss           filtered rows y-1, y and y+1
+ * @param[out]  mag             gradient intensity of the row
+ * @param[out]  octant          gradient octant of the row
+ * @return                      none
+ * @note                        Same result as sobel_filter() for this row.
+ */
+static void sobel_row(const uint8_t* gauss[RING_ROWS], uint16_t* mag, uint8_t* octant)
+{
+	mag[0] = mag[IM_LENGTH_PX-1] = 0;
+	octant[0] = octant[IM_LENGTH_PX-1] = 0;
+	for (img_coord x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
+		int16_t Ix, Iy;
+		sobel_gradient(gauss, x, &Ix, &Iy);
+		mag[x] = gradient_magnitude(Ix, Iy);
+		octant[x] = gradient_octant(Ix, Iy);
+	}
+}
+
+/**
+ * @brief                       Local max suppression and double threshold of
+ *                              one image row (streaming). Strong and weak
+ *                              pixels get their gradient octant stored in the
+ *                              color buffer so that their color can be
+ *                              resolved once the edges are known.
+ * @param[in]   mag             gradient intensity of rows y-1, y and y+1
+ * @param[in]   octant          gradient octant of row y
+ * @param[in]   max             maximum gradient intensity of the image
+ * @param[in]   y               row index, its Strong and Weak pixels are set
+ *                              in the edge maps
+ * @param[out]  color           color of row y
+ * @return                      none
+ */
+static void threshold_row(const uint16_t* mag[RING_ROWS], const uint8_t* octant,
+                          uint16_t max, img_coord y, uint8_t* color)
+{
+	const uint16_t* row = mag[1];
+
+	for (img_coord x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
+		uint8_t o = octant[x] - 1;
+		uint16_t mag_octant = mag[1 + nms_dy[o]][x + nms_dx[o]];
+		uint16_t mag_octant_opposed = mag[1 - nms_dy[o]][x - nms_dx[o]];
+		uint8_t thr = threshold_value(local_max_value(row[x], mag_octant,
+		                                              mag_octant_opposed, max));
+		set_threshold_bits(x, y, thr);
+		if (thr != BG_PIXEL)
+			color[x] |= COLOR_STRONG | o << COLOR_OCTANT_POS;
+	}
+}
+
+/**
+ * @brief                       Returns where a row is stored in a ring
+ * @param[in]   y               center row
+ * @param[in]   dy              offset to the center row (-1, 0 or 1)
+ * @return                      index of row y+dy in the ring
+ */
+static uint8_t ring_slot(img_coord y, int8_t dy)
+{
+	return (y + dy + RING_ROWS) % RING_ROWS;
+}
+
+/**
+ * @brief                       Advances the maximum gradient intensity of
+ *                              img_buffer and its gradient histogram over the
+ *                              next rows of the streamed frame, without
+ *                              storing the gradient.
+ * @param[in]   end             first row not filtered, its grayscale rows
+ *                              up to end+GAUSSIAN_RADIUS-1 must be converted
+ * @return                      none
+ */
+static void stream_max_gradient(img_coord end)
+{
+	canny_rows* rows = stream.rows;
+	for (img_coord y = stream.gauss_rows; y < end; ++y) {
+		gaussian_row(y, rows->hpass, rows->gauss[y % RING_ROWS]);
+		if (y < 2)
+			continue;
+		const uint8_t* gauss[RING_ROWS] = {rows->gauss[ring_slot(y-1, -1)],
+		                                   rows->gauss[ring_slot(y-1, 0)],
+		                                   rows->gauss[ring_slot(y-1, 1)]};
+		for (img_coord x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
+			int16_t Ix, Iy;
+			sobel_gradient(gauss, x, &Ix, &Iy);
+			uint16_t mag = gradient_magnitude(Ix, Iy);
+			if (mag > stream.max)
+				stream.max = mag;
+			histogram_add(mag);
+		}
+	}
+	if (end > stream.gauss_rows)
+		stream.gauss_rows = end;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+void canny_accumulate(const uint8_t* image, gray_sum* sum)
+{
+	for (img_index i = 0; i < IM_LENGTH_PX * IM_HEIGHT_PX; ++i) {
+		uint16_t rgb_565 = ((uint16_t)image[2*i] << 8) | image[2*i+1];
+		sum->px[i] += luma(rgb_565 >> RED_LEVEL_POS,
+		                   (rgb_565 & GREEN_MASK) >> GREEN_LEVEL_POS,
+		                   rgb_565 & BLUE_MASK);
+	}
+	++sum->nb_frames;
+}
+
+void canny_edge(uint8_t* image, const gray_sum* average, uint8_t* color,
+                edge_map* edge_pixels, stage_hook hook)
+{
+	img_buffer = image;
+	edges = edge_pixels;
+	edge_map_clear(edges);
+	drop_components();
+	thresholds = (canny_thresholds){0};
+
+	set_grayscale_filter_colors(average, color, 0, IM_LENGTH_PX*IM_HEIGHT_PX);
+
+	if (hook != NULL)
+		hook(STAGE_GRAYSCALE, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+
+	// sobel_angle_state outlives img_temp_buffer and I_mag, it is allocated
+	// first so that they are freed from the top of the arena
+	// the frame is dropped (no edge) if the arena budget is exceeded
+	sobel_angle_state = arena_calloc(IM_LENGTH_PX*IM_HEIGHT_PX, sizeof(uint8_t));
+	img_temp_buffer = arena_calloc(IM_LENGTH_PX*IM_HEIGHT_PX, sizeof(uint8_t));
+	if (sobel_angle_state == NULL || img_temp_buffer == NULL || !gaussian_filter()) {
+		arena_free(img_temp_buffer);
+		arena_free(sobel_angle_state);
+		return;
+	}
+
+	if (hook != NULL)
+		hook(STAGE_GAUSS, img_temp_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+
+	// I_mag is zeroed so that the image borders never hold stale magnitudes
+	I_mag = arena_calloc(IM_LENGTH_PX*IM_HEIGHT_PX, sizeof(uint16_t));
+	gradient_hist = arena_calloc(HIST_BINS, sizeof(img_index));
+	if (I_mag == NULL || gradient_hist == NULL) {
+		arena_free(gradient_hist);
+		arena_free(I_mag);
+		arena_free(img_temp_buffer);
+		arena_free(sobel_angle_state);
+		return;
+	}
+
+	uint16_t max = sobel_filter();
+	set_thresholds(max);
+	arena_free(gradient_hist);
+
+	if (hook != NULL)
+		hook(STAGE_SOBEL, sobel_angle_state, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+
+	local_max_supression(max);
+
+	if (hook != NULL)
+		hook(STAGE_LOCAL_MAX, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+
+	arena_free(I_mag);
+	arena_free(img_temp_buffer);
+
+	if (max > MIN_I_MAG) {
+		strong_map = arena_calloc(1, sizeof(edge_map));
+		if (strong_map != NULL) {
+			double_threshold();
+			edge_track_hyst();
+			arena_free(strong_map);
+			set_strong_pixel_colors(color);
+		}
+	}
+
+	if (hook != NULL) {
+		edge_map_to_image(edges, img_buffer);
+		hook(STAGE_HYSTERESIS, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+	}
+
+	arena_free(sobel_angle_state);
+}
+
+void canny_edge_stream(uint8_t* image, const gray_sum* average, uint8_t* color,
+                       edge_map* edge_pixels, stage_hook hook)
+{
+	canny_stream_begin(image, average, color, edge_pixels, hook);
+	canny_stream_end();
+}
+
+void canny_stream_begin(uint8_t* image, const gray_sum* average, uint8_t* color,
+                        edge_map* edge_pixels, stage_hook hook)
+{
+	img_buffer = image;
+	edges = edge_pixels;
+	edge_map_clear(edges);
+	drop_components();
+	thresholds = (canny_thresholds){0};
+
+	stream = (canny_stream_state){.average = average, .color = color, .hook = hook};
+	stream.rows = arena_calloc(1, sizeof(canny_rows));
+
+	// the thresholds depend on the gradient of the whole image, its histogram
+	// is built as the rows land
+	gradient_hist = arena_calloc(HIST_BINS, sizeof(img_index));
+
+	// the frame is only converted (no edge) if the arena budget is exceeded
+	if (stream.rows == NULL || gradient_hist == NULL) {
+		arena_free(gradient_hist);
+		arena_free(stream.rows);
+		stream.rows = NULL;
+	}
+}
+
+void canny_stream_rows(img_coord nb_rows)
+{
+	if (nb_rows > IM_HEIGHT_PX)
+		nb_rows = IM_HEIGHT_PX;
+	if (nb_rows <= stream.gray_rows)
+		return;
+
+	set_grayscale_filter_colors(stream.average, stream.color,
+	                            position(0, stream.gray_rows), position(0, nb_rows));
+	stream.gray_rows = nb_rows;
+	if (nb_rows == IM_HEIGHT_PX && stream.hook != NULL)
+		stream.hook(STAGE_GRAYSCALE, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+	if (stream.rows == NULL)
+		return;
+
+	if (nb_rows == IM_HEIGHT_PX) {
+		stream_max_gradient(IM_HEIGHT_PX);
+	} else if (nb_rows > GAUSSIAN_RADIUS) {
+		// the gaussian of a row reads the grayscale rows below it
+		stream_max_gradient(nb_rows - GAUSSIAN_RADIUS);
+	}
+}
+
+void canny_stream_end(void)
+{
+	canny_stream_rows(IM_HEIGHT_PX);
+
+	canny_rows* rows = stream.rows;
+	uint8_t* color = stream.color;
+	stage_hook hook = stream.hook;
+	uint16_t max = stream.max;
+	strong_map = NULL;
+	if (rows != NULL) {
+		set_thresholds(max);
+		arena_free(gradient_hist);
+		if (max > MIN_I_MAG)
+			strong_map = arena_calloc(1, sizeof(edge_map));
+	}
+
+	if (strong_map != NULL) {
+		// At row y: gaussian of row y, sobel of row y-1 and threshold of row y-2
+		for (img_coord y = 0; y <= IM_HEIGHT_PX; ++y) {
+			if (y < IM_HEIGHT_PX)
+				gaussian_row(y, rows->hpass, rows->gauss[y % RING_ROWS]);
+
+			int16_t sobel_y = y - 1;
+			if (sobel_y >= 0 && sobel_y < IM_HEIGHT_PX) {
+				uint8_t slot = sobel_y % RING_ROWS;
+				if (sobel_y >= XY_OFFSET_3x3 && sobel_y < IM_HEIGHT_PX-XY_OFFSET_3x3) {
+					const uint8_t* gauss[RING_ROWS] = {rows->gauss[ring_slot(sobel_y, -1)],
+					                                   rows->gauss[ring_slot(sobel_y, 0)],
+					                                   rows->gauss[ring_slot(sobel_y, 1)]};
+					sobel_row(gauss, rows->mag[slot], rows->octant[slot]);
+				} else {
+					for (img_coord x = 0; x < IM_LENGTH_PX; ++x) {
+						rows->mag[slot][x] = 0;
+						rows->octant[slot][x] = 0;
+					}
+				}
+			}
+
+			int16_t thr_y = y - 2;
+			if (thr_y >= XY_OFFSET_3x3 && thr_y < IM_HEIGHT_PX-XY_OFFSET_3x3) {
+				const uint16_t* mag[RING_ROWS] = {rows->mag[ring_slot(thr_y, -1)],
+				                               rows->mag[ring_slot(thr_y, 0)],
+				                               rows->mag[ring_slot(thr_y, 1)]};
+				threshold_row(mag, rows->octant[thr_y % RING_ROWS], max, thr_y,
+				              &color[position(0, thr_y)]);
+			}
+		}
+		edge_track_hyst();
+		arena_free(strong_map);
+
+		// the pixels that are not edges lose their flags
+		for (img_coord y = 0; y < IM_HEIGHT_PX; ++y) {
+			for (img_coord x = 0; x < IM_LENGTH_PX; ++x) {
+				if (!edge_map_test(edges, edge_map_bit(x, y)))
+					color[position(x, y)] &= COLOR_VALUE_MASK;
+			}
+		}
+		resolve_strong_colors(color);
+	}
+
+	arena_free(rows);
+
+	if (hook != NULL) {
+		edge_map_to_image(edges, img_buffer);
+		hook(STAGE_HYSTERESIS, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+	}
+}
+
+void canny_segment_regions(uint8_t* image, uint8_t* color, edge_map* edge_pixels,
+                           stage_hook hook)
+{
+	img_buffer = image;
+	edges = edge_pixels;
+	edge_map_clear(edges);
+	drop_components();
+	thresholds = (canny_thresholds){0};
+
+	set_grayscale_filter_colors(NULL, color, 0, IM_LENGTH_PX*IM_HEIGHT_PX);
+
+	if (hook != NULL)
+		hook(STAGE_GRAYSCALE, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+
+	segment_regions(color);
+
+	if (hook != NULL) {
+		edge_map_to_image(edges, img_buffer);
+		hook(STAGE_REGIONS, img_buffer, IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t));
+	}
+}
+
+canny_thresholds canny_get_thresholds(void)
+{
+	return thresholds;
+}
+
+uint16_t canny_components(const edge_component** list)
+{
+	*list = components;
+	return nb_components;
+}
+
+void canny_free_components(void)
+{
+	arena_free(components);
+	drop_components();
+}
@@ -0,0 +1,235 @@
+/**
+ * @file    edge_map.c
+ * @brief   Binary images with one bit per pixel (edge maps).
+ * @note    This module does not depend on ChibiOS, it is shared by the
+ *          e-puck firmware and the host benchmark harness.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Module headers
+
+#include <edge_map.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define WORD_ALL_SET       UINT32_MAX
+
+// Thinning (Zhang-Suen): the 8 neighbours of a pixel index a table of the
+// subiterations that may delete it
+
+#define NB_NEIGHBOURS      8
+#define NB_NEIGHBOUR_SETS  256
+#define THIN_FIRST         0x01
+#define THIN_SECOND        0x02
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+// bit of the neighbours P2..P9 of Zhang-Suen (clockwise from the top) in the
+// index of thinning_lut
+static const uint8_t ring_bits[NB_NEIGHBOURS] = {1, 2, 4, 7, 6, 5, 3, 0};
+
+// THIN_* flags of each set of neighbours, built on the first thinning
+static uint8_t thinning_lut[NB_NEIGHBOUR_SETS];
+static bool thinning_lut_built = false;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                       number of bits set in a word
+ */
+static inline uint8_t popcount(uint32_t word)
+{
+	return __builtin_popcount(word);
+}
+
+/**
+ * @brief                       index of the lowest bit set in a word, which
+ *                              must not be 0 (single instruction on the M4:
+ *                              RBIT + CLZ)
+ */
+static inline uint8_t lowest_bit(uint32_t word)
+{
+	return __builtin_ctz(word);
+}
+
+/**
+ * @brief                       mask of the bits [start, end[ of a word
+ * @param[in]   start, end      bits in range 0-EDGE_MAP_WORD_BITS, start < end
+ */
+static inline uint32_t word_mask(uint8_t start, uint8_t end)
+{
+	uint32_t mask = WORD_ALL_SET << start;
+	if (end < EDGE_MAP_WORD_BITS)
+		mask &= ((uint32_t)1 << end) - 1;
+	return mask;
+}
+
+/**
+ * @brief                       index of the 8 neighbours of a 3x3 window (the
+ *                              center bit removed)
+ */
+static inline uint8_t window_neighbours(uint16_t window)
+{
+	return (window & (WINDOW_CENTER - 1)) | ((window >> 1) & ~(WINDOW_CENTER - 1));
+}
+
+/**
+ * @brief                       Zhang-Suen conditions of a pixel: 2 to 6
+ *                              neighbours set, a single 0 to 1 transition
+ *                              around it, and P4.P6.(P2 or P8) = 0 for the
+ *                              first subiteration, P2.P8.(P4 or P6) = 0 for the
+ *                              second one
+ * @param[in]   neighbours      index of the neighbours (window_neighbours())
+ * @return                      THIN_* flags of the subiterations deleting the
+ *                              pixel
+ */
+static uint8_t thinning_flags(uint8_t neighbours)
+{
+	bool p[NB_NEIGHBOURS];
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < NB_NEIGHBOURS; ++i) {
+		p[i] = (neighbours >> ring_bits[i]) & 1;
+		count += p[i];
+	}
+	uint8_t transitions = 0;
+	for (uint8_t i = 0; i < NB_NEIGHBOURS; ++i)
+		transitions += !p[i] && p[(i + 1) % NB_NEIGHBOURS];
+	if (count < 2 || count > 6 || transitions != 1)
+		return 0;
+
+	// P2, P4, P6 and P8 are at indices 0, 2, 4 and 6
+	uint8_t flags = 0;
+	if (!(p[2] && p[4] && (p[0] || p[6])))
+		flags |= THIN_FIRST;
+	if (!(p[0] && p[6] && (p[2] || p[4])))
+		flags |= THIN_SECOND;
+	return flags;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+void edge_map_clear(edge_map* map)
+{
+	memset(map->words, 0, sizeof(map->words));
+}
+
+uint16_t edge_map_count(const edge_map* map)
+{
+	uint16_t count = 0;
+	for (uint16_t i = 0; i < EDGE_MAP_WORDS; ++i)
+		count += popcount(map->words[i]);
+	return count;
+}
+
+img_coord edge_map_next_run(const edge_map* map, img_coord y, img_coord x, img_coord* end)
+{
+	const uint32_t* row = &map->words[y*EDGE_MAP_ROW_WORDS];
+
+	// first pixel set from x on
+	img_coord w = x / EDGE_MAP_WORD_BITS;
+	uint32_t bits = row[w] & (WORD_ALL_SET << (x % EDGE_MAP_WORD_BITS));
+	while (bits == 0) {
+		if (++w == EDGE_MAP_ROW_WORDS)
+			return *end = IM_LENGTH_PX;
+		bits = row[w];
+	}
+	img_coord start = w*EDGE_MAP_WORD_BITS + lowest_bit(bits);
+
+	// first pixel cleared after it, the padding bits are never set
+	bits = ~row[w] & (WORD_ALL_SET << (start % EDGE_MAP_WORD_BITS));
+	while (bits == 0) {
+		if (++w == EDGE_MAP_ROW_WORDS) {
+			*end = IM_LENGTH_PX;
+			return start;
+		}
+		bits = ~row[w];
+	}
+	*end = w*EDGE_MAP_WORD_BITS + lowest_bit(bits);
+	return start;
+}
+
+bool edge_map_any(const edge_map* map, img_coord y, img_coord start, img_coord end)
+{
+	const uint32_t* row = &map->words[y*EDGE_MAP_ROW_WORDS];
+	while (start < end) {
+		img_coord w = start / EDGE_MAP_WORD_BITS;
+		uint16_t word_end = (w + 1)*EDGE_MAP_WORD_BITS;
+		img_coord stop = end < word_end ? end : word_end;
+		if (row[w] & word_mask(start % EDGE_MAP_WORD_BITS,
+		                       stop - w*EDGE_MAP_WORD_BITS))
+			return true;
+		start = stop;
+	}
+	return false;
+}
+
+void edge_map_clear_run(edge_map* map, img_coord y, img_coord start, img_coord end)
+{
+	uint32_t* row = &map->words[y*EDGE_MAP_ROW_WORDS];
+	while (start < end) {
+		img_coord w = start / EDGE_MAP_WORD_BITS;
+		uint16_t word_end = (w + 1)*EDGE_MAP_WORD_BITS;
+		img_coord stop = end < word_end ? end : word_end;
+		row[w] &= ~word_mask(start % EDGE_MAP_WORD_BITS, stop - w*EDGE_MAP_WORD_BITS);
+		start = stop;
+	}
+}
+
+void edge_map_to_image(const edge_map* map, uint8_t* image)
+{
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y) {
+		for (img_coord x = 0; x < IM_LENGTH_PX; ++x)
+			image[x + y*IM_LENGTH_PX] = edge_map_test(map, edge_map_bit(x, y)) ?
+			                            STRONG_PIXEL : 0;
+	}
+}
+
+uint16_t edge_map_thin(edge_map* map, edge_map* scratch)
+{
+	if (!thinning_lut_built) {
+		for (uint16_t i = 0; i < NB_NEIGHBOUR_SETS; ++i)
+			thinning_lut[i] = thinning_flags(i);
+		thinning_lut_built = true;
+	}
+
+	uint16_t removed = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (uint8_t pass = THIN_FIRST; pass <= THIN_SECOND; pass <<= 1) {
+			// the deletions of a subiteration are decided on the map before it
+			*scratch = *map;
+			for (img_coord y = 1; y < IM_HEIGHT_PX - 1; ++y) {
+				img_coord start, end;
+				for (img_coord x = 1; (start = edge_map_next_run(scratch, y, x, &end))
+				     < IM_LENGTH_PX - 1; x = end) {
+					if (end > IM_LENGTH_PX - 1)
+						end = IM_LENGTH_PX - 1;
+					for (img_coord i = start; i < end; ++i) {
+						uint16_t bit = edge_map_bit(i, y);
+						uint16_t window = edge_map_window(scratch, bit);
+						if (thinning_lut[window_neighbours(window)] & pass) {
+							edge_map_reset(map, bit);
+							++removed;
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+	}
+	return removed;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file    gaussian.c
+ * @brief   Separable 5x5 gaussian filter in integer arithmetic.
+ * @note    This module does not depend on ChibiOS, it is shared by the
+ *          e-puck firmware and the host benchmark harness.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <string.h>
+
+// Module headers
+
+#include <gaussian.h>
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+// core_cm4_simd.h expects the definitions of core_cm4.h
+#ifndef __ASM
+#define __ASM              __asm
+#endif
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE    static inline
+#endif
+#include <core_cm4_simd.h>
+#endif
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Kernel [1 4 6 4 1] along each axis, the 2D kernel sums up to 256
+
+#define KER_CENTER         6
+#define KER_NEAR           4
+#define KER_SHIFT          8
+#define KER_ROUND          (1 << (KER_SHIFT - 1))
+
+// Pairs of 16-bit coefficients for __SMLAD (low half first)
+
+#define KER_PAIR_FAR_CENTER  (1 | (KER_CENTER << 16))
+#define KER_PAIR_NEAR        (KER_NEAR | (KER_NEAR << 16))
+#define KER_PAIR_ROUND       (KER_ROUND | (KER_ROUND << 16))
+
+#define LOW_BYTES_MASK       0x00FF00FF
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+#if !(defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP)
+/**
+ * @brief                       C emulation of the M4 instructions, same
+ *                              semantics as the CMSIS intrinsics
+ */
+static inline uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+	return op3 + (int32_t)(int16_t)op1*(int16_t)op2
+	       + (int32_t)(int16_t)(op1 >> 16)*(int16_t)(op2 >> 16);
+}
+
+static inline uint32_t __SADD16(uint32_t op1, uint32_t op2)
+{
+	return ((op1 + op2) & 0xFFFF) | (((op1 >> 16) + (op2 >> 16)) << 16);
+}
+
+static inline uint32_t __UXTB16(uint32_t op1)
+{
+	return op1 & LOW_BYTES_MASK;
+}
+#endif
+
+/**
+ * @brief                       loads 4 bytes (little endian, like the M4)
+ * @param[in]   src             address of the first byte, may be unaligned
+ * @return                      the 4 bytes, first byte in the low byte
+ */
+static inline uint32_t load32(const void* src)
+{
+	uint32_t word;
+	memcpy(&word, src, sizeof(word));
+	return word;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+void gaussian_hpass_scalar(const uint8_t* in, uint16_t* out, uint16_t width)
+{
+	for (uint16_t x = GAUSSIAN_RADIUS; x + GAUSSIAN_RADIUS < width; ++x) {
+		out[x] = in[x-2] + in[x+2] + KER_NEAR*(in[x-1] + in[x+1])
+		         + KER_CENTER*in[x];
+	}
+}
+
+void gaussian_vpass_scalar(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                           uint8_t* out, uint16_t width)
+{
+	for (uint16_t x = 0; x < width; ++x) {
+		if (x < GAUSSIAN_RADIUS || x + GAUSSIAN_RADIUS >= width) {
+			out[x] = in[x];
+			continue;
+		}
+		uint32_t conv = h[0][x] + h[4][x] + KER_NEAR*(h[1][x] + h[3][x])
+		                + KER_CENTER*h[2][x];
+		out[x] = (conv + KER_ROUND) >> KER_SHIFT;
+	}
+}
+
+void gaussian_hpass_simd(const uint8_t* in, uint16_t* out, uint16_t width)
+{
+	uint16_t x = GAUSSIAN_RADIUS;
+
+	/**
+	 * Two pixels per iteration. even holds in[x-2] and in[x], odd holds
+	 * in[x-1] and in[x+1] (one per 16-bit half), the next ones are loaded
+	 * from in[x] and carried over to the next iteration.
+	 */
+	if (width >= 2*GAUSSIAN_RADIUS + 2) {
+		uint32_t word = load32(&in[x - GAUSSIAN_RADIUS]);
+		uint32_t even = __UXTB16(word);
+		uint32_t odd = __UXTB16(word >> 8);
+		for (; x + 1 + GAUSSIAN_RADIUS < width; x += 2) {
+			word = load32(&in[x]);
+			uint32_t next_even = __UXTB16(word);
+			uint32_t next_odd = __UXTB16(word >> 8);
+			out[x] = __SMLAD(even, KER_PAIR_FAR_CENTER,
+			                 __SMLAD(odd, KER_PAIR_NEAR, next_even >> 16));
+			out[x+1] = __SMLAD(odd, KER_PAIR_FAR_CENTER,
+			                   __SMLAD(next_even, KER_PAIR_NEAR, next_odd >> 16));
+			even = next_even;
+			odd = next_odd;
+		}
+	}
+
+	// odd number of filtered pixels
+	for (; x + GAUSSIAN_RADIUS < width; ++x) {
+		out[x] = in[x-2] + in[x+2] + KER_NEAR*(in[x-1] + in[x+1])
+		         + KER_CENTER*in[x];
+	}
+}
+
+void gaussian_vpass_simd(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                         uint8_t* out, uint16_t width)
+{
+	uint16_t x;
+	for (x = 0; x < GAUSSIAN_RADIUS && x < width; ++x)
+		out[x] = in[x];
+
+	/**
+	 * Two columns per iteration, one per 16-bit half. The inputs are the
+	 * horizontal sums (at most 16*255), so the vertical sums reach
+	 * 16*16*255 + KER_ROUND = 65408. Every partial sum is positive and
+	 * below 2^16 and the shifted terms stay below 2^15, so no carry
+	 * crosses into the other half. The halves overflow as signed values,
+	 * but __SADD16 does not saturate: it adds modulo 2^16 and the bits
+	 * read as unsigned stay exact.
+	 */
+	for (; x + 1 + GAUSSIAN_RADIUS < width; x += 2) {
+		uint32_t center = load32(&h[2][x]);
+		uint32_t conv = __SADD16(load32(&h[0][x]), load32(&h[4][x]));
+		conv = __SADD16(conv, __SADD16(load32(&h[1][x]), load32(&h[3][x])) << 2);
+		conv = __SADD16(conv, __SADD16(center << 2, center << 1));
+		conv = __SADD16(conv, KER_PAIR_ROUND);
+		conv = (conv >> KER_SHIFT) & LOW_BYTES_MASK;
+		out[x] = conv;
+		out[x+1] = conv >> 16;
+	}
+
+	for (; x < width; ++x) {
+		if (x + GAUSSIAN_RADIUS >= width) {
+			out[x] = in[x];
+			continue;
+		}
+		uint32_t conv = h[0][x] + h[4][x] + KER_NEAR*(h[1][x] + h[3][x])
+		                + KER_CENTER*h[2][x];
+		out[x] = (conv + KER_ROUND) >> KER_SHIFT;
+	}
+}
+
+void gaussian_hpass(const uint8_t* in, uint16_t* out, uint16_t width)
+{
+#if GAUSSIAN_USE_SIMD
+	gaussian_hpass_simd(in, out, width);
+#else
+	gaussian_hpass_scalar(in, out, width);
+#endif
+}
+
+void gaussian_vpass(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                    uint8_t* out, uint16_t width)
+{
+#if GAUSSIAN_USE_SIMD
+	gaussian_vpass_simd(h, in, out, width);
+#else
+	gaussian_vpass_scalar(h, in, out, width);
+#endif
+}
@@ -0,0 +1,141 @@
+/**
+ * @file    arena.h
+ * @brief   Static per-frame memory arena of the image pipeline.
+ * @note    The blocks are allocated at the top of a fixed buffer (bump
+ *          allocation) and the whole arena is reset once per frame, so that
+ *          a capture never depends on the state of the heap left by the
+ *          previous ones. A freed block is reclaimed as soon as all the
+ *          blocks above it are freed (LIFO), a block at the top grows and
+ *          shrinks in place.
+ *          A single block may also be kept at the high end of the arena, for
+ *          the data that outlives the blocks of a frame (the contours of the
+ *          tiles of a mosaic).
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+// C standard header files
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Module headers
+
+#include <mod_img_processing.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Budget of a frame (or of a mosaic), headers included, for the resolution
+// profile. It holds the fixed buffers of the full frame Canny engine (4 B per
+// pixel), the planner needs about 6 B per edge pixel and gives up on a frame
+// that does not fit. Only the budget of the 100x90 profile fits in the CCM of
+// the e-puck, the larger profiles are built by the host benchmark only.
+#if IM_PROFILE == IM_PROFILE_100x90
+#define ARENA_SIZE         (64*1024)
+#elif IM_PROFILE == IM_PROFILE_160x120
+#define ARENA_SIZE         (128*1024)
+#else
+#define ARENA_SIZE         (256*1024)
+#endif
+
+// The firmware keeps the arena in the core coupled memory (CCM, ram4 in the
+// linker script). Only the CPU reads and writes its blocks, no DMA transfer
+// can reach the CCM, and ram0 is left to the heap (DCMI buffers, path data).
+#ifndef ARENA_IN_CCM
+#define ARENA_IN_CCM       0
+#endif
+#define CCM_SIZE           (64*1024)
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef struct arena_stats {
+	uint32_t allocs;        // number of allocations since last mark
+	size_t peak_bytes;      // highest number of bytes used since last mark
+	size_t used_bytes;      // number of bytes used
+	size_t frame_peak_bytes; // highest number of bytes used since last
+	                        // reset
+	uint32_t failures;      // allocations that exceeded the budget since last
+	                        // reset
+} arena_stats;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               Frees all the blocks, called once per frame before
+ *                      the edge detection (or before the first tile of a
+ *                      mosaic).
+ * @return              none
+ * @note                The pointers returned before the reset must no longer
+ *                      be used, not even freed.
+ */
+void arena_reset(void);
+
+/**
+ * @brief               Allocates a block at the top of the arena.
+ * @param[in]   size    Size in bytes
+ * @return              Pointer aligned on 8 bytes, NULL if the budget of the
+ *                      frame is exceeded
+ */
+void* arena_malloc(size_t size);
+
+/**
+ * @brief               Same as arena_malloc(), the block is zeroed.
+ * @param[in]   nmemb   Number of elements
+ * @param[in]   size    Size in bytes of an element
+ * @return              Pointer aligned on 8 bytes, NULL if the budget of the
+ *                      frame is exceeded
+ */
+void* arena_calloc(size_t nmemb, size_t size);
+
+/**
+ * @brief               Resizes a block, in place if it is at the top of the
+ *                      arena or if it shrinks.
+ * @param[in]   ptr     Block (may be NULL)
+ * @param[in]   size    New size in bytes
+ * @return              Resized block, NULL if the budget of the frame is
+ *                      exceeded (ptr is then left unchanged)
+ */
+void* arena_realloc(void* ptr, size_t size);
+
+/**
+ * @brief               Frees a block (may be NULL).
+ * @param[in]   ptr     Block
+ * @return              none
+ * @note                The memory is only reclaimed once the blocks above it
+ *                      are freed.
+ */
+void arena_free(void* ptr);
+
+/**
+ * @brief               Resizes the block at the high end of the arena. It
+ *                      grows down towards the other blocks.
+ * @param[in]   ptr     High block, NULL if there is none
+ * @param[in]   size    New size in bytes, 0 frees the block
+ * @return              Resized block, its content moved with its first byte,
+ *                      NULL if the budget of the frame is exceeded (ptr is
+ *                      then left unchanged) or if the block is freed
+ * @note                It is freed by the reset as well.
+ */
+void* arena_realloc_high(void* ptr, size_t size);
+
+/**
+ * @brief               Starts a new measurement window: resets the
+ *                      allocation count and sets the peak to the bytes used.
+ * @return              none
+ */
+void arena_mark(void);
+
+/**
+ * @brief               Returns the usage of the arena
+ * @return              Arena statistics
+ */
+arena_stats arena_get_stats(void);
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,215 @@
+/**
+ * @file    canny.h
+ * @brief   External declarations of the Canny edge detection module.
+ */
+
+#ifndef _CANNY_H_
+#define _CANNY_H_
+
+// C standard header files
+
+#include <stdint.h>
+
+// Module headers
+
+#include <pipeline.h>
+#include <edge_map.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Frames averaged by a multi-frame capture, the sum of their grayscale
+// levels fits in 16 bits
+
+#define MAX_ACCUMULATED_FRAMES 16
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+// Connected edge pixels (8-connectivity) of an edge image
+typedef struct edge_component {
+	uint16_t nb_pixels;
+	img_coord x_min;
+	img_coord x_max;
+	img_coord y_min;
+	img_coord y_max;
+} edge_component;
+
+// Thresholds of the last edge detection, in units of the L2 norm of the
+// sobel gradient
+typedef struct canny_thresholds {
+	uint16_t max;          // maximum gradient of the image
+	uint16_t high;         // strong pixels are above
+	uint16_t low;          // weak pixels are above
+} canny_thresholds;
+
+// Running sum of the grayscale images of a multi-frame capture
+typedef struct gray_sum {
+	uint16_t px[IM_LENGTH_PX*IM_HEIGHT_PX];
+	uint8_t nb_frames;
+} gray_sum;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                       adds the grayscale image of a frame to a
+ *                              running sum
+ * @param[in]   image           RGB565 image of size IM_LENGTH_PX * IM_HEIGHT_PX
+ *                              (big endian, 2 bytes per pixel), not modified
+ * @param[in,out] sum           running sum, zeroed before the first frame
+ * @return                      none
+ * @note                        At most MAX_ACCUMULATED_FRAMES frames.
+ */
+void canny_accumulate(const uint8_t* image, gray_sum* sum);
+
+/**
+ * @brief                       canny edge detection algorithm on an image buffer.
+ *                              The thresholds are percentiles of the gradient
+ *                              of the image, the hysteresis keeps every
+ *                              connected component of weak pixels that
+ *                              touches a strong pixel.
+ * @param[in,out] image         RGB565 image of size IM_LENGTH_PX * IM_HEIGHT_PX
+ *                              (big endian, 2 bytes per pixel), used as a
+ *                              work buffer. With a hook, its first
+ *                              IM_LENGTH_PX * IM_HEIGHT_PX bytes are overwritten
+ *                              with the edges of the image before the last
+ *                              stage is reported. Active pixels take the value
+ *                              of STRONG_PIXEL and inactive pixels take a
+ *                              value of 0.
+ * @param[in]   average         running sum of a multi-frame capture (may be
+ *                              NULL): the edges are detected on the average of
+ *                              its frames, the colors are those of image
+ * @param[out]  color           buffer of size IM_LENGTH_PX * IM_HEIGHT_PX
+ *                              receiving the color (enum Colors) of each pixel
+ * @param[out]  edge_pixels     edges of the image, one bit per pixel
+ * @param[in]   hook            called after each stage (may be NULL)
+ * @return                      none
+ * @note                        If the arena budget is exceeded, the frame is
+ *                              dropped: edge_pixels is left empty.
+ */
+void canny_edge(uint8_t* image, const gray_sum* average, uint8_t* color,
+                edge_map* edge_pixels, stage_hook hook);
+
+/**
+ * @brief                       same as canny_edge() but the image is streamed
+ *                              row by row through all the stages, keeping only
+ *                              3 rows of each intermediate result.
+ * @param[in,out] image         see canny_edge()
+ * @param[in]   average         see canny_edge()
+ * @param[out]  color           see canny_edge()
+ * @param[out]  edge_pixels     see canny_edge()
+ * @param[in]   hook            called after the grayscale conversion and at
+ *                              the end (STAGE_HYSTERESIS) only, the other
+ *                              stages have no image output (may be NULL)
+ * @return                      none
+ * @note                        The result is identical to canny_edge(). The
+ *                              gaussian and sobel filters run twice since the
+ *                              thresholds depend on the gradient histogram of
+ *                              the whole image.
+ */
+void canny_edge_stream(uint8_t* image, const gray_sum* average, uint8_t* color,
+                       edge_map* edge_pixels, stage_hook hook);
+
+/**
+ * @brief                       starts canny_edge_stream() on a frame that is
+ *                              still being received, its rows are passed to
+ *                              canny_stream_rows() as they land
+ * @param[in,out] image         see canny_edge(), only its landed rows are
+ *                              read (and converted in place)
+ * @param[in]   average         see canny_edge()
+ * @param[out]  color           see canny_edge()
+ * @param[out]  edge_pixels     see canny_edge()
+ * @param[in]   hook            see canny_edge_stream()
+ * @return                      none
+ */
+void canny_stream_begin(uint8_t* image, const gray_sum* average, uint8_t* color,
+                        edge_map* edge_pixels, stage_hook hook);
+
+/**
+ * @brief                       runs the grayscale conversion, the gaussian
+ *                              filter and the gradient histogram on the rows
+ *                              of the frame that have landed
+ * @param[in]   nb_rows         rows [0, nb_rows[ of the image have landed,
+ *                              fewer rows than in a previous call are ignored
+ * @return                      none
+ * @note                        The rows closer than GAUSSIAN_RADIUS to the
+ *                              last landed one are filtered with the next
+ *                              rows.
+ */
+void canny_stream_rows(img_coord nb_rows);
+
+/**
+ * @brief                       completes the edge detection of a streamed
+ *                              frame once all its rows have landed: the
+ *                              thresholds are set from the histogram and the
+ *                              second pass extracts the edges
+ * @return                      none
+ * @note                        canny_stream_begin(), canny_stream_rows() and
+ *                              canny_stream_end() give the same result as
+ *                              canny_edge_stream() whatever the row groups.
+ */
+void canny_stream_end(void);
+
+/**
+ * @brief                       region segmentation, replaces the edge
+ *                              detection for flat-color subjects: the
+ *                              connected regions (4-connectivity) of pixels of
+ *                              the same color are labeled in one labeling of
+ *                              the color classes and the outline of each
+ *                              region is set as edges. The outline pixels keep
+ *                              the color of their region.
+ * @param[in,out] image         see canny_edge(), the hook receives the
+ *                              grayscale image and the outlines
+ *                              (STAGE_REGIONS)
+ * @param[out]  color           see canny_edge()
+ * @param[out]  edge_pixels     outlines of the regions, one bit per pixel
+ * @param[in]   hook            called after the color classification and at
+ *                              the end (may be NULL)
+ * @return                      none
+ * @note                        The background (white) is not outlined, nor
+ *                              the regions of a few pixels.
+ *                              The components are the outlines.
+ *                              If the labels of the regions do not fit in the
+ *                              arena, edge_pixels is left empty.
+ */
+void canny_segment_regions(uint8_t* image, uint8_t* color, edge_map* edge_pixels,
+                           stage_hook hook);
+
+/**
+ * @brief                       returns the thresholds of the last edge
+ *                              detection
+ * @return                      thresholds (0 before the first detection and
+ *                              after a region segmentation)
+ */
+canny_thresholds canny_get_thresholds(void);
+
+/**
+ * @brief                       returns the connected components of the edges
+ *                              found by the last call to canny_edge(),
+ *                              canny_edge_stream() or canny_segment_regions()
+ * @param[out]  list            components, valid until the next edge
+ *                              detection or canny_free_components() (NULL if
+ *                              there is no edge)
+ * @return                      number of components
+ * @note                        The hysteresis keeps whole components of
+ *                              strong and weak pixels, so the pixel counts and
+ *                              bounding boxes are those of the final edges.
+ */
+uint16_t canny_components(const edge_component** list);
+
+/**
+ * @brief                       frees the components of the last edge
+ *                              detection once they are no longer needed
+ * @return                      none
+ * @note                        Not after a reset of the arena. The components
+ *                              are the last block of the edge detection, the
+ *                              arena reclaims it (and the blocks freed below
+ *                              it) right away.
+ */
+void canny_free_components(void);
+
+#endif /* _CANNY_H_ */
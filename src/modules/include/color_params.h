@@ -0,0 +1,42 @@
+/**
+ * @file    color_params.h
+ * @brief   Color classification and grayscale conversion parameters.
+ * @note    The lookup tables of color_lut.h are generated from these values
+ *          by gen_color_lut at build time, retuning them only requires a
+ *          rebuild.
+ */
+
+#ifndef _COLOR_PARAMS_H_
+#define _COLOR_PARAMS_H_
+
+/*===========================================================================*/
+/* Exported constants.                                                       */
+/*===========================================================================*/
+
+// Color masks for RGB565 image format
+
+#define RED_MASK           0xF800
+#define GREEN_MASK         0x7E0
+#define BLUE_MASK          0x1F
+
+#define RGB_RED_POS        8
+#define RGB_GREEN_POS      3
+#define RGB_BLUE_POS       3
+
+// Grayscale conversion
+
+#define LUMA_RED_COEFF     0.2989f
+#define LUMA_GREEN_COEFF   0.5870f
+#define LUMA_BLUE_COEFF    0.1140f
+
+// Color classification, channels in range 0-255
+
+#define BLACK_THRESHOLD    60
+#define BLUE_MIN_VALUE     45
+#define GREEN_BLUE_DIFF    20
+#define GREEN_COEFF        1.2f
+#define RED_COEFF          1.5f
+
+#define NUMBER_COLORS      3
+
+#endif /* _COLOR_PARAMS_H_ */
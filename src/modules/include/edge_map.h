@@ -0,0 +1,190 @@
+/**
+ * @file    edge_map.h
+ * @brief   Binary images with one bit per pixel (edge maps) and their
+ *          word-parallel operations.
+ * @note    The rows are padded to whole 32-bit words so that a row segment
+ *          is read with one or two word accesses. Pixel (x, y) is bit
+ *          x + y*EDGE_MAP_ROW_BITS of the map.
+ */
+
+#ifndef _EDGE_MAP_H_
+#define _EDGE_MAP_H_
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Module headers
+
+#include <mod_img_processing.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define EDGE_MAP_WORD_BITS 32
+#define EDGE_MAP_ROW_WORDS ((IM_LENGTH_PX + EDGE_MAP_WORD_BITS - 1)/EDGE_MAP_WORD_BITS)
+#define EDGE_MAP_ROW_BITS  (EDGE_MAP_ROW_WORDS*EDGE_MAP_WORD_BITS)
+#define EDGE_MAP_WORDS     (EDGE_MAP_ROW_WORDS*IM_HEIGHT_PX)
+
+#if EDGE_MAP_ROW_BITS*IM_HEIGHT_PX > UINT16_MAX
+#error "the bits of the edge map do not fit their 16-bit index"
+#endif
+
+// Bits of the 3x3 window returned by edge_map_window(), bit (dx+1) + 3*(dy+1)
+// holds the neighbour at offset (dx, dy)
+
+#define WINDOW_ROW_BITS    3
+#define WINDOW_ROW_MASK    0x7
+
+#define WINDOW_TOP_LEFT    0x001
+#define WINDOW_TOP         0x002
+#define WINDOW_TOP_RIGHT   0x004
+#define WINDOW_LEFT        0x008
+#define WINDOW_CENTER      0x010
+#define WINDOW_RIGHT       0x020
+#define WINDOW_BOTTOM_LEFT 0x040
+#define WINDOW_BOTTOM      0x080
+#define WINDOW_BOTTOM_RIGHT 0x100
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef struct edge_map {
+	uint32_t words[EDGE_MAP_WORDS];
+} edge_map;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                       returns the bit of a pixel
+ * @param[in]   x, y            pixel coordinates
+ * @return                      bit index in the map
+ */
+static inline uint16_t edge_map_bit(img_coord x, img_coord y)
+{
+	return x + (uint16_t)y*EDGE_MAP_ROW_BITS;
+}
+
+static inline bool edge_map_test(const edge_map* map, uint16_t bit)
+{
+	return (map->words[bit / EDGE_MAP_WORD_BITS] >> (bit % EDGE_MAP_WORD_BITS)) & 1;
+}
+
+static inline void edge_map_set(edge_map* map, uint16_t bit)
+{
+	map->words[bit / EDGE_MAP_WORD_BITS] |= (uint32_t)1 << (bit % EDGE_MAP_WORD_BITS);
+}
+
+static inline void edge_map_reset(edge_map* map, uint16_t bit)
+{
+	map->words[bit / EDGE_MAP_WORD_BITS] &= ~((uint32_t)1 << (bit % EDGE_MAP_WORD_BITS));
+}
+
+/**
+ * @brief                       reads 3 consecutive bits of a map
+ * @param[in]   map             edge map
+ * @param[in]   bit             first bit
+ * @return                      bits, the first one in the lowest bit
+ */
+static inline uint16_t edge_map_read_3_bits(const edge_map* map, uint16_t bit)
+{
+	uint16_t word = bit / EDGE_MAP_WORD_BITS;
+	uint8_t shift = bit % EDGE_MAP_WORD_BITS;
+	uint32_t bits = map->words[word] >> shift;
+	if (shift > EDGE_MAP_WORD_BITS - WINDOW_ROW_BITS)
+		bits |= map->words[word + 1] << (EDGE_MAP_WORD_BITS - shift);
+	return bits & WINDOW_ROW_MASK;
+}
+
+/**
+ * @brief                       returns the 3x3 neighbourhood of a pixel, one
+ *                              or two word accesses per row
+ * @param[in]   map             edge map
+ * @param[in]   bit             bit of the center pixel, which must not be on
+ *                              the image border
+ * @return                      window bits (WINDOW_*)
+ * @note                        Inline, it is called at each step of the
+ *                              contour tracing.
+ */
+static inline uint16_t edge_map_window(const edge_map* map, uint16_t bit)
+{
+	uint16_t first = bit - EDGE_MAP_ROW_BITS - 1;
+	return edge_map_read_3_bits(map, first)
+	       | edge_map_read_3_bits(map, first + EDGE_MAP_ROW_BITS) << WINDOW_ROW_BITS
+	       | edge_map_read_3_bits(map, first + 2*EDGE_MAP_ROW_BITS) << 2*WINDOW_ROW_BITS;
+}
+
+/**
+ * @brief                       clears all the pixels of a map
+ * @param[out]  map             edge map
+ * @return                      none
+ */
+void edge_map_clear(edge_map* map);
+
+/**
+ * @brief                       counts the pixels set in a map (popcount of
+ *                              its words)
+ * @param[in]   map             edge map
+ * @return                      number of pixels set
+ */
+uint16_t edge_map_count(const edge_map* map);
+
+/**
+ * @brief                       finds the next run of pixels set in a row
+ * @param[in]   map             edge map
+ * @param[in]   y               row
+ * @param[in]   x               first column searched
+ * @param[out]  end             column following the run
+ * @return                      first column of the run, IM_LENGTH_PX if there
+ *                              is none
+ * @note                        Background and set pixels are skipped a word
+ *                              at a time (count trailing zeros).
+ */
+img_coord edge_map_next_run(const edge_map* map, img_coord y, img_coord x, img_coord* end);
+
+/**
+ * @brief                       checks if a pixel of a row segment is set
+ * @param[in]   map             edge map
+ * @param[in]   y               row
+ * @param[in]   start, end      columns [start, end[ of the segment
+ * @return                      true if at least one pixel is set
+ */
+bool edge_map_any(const edge_map* map, img_coord y, img_coord start, img_coord end);
+
+/**
+ * @brief                       clears a row segment
+ * @param[in,out] map           edge map
+ * @param[in]   y               row
+ * @param[in]   start, end      columns [start, end[ of the segment
+ * @return                      none
+ */
+void edge_map_clear_run(edge_map* map, img_coord y, img_coord start, img_coord end);
+
+/**
+ * @brief                       thins the strokes of a map down to one pixel
+ *                              (Zhang-Suen parallel thinning), the
+ *                              connectivity of the strokes is kept
+ * @param[in,out] map           edge map, the pixels on the image border are
+ *                              left unchanged
+ * @param[out]  scratch         work map, copy of map before each subiteration
+ * @return                      number of pixels removed
+ * @note                        The conditions are read in a table indexed by
+ *                              the 8 neighbours of a pixel (edge_map_window()).
+ */
+uint16_t edge_map_thin(edge_map* map, edge_map* scratch);
+
+/**
+ * @brief                       writes a map as an 8-bit image (STRONG_PIXEL
+ *                              for the pixels set, 0 for the others)
+ * @param[in]   map             edge map
+ * @param[out]  image           image of IM_LENGTH_PX * IM_HEIGHT_PX bytes
+ * @return                      none
+ */
+void edge_map_to_image(const edge_map* map, uint8_t* image);
+
+#endif /* _EDGE_MAP_H_ */
@@ -0,0 +1,78 @@
+/**
+ * @file    gaussian.h
+ * @brief   External declarations of the separable 5x5 gaussian filter.
+ * @note    The kernel is the binomial [1 4 6 4 1] along each axis
+ *          (standard deviation of 1), the result is rounded to the nearest
+ *          integer. The rows and columns closer than GAUSSIAN_RADIUS to the
+ *          border are not filtered.
+ */
+
+#ifndef _GAUSSIAN_H_
+#define _GAUSSIAN_H_
+
+// C standard header files
+
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+#define GAUSSIAN_RADIUS    2
+#define GAUSSIAN_TAPS      (2*GAUSSIAN_RADIUS + 1)
+
+// The M4 dual 16-bit MAC instructions are used when the target has them
+#ifndef GAUSSIAN_USE_SIMD
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#define GAUSSIAN_USE_SIMD  1
+#else
+#define GAUSSIAN_USE_SIMD  0
+#endif
+#endif
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                       horizontal pass of one row
+ * @param[in]   in              grayscale row
+ * @param[out]  out             unnormalized filtered row (up to 16*255), the
+ *                              first and last GAUSSIAN_RADIUS values are not
+ *                              written
+ * @param[in]   width           number of pixels of the row
+ * @return                      none
+ */
+void gaussian_hpass(const uint8_t* in, uint16_t* out, uint16_t width);
+
+/**
+ * @brief                       vertical pass of one row
+ * @param[in]   h               horizontal passes of rows y-2 to y+2
+ * @param[in]   in              grayscale row y, copied to the border columns
+ * @param[out]  out             filtered row y
+ * @param[in]   width           number of pixels of the row
+ * @return                      none
+ */
+void gaussian_vpass(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                    uint8_t* out, uint16_t width);
+
+/**
+ * @brief                       portable implementations of the passes, used
+ *                              when GAUSSIAN_USE_SIMD is 0
+ */
+void gaussian_hpass_scalar(const uint8_t* in, uint16_t* out, uint16_t width);
+void gaussian_vpass_scalar(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                           uint8_t* out, uint16_t width);
+
+/**
+ * @brief                       implementations with the dual 16-bit MAC
+ *                              instructions (__SMLAD, __SADD16), used when
+ *                              GAUSSIAN_USE_SIMD is 1. Without DSP extension
+ *                              the instructions are emulated in C, so that
+ *                              both implementations can be compared on a host.
+ */
+void gaussian_hpass_simd(const uint8_t* in, uint16_t* out, uint16_t width);
+void gaussian_vpass_simd(const uint16_t* const h[GAUSSIAN_TAPS], const uint8_t* in,
+                         uint8_t* out, uint16_t width);
+
+#endif /* _GAUSSIAN_H_ */
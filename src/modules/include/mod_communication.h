@@ -18,9 +18,22 @@ typedef enum message_type {
 	MSG_IMAGE_SOBEL_MAG,
 	MSG_IMAGE_LOCAL_THR,
 	MSG_IMAGE_CANNY,
-	MSG_IMAGE_PATH
+	MSG_IMAGE_PATH,
+	MSG_THRESHOLDS,        // canny_thresholds of the last edge detection
+	MSG_PRUNING,           // planner_pruning of the last path
+	MSG_EDGE_MAP,          // edge_map of a live preview frame
+	MSG_ORDERING           // planner_ordering of the last path
 } message_type;
 
+// Intermediate images sent to the computer, the color requests, the path and
+// the live preview are always sent
+typedef enum telemetry_level {
+	TELEMETRY_NONE,        // no image
+	TELEMETRY_FINAL,       // edge image, thresholds, pruning and ordering only
+	TELEMETRY_ALL,         // every image of the pipeline
+	NB_TELEMETRY_LEVELS
+} telemetry_level;
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -47,10 +60,26 @@ uint8_t com_receive_command(BaseSequentialStream* in);
 /**
  * @brief                Reads length data (uint8) from the computer.
  * @param[in]   in       Pointer to a @p BaseSequentialStream or derived class
- * @returnm              Length in mm
+ * @returnm              Length in mm (in pixels for the minimum stroke
+ *                       length)
  */
 uint8_t com_receive_length(BaseSequentialStream* in);
 
+/**
+ * @brief                Reads a telemetry level from the computer.
+ * @param[in]   in       Pointer to a @p BaseSequentialStream or derived class
+ * @return               Telemetry level (enum telemetry_level)
+ */
+uint8_t com_receive_telemetry(BaseSequentialStream* in);
+
+/**
+ * @brief                Reads the number of frames averaged by a capture
+ *                       from the computer.
+ * @param[in]   in       Pointer to a @p BaseSequentialStream or derived class
+ * @return               Number of frames
+ */
+uint8_t com_receive_nb_frames(BaseSequentialStream* in);
+
 /**
  * @brief                Reads position and color data from the computer and
  *                       and fills corresponding buffers.
@@ -60,6 +89,23 @@ uint8_t com_receive_length(BaseSequentialStream* in);
  */
 uint16_t com_receive_data(BaseSequentialStream* in);
 
+/**
+ * @brief                Selects the messages sent by com_send_data().
+ * @param[in]   level    Telemetry level (enum telemetry_level), ignored if
+ *                       out of range. TELEMETRY_FINAL by default, the
+ *                       stage images of TELEMETRY_ALL make the edges be
+ *                       detected on the full frame instead of streamed.
+ * @return               none
+ */
+void com_set_telemetry(uint8_t level);
+
+/**
+ * @brief                Tells whether a type of message is sent.
+ * @param[in]   msg_type Type of message defined in enum message_type.
+ * @return               true if com_send_data() sends this type of message
+ */
+bool com_telemetry_enabled(message_type msg_type);
+
 /**
  * @brief                Sends data to the computer (uint8_t)
  * @param[in]   out      Pointer to a @p BaseSequentialStream or derived class
@@ -67,6 +113,8 @@ uint16_t com_receive_data(BaseSequentialStream* in);
  * @param[in]   size     Size in bytes of data to be sent.
  * @param[in]   msg_type Type of message defined in enum message_type.
  * @return               none
+ * @note                 Nothing is sent if the type of message is disabled
+ *                       by the telemetry level.
  */
 void com_send_data(BaseSequentialStream* out, uint8_t* data, uint16_t size,
                     message_type msg_type);
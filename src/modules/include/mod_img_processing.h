@@ -7,23 +7,81 @@
 #ifndef _MOD_IMG_PROCESSING_H_
 #define _MOD_IMG_PROCESSING_H_
 
+// C standard header files
+
+#include <stdint.h>
+
 /*===========================================================================*/
 /* Module exported constants.                                                */
 /*===========================================================================*/
 
+// Resolution profiles, one is selected at build time with
+// -DIM_PROFILE=IM_PROFILE_<length>x<height>. The image size is a constant
+// of the build: the kernels use constant strides and the coordinate and
+// index types are as narrow as the profile allows.
+
+#define IM_PROFILE_100x90  1
+#define IM_PROFILE_160x120 2
+#define IM_PROFILE_200x180 3
+
+#ifndef IM_PROFILE
+#define IM_PROFILE         IM_PROFILE_100x90
+#endif
+
+#if IM_PROFILE == IM_PROFILE_100x90
 #define IM_LENGTH_PX       100
 #define IM_HEIGHT_PX       90
+#elif IM_PROFILE == IM_PROFILE_160x120
+#define IM_LENGTH_PX       160
+#define IM_HEIGHT_PX       120
+#elif IM_PROFILE == IM_PROFILE_200x180
+#define IM_LENGTH_PX       200
+#define IM_HEIGHT_PX       180
+#else
+#error "unknown resolution profile"
+#endif
+
+// size of an RGB565 frame of the profile
+#define FRAME_BYTES        (IM_LENGTH_PX*IM_HEIGHT_PX*2)
+
 #define STRONG_PIXEL       255
 
+// width of the image borders cleared by the edge detection
+#define MARGIN_PX          4
+
+// Tiled capture: TILES_X x TILES_Y frames of IM_LENGTH_PX x IM_HEIGHT_PX
+// form a mosaic. Adjacent tiles overlap by their cleared borders so that
+// the edges of the mosaic are continuous across the tiles.
+
+#define TILES_X            2
+#define TILES_Y            2
+#define NB_TILES           (TILES_X*TILES_Y)
+#define TILE_OVERLAP_PX    (2*MARGIN_PX)
+#define TILE_STEP_X        (IM_LENGTH_PX - TILE_OVERLAP_PX)
+#define TILE_STEP_Y        (IM_HEIGHT_PX - TILE_OVERLAP_PX)
+#define MOSAIC_LENGTH_PX   ((TILES_X - 1)*TILE_STEP_X + IM_LENGTH_PX)
+#define MOSAIC_HEIGHT_PX   ((TILES_Y - 1)*TILE_STEP_Y + IM_HEIGHT_PX)
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
 
-typedef struct rgb_color {
-	uint8_t red;
-	uint8_t green;
-	uint8_t blue;
-} rgb_color;
+// coordinate of a pixel, the loops run up to IM_LENGTH_PX or IM_HEIGHT_PX
+#if IM_LENGTH_PX < UINT8_MAX && IM_HEIGHT_PX < UINT8_MAX
+typedef uint8_t img_coord;
+#else
+typedef uint16_t img_coord;
+#endif
+
+// index of a pixel in an image buffer
+#if IM_LENGTH_PX*IM_HEIGHT_PX < UINT16_MAX
+typedef uint16_t img_index;
+#else
+typedef uint32_t img_index;
+#endif
+
+// defined in edge_map.h, which depends on the image size defined here
+struct edge_map;
 
 enum Octants{first_octant = 1, second_octant, third_octant, fourth_octant,
              fifth_octant, sixth_octant, seventh_octant, eighth_octant
@@ -43,13 +101,71 @@ void mod_img_processing_init(void);
  * @brief                       captures an image from camera and calls
  *                              image processing and path tracing functions
  * @return                      none
+ * @note                        With double buffering, the capture starts
+ *                              even if the previous image is still processed.
  */
 void capture_image(void);
 
 /**
- * @brief                       returns image_buffer
- * @return                      pointer to image_buffer
+ * @brief                       captures the NB_TILES tiles of the mosaic one
+ *                              after the other at twice the resolution of
+ *                              capture_image() and plans the path of the
+ *                              mosaic
+ * @return                      none
+ * @note                        Only the tiles being captured or processed
+ *                              are in memory, the contours of the processed
+ *                              tiles are kept by the planner.
+ */
+void capture_image_tiled(void);
+
+/**
+ * @brief                       captures a single frame and plans the path of
+ *                              the outlines of its color regions instead of
+ *                              its edges, for flat-color subjects
+ * @return                      none
+ * @note                        The frames are not averaged, the regions are
+ *                              segmented on the colors of one frame.
+ */
+void capture_image_regions(void);
+
+/**
+ * @brief                       starts the live preview: frames are captured
+ *                              back to back and only their final edges are
+ *                              streamed to the computer, as edge maps, at the
+ *                              rate of the serial link
+ * @return                      none
+ * @note                        Capture, edge detection and transmission run
+ *                              in their own threads linked by mailboxes, the
+ *                              frames the link cannot keep up with are
+ *                              dropped. No path is planned.
+ */
+void capture_preview_start(void);
+
+/**
+ * @brief                       stops the live preview after the frame being
+ *                              captured, a capture stops it as well
+ * @return                      none
+ */
+void capture_preview_stop(void);
+
+/**
+ * @brief                       sets the number of frames averaged by each
+ *                              capture (each tile of a tiled capture)
+ * @param[in]   nb_frames       from 1 (single frame) to
+ *                              MAX_ACCUMULATED_FRAMES, ignored if out of range
+ * @return                      none
+ * @note                        The frames are captured back to back, the
+ *                              edges are detected on the average of their
+ *                              grayscale images to reduce the sensor noise.
+ */
+void set_accumulated_frames(uint8_t nb_frames);
+
+/**
+ * @brief                       returns the edges of the last processed frame
+ * @return                      pointer to the edge map, modified by the
+ *                              planner and overwritten by the next edge
+ *                              detection
  */
-uint8_t* get_img_buffer(void);
+struct edge_map* get_edge_map(void);
 
 #endif /* _MOD_IMG_PROCESSING_H_ */
@@ -1,30 +1,14 @@
 /*
  * @file	mod_path.h
- * @brief	Path structures, related constants and external declarations.
+ * @brief	External declarations of the path module.
  */
 
-#include <mod_data.h>
-
 #ifndef _MOD_PATH_H_
 #define _MOD_PATH_H_
 
-/*===========================================================================*/
-/* Module data structures and types.                                         */
-/*===========================================================================*/
-
-typedef struct edge_pos {
-	struct cartesian_coord pos;
-	uint16_t index;
-} edge_pos;
-
-typedef struct edge_track {
-	struct cartesian_coord pos;
-	uint8_t label;
-	bool is_extremity;	//line = 0, edge = 1;
-	uint8_t color;
-} edge_track;
+// Module headers
 
-enum edge_status{start = 0, end = 1, init = 2};
+#include <planner.h>
 
 /*===========================================================================*/
 /* External declarations.                                                    */
@@ -37,6 +21,13 @@ enum edge_status{start = 0, end = 1, init = 2};
  */
 void path_planning(void);
 
+/**
+ * @brief             same as path_planning() for the mosaic of a tiled
+ *                    capture, once its last tile has been added to the
+ *                    planner
+ * @return            none
+ */
+void path_planning_mosaic(void);
 
-#endif /* _MOD_PATH_H_ */
 
+#endif /* _MOD_PATH_H_ */
@@ -0,0 +1,109 @@
+/**
+ * @file    path_order.h
+ * @brief   Ordering of the contours of a path to reduce the pen up travel.
+ */
+
+#ifndef _PATH_ORDER_H_
+#define _PATH_ORDER_H_
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Module headers
+
+#include <planner.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Longest sequence of contours moved by an Or-opt move
+#define OR_OPT_MAX_CONTOURS 3
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                       orders the contours by nearest neighbour: from
+ *                              a position, the closest extremity of the
+ *                              contours left is drawn next, from the
+ *                              extremity to the other one
+ * @param[in,out] edges         extremities of the contours by pairs, edges[i]
+ *                              and edges[i+1] (i even) are the ends of one
+ *                              contour. The pairs are sorted in the drawing
+ *                              order and the drawn one comes first.
+ * @param[out]  status          status[i] (i even) is start if the contour of
+ *                              edges[i] keeps its orientation, end if it is
+ *                              reversed
+ * @param[in]   size_edges      number of extremities (even)
+ * @param[in]   from            initial position
+ * @return                      false if the index does not fit in the arena,
+ *                              the edges are then left unchanged
+ * @note                        The extremities are indexed by a uniform grid
+ *                              and removed from it once drawn, the search of
+ *                              the closest one widens ring by ring of cells
+ *                              and compares squared integer distances. The
+ *                              order is that of path_order_nearest_scan()
+ *                              (same ties).
+ */
+bool path_order_nearest(edge_pos* edges, uint8_t* status, uint16_t size_edges,
+                        cartesian_coord from);
+
+/**
+ * @brief                       same as path_order_nearest() without index:
+ *                              all the contours left are scanned for each
+ *                              contour drawn, in O(size_edges^2)
+ * @param[in,out] edges         see path_order_nearest()
+ * @param[out]  status          see path_order_nearest()
+ * @param[in]   size_edges      see path_order_nearest()
+ * @param[in]   from            see path_order_nearest()
+ * @return                      none
+ * @note                        Of two extremities at the same distance, the
+ *                              first one in edges is drawn.
+ */
+void path_order_nearest_scan(edge_pos* edges, uint8_t* status, uint16_t size_edges,
+                             cartesian_coord from);
+
+/**
+ * @brief                       improves the order of the contours (anytime
+ *                              local search): 2-opt moves reverse a sequence
+ *                              of contours, Or-opt moves take 1 to
+ *                              OR_OPT_MAX_CONTOURS consecutive contours to
+ *                              another place, reversed or not. A move is made
+ *                              as soon as it shortens the pen up travel, until
+ *                              no move does or the time is over.
+ * @param[in,out] edges         contours in the drawing order, output of
+ *                              path_order_nearest(), the drawn extremity
+ *                              first
+ * @param[in,out] status        see path_order_nearest(), a reversed contour
+ *                              has its status flipped
+ * @param[in]   size_edges      number of extremities (even)
+ * @param[in]   from            initial position
+ * @param[in]   to              position the pen goes to after the contours
+ *                              (NULL if they end the path), kept there
+ * @param[in]   clock           time source (NULL: no time limit)
+ * @param[in]   budget_ms       time allowed
+ * @return                      number of moves made
+ * @note                        Each move shortens the travel, so the order
+ *                              is the best one found whenever it stops. A
+ *                              pass over all the moves is O(size_edges^2).
+ */
+uint16_t path_order_improve(edge_pos* edges, uint8_t* status, uint16_t size_edges,
+                            cartesian_coord from, const cartesian_coord* to,
+                            pipeline_clock clock, uint32_t budget_ms);
+
+/**
+ * @brief                       length of the pen up moves of an order of the
+ *                              contours
+ * @param[in]   edges           contours in the drawing order, the drawn
+ *                              extremity first
+ * @param[in]   size_edges      number of extremities (even)
+ * @param[in]   from            initial position
+ * @return                      length in pixels
+ */
+float path_order_travel(const edge_pos* edges, uint16_t size_edges, cartesian_coord from);
+
+#endif /* _PATH_ORDER_H_ */
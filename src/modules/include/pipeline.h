@@ -0,0 +1,52 @@
+/**
+ * @file    pipeline.h
+ * @brief   Stages of the image to path pipeline and the hook called
+ *          between them.
+ * @note    This header and the modules including it must not depend on
+ *          ChibiOS so that the pipeline can be built and measured on a host.
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+// C standard header files
+
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef enum pipeline_stage {
+	STAGE_GRAYSCALE,
+	STAGE_GAUSS,
+	STAGE_SOBEL,
+	STAGE_LOCAL_MAX,
+	STAGE_HYSTERESIS,
+	STAGE_REGIONS,         // replaces the canny stages in the region mode
+	STAGE_THINNING,
+	STAGE_TRACING,
+	STAGE_PRUNING,
+	STAGE_OPTIMIZATION,
+	STAGE_ORDERING,
+	NB_STAGES
+} pipeline_stage;
+
+/**
+ * @brief                       called once a stage has completed
+ * @param[in]   stage           stage that has just completed
+ * @param[in]   data            pointer to the buffer produced by the stage
+ *                              (NULL if the stage has no image output)
+ * @param[in]   size            size in bytes of data
+ */
+typedef void (*stage_hook)(pipeline_stage stage, uint8_t* data, uint16_t size);
+
+/**
+ * @brief                       returns a monotonic time, it bounds the stages
+ *                              that improve their result as long as time is
+ *                              left
+ * @return                      time in ms
+ */
+typedef uint32_t (*pipeline_clock)(void);
+
+#endif /* _PIPELINE_H_ */
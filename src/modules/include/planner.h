@@ -0,0 +1,226 @@
+/*
+ * @file	planner.h
+ * @brief	Path structures and external declarations of the path planner.
+ */
+
+#ifndef _PLANNER_H_
+#define _PLANNER_H_
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Module headers
+
+#include <mod_data.h>
+#include <pipeline.h>
+#include <edge_map.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Default tolerances of the contour simplification (planner_set_simplification)
+
+/** this dictates the maximum perpendicular distance in pixels between
+ * approximated lines of optimized contour buffer and corresponding points of
+ * the non optimized contour buffer.
+ * Smaller values lead to more points for approximating a shape.
+ */
+
+#define MAX_PERP_DIST      0.95f
+
+/** max allowed distance between two positions in the final buffer.
+ * this parameter is important because the robot needs more than two points
+ * to draw a straight line (mechanical constraint)
+ */
+
+#define MAX_PIXEL_DIST     3
+
+// Default time allowed to the improvement of the order of the contours
+// (planner_set_ordering)
+#define ORDER_BUDGET_MS    200
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+typedef struct edge_pos {
+	struct cartesian_coord pos;
+	uint16_t index;
+} edge_pos;
+
+enum edge_status{start = 0, end = 1, init = 2};
+
+// Contours removed by the pruning of the last path (of all the tiles of a
+// mosaic)
+typedef struct planner_pruning {
+	uint16_t traced;       // contours traced
+	uint16_t contours;     // contours removed
+	uint32_t time_ms;      // estimated drawing time saved
+} planner_pruning;
+
+// Contour tracing of the last path (of all the tiles of a mosaic)
+typedef struct planner_tracing {
+	uint16_t contours;     // contours traced
+	uint32_t points;       // points of the traced contours
+	uint32_t steps;        // moves from a pixel to a neighbour, both walks
+	uint32_t store_bytes;  // bytes of the contour store once traced
+} planner_tracing;
+
+// Order of the contours of the last path: pen up travel before and after the
+// improvement of the nearest neighbour order, and the drawing it predicts
+typedef struct planner_ordering {
+	uint16_t contours;     // contours ordered
+	uint16_t moves;        // moves made by the improvement
+	uint32_t travel_before; // pen up travel of the nearest neighbour order (canvas px)
+	uint32_t travel_after; // pen up travel of the improved order (canvas px)
+	uint32_t time_ms;      // estimated drawing time saved by the improvement
+	uint32_t total_ms;     // predicted drawing time of the path
+	uint16_t color_changes; // predicted changes of pen
+} planner_ordering;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief                       traces, optimizes and orders the contours of an
+ *                              edge image and stores the resulting path and
+ *                              colors in mod_data
+ * @param[in]   img_edges       edge image, output of the last edge detection
+ *                              (its components are reused), modified
+ * @param[in]   color           color buffer (output of canny_edge), reused
+ *                              as the path color buffer
+ * @param[in]   hook            called after each stage (may be NULL)
+ * @return                      length of the path (0 if there is no edge)
+ */
+uint16_t planner_path(edge_map* img_edges, uint8_t* color, stage_hook hook);
+
+/**
+ * @brief                       enables the thinning of the edges to one pixel
+ *                              wide strokes before they are traced (enabled by
+ *                              default)
+ * @param[in]   enable          true to thin the edges
+ * @return                      none
+ */
+void planner_set_thinning(bool enable);
+
+/**
+ * @brief                       sets the minimum length of a stroke: the
+ *                              shorter contours are removed before the
+ *                              ordering, unless both of their ends touch a
+ *                              longer stroke
+ * @param[in]   length          length in pixels of the image, 0 disables the
+ *                              pruning
+ * @return                      none
+ */
+void planner_set_min_stroke(uint8_t length);
+
+/**
+ * @brief                       sets the tolerances of the simplification of
+ *                              the contours (MAX_PERP_DIST and MAX_PIXEL_DIST
+ *                              by default)
+ * @param[in]   perp_dist       largest distance in pixels between a removed
+ *                              point and the segment replacing it
+ * @param[in]   pixel_dist      one point out of pixel_dist is kept along the
+ *                              straight lines (ignored if 0)
+ * @return                      none
+ * @note                        Larger tolerances give fewer points and a
+ *                              faster drawing, at the cost of fidelity.
+ */
+void planner_set_simplification(float perp_dist, uint8_t pixel_dist);
+
+/**
+ * @brief                       sets the time allowed to the improvement of
+ *                              the nearest neighbour order of the contours
+ *                              (ORDER_BUDGET_MS by default)
+ * @param[in]   budget_ms       time allowed, 0 keeps the nearest neighbour
+ *                              order
+ * @param[in]   clock           time source (NULL, the default: the order is
+ *                              improved until no move shortens it)
+ * @return                      none
+ */
+void planner_set_ordering(uint16_t budget_ms, pipeline_clock clock);
+
+/**
+ * @brief                       groups the contours by color: all the contours
+ *                              of a color are drawn before the pen is changed
+ *                              (enabled by default)
+ * @param[in]   enable          true to group the contours, false to order
+ *                              them by pen up travel only
+ * @return                      none
+ * @note                        The groups are drawn in the order of the
+ *                              lowest predicted time, pen up travel and turns
+ *                              of the carousel of the pens. The contours are
+ *                              ordered without groups instead if this order
+ *                              is predicted faster.
+ */
+void planner_set_color_grouping(bool enable);
+
+/**
+ * @brief                       returns the scale of the last path
+ * @return                      canvas pixels per pixel of the traced image
+ *                              (of the mosaic for a tiled capture)
+ */
+float planner_get_scale(void);
+
+/**
+ * @brief                       returns the contours removed by the pruning of
+ *                              the last path
+ * @return                      pruning statistics
+ */
+planner_pruning planner_get_pruning(void);
+
+/**
+ * @brief                       returns the pen up travel of the last path
+ *                              before and after the improvement of its order,
+ *                              its predicted pen changes and drawing time
+ * @return                      ordering statistics
+ */
+planner_ordering planner_get_ordering(void);
+
+/**
+ * @brief                       returns the statistics of the contour tracing
+ *                              of the last path
+ * @return                      tracing statistics
+ */
+planner_tracing planner_get_tracing(void);
+
+/**
+ * @brief                       starts a new mosaic (tiled capture), frees the
+ *                              contours of the previous one
+ * @return                      none
+ */
+void planner_mosaic_begin(void);
+
+/**
+ * @brief                       traces and optimizes the contours of a tile and
+ *                              adds them to the mosaic
+ * @param[in]   img_edges       edge image of the tile, output of the last edge
+ *                              detection, modified
+ * @param[in]   color           color buffer of the tile (output of canny_edge),
+ *                              may be freed once the function returns
+ * @param[in]   tile_x          column of the tile, from 0 to TILES_X-1
+ * @param[in]   tile_y          row of the tile, from 0 to TILES_Y-1
+ * @param[in]   hook            called after the tracing and the optimization
+ *                              (may be NULL)
+ * @return                      none
+ */
+void planner_mosaic_add(edge_map* img_edges, uint8_t* color, uint8_t tile_x,
+                        uint8_t tile_y, stage_hook hook);
+
+/**
+ * @brief                       stitches the contours of the tiles across their
+ *                              seams, orders them and stores the resulting
+ *                              path and colors in mod_data
+ * @param[in]   hook            called after the ordering (may be NULL)
+ * @return                      length of the path (0 if there is no edge)
+ * @note                        The path is scaled from the mosaic size
+ *                              (MOSAIC_LENGTH_PX x MOSAIC_HEIGHT_PX) to the
+ *                              canvas.
+ */
+uint16_t planner_mosaic_path(stage_hook hook);
+
+#endif /* _PLANNER_H_ */
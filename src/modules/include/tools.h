@@ -8,6 +8,7 @@
 
 // Module headers
 #include <mod_data.h>
+#include <mod_img_processing.h>
 
 /*===========================================================================*/
 /* External declarations.                                                    */
@@ -18,8 +19,13 @@
  * @param[in]   x       x coordinate in range [0, IM_LENGTH_PX]
  * @param[in]   y       y coordinate in range [0, IM_HEIGHT_PX]
  * @return              corresponding 1D buffer position
+ * @note                Inline, the stride is a constant of the resolution
+ *                      profile.
  */
-uint16_t position(uint8_t pos_x, uint8_t pos_y);
+static inline img_index position(img_coord pos_x, img_coord pos_y)
+{
+	return pos_x + (img_index)pos_y*IM_LENGTH_PX;
+}
 
 /**
  * @brief               calculates the perpendicular distance between a starting coordinate
@@ -27,6 +27,29 @@
 #define SERIAL_BIT_RATE			115200
 #define MAX_BUFFER_SIZE			4000
 
+// Messages sent for each telemetry level
+
+#define MSG_BIT(type)           (1 << (type))
+#define MSG_ALWAYS_SENT         (MSG_BIT(MSG_COLOR) | MSG_BIT(MSG_IMAGE_PATH) \
+                                 | MSG_BIT(MSG_EDGE_MAP))
+
+static const uint16_t telemetry_masks[NB_TELEMETRY_LEVELS] = {
+	MSG_ALWAYS_SENT,
+	MSG_ALWAYS_SENT | MSG_BIT(MSG_IMAGE_CANNY) | MSG_BIT(MSG_THRESHOLDS)
+	| MSG_BIT(MSG_PRUNING) | MSG_BIT(MSG_ORDERING),
+	MSG_ALWAYS_SENT | MSG_BIT(MSG_IMAGE_RGB) | MSG_BIT(MSG_IMAGE_GRAYSCALE)
+	| MSG_BIT(MSG_IMAGE_GAUSS) | MSG_BIT(MSG_IMAGE_SOBEL_MAG)
+	| MSG_BIT(MSG_IMAGE_LOCAL_THR) | MSG_BIT(MSG_IMAGE_CANNY)
+	| MSG_BIT(MSG_THRESHOLDS) | MSG_BIT(MSG_PRUNING) | MSG_BIT(MSG_ORDERING)
+};
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+// the stage images of TELEMETRY_ALL need the slower full frame engine
+static uint16_t telemetry_mask = telemetry_masks[TELEMETRY_FINAL];
+
 /*===========================================================================*/
 /* Module exported functions.                                                */
 /*===========================================================================*/
@@ -111,6 +134,71 @@ uint8_t com_receive_length(BaseSequentialStream* in)
 	return c = chSequentialStreamGet(in); // parses length
 }
 
+uint8_t com_receive_telemetry(BaseSequentialStream* in)
+{
+	volatile uint8_t c;
+	uint8_t state = 0;
+
+	while (state != 3) {
+		c = chSequentialStreamGet(in);
+
+		switch (state) {
+			case 0:
+				if (c == 'T')
+					state = 1;
+				else
+					state = 0;
+			case 1:
+				if (c == 'E')
+					state = 2;
+				else if (c == 'T')
+					state = 1;
+				else
+					state = 0;
+			case 2:
+				if (c == 'L')
+					state = 3;
+				else if (c == 'T')
+					state = 1;
+				else
+					state = 0;
+		}
+	}
+	return c = chSequentialStreamGet(in); // parses telemetry level
+}
+
+uint8_t com_receive_nb_frames(BaseSequentialStream* in)
+{
+	volatile uint8_t c;
+	uint8_t state = 0;
+
+	while (state != 3) {
+		c = chSequentialStreamGet(in);
+
+		switch (state) {
+			case 0:
+				if (c == 'A')
+					state = 1;
+				else
+					state = 0;
+			case 1:
+				if (c == 'V')
+					state = 2;
+				else if (c == 'A')
+					state = 1;
+				else
+					state = 0;
+			case 2:
+				if (c == 'G')
+					state = 3;
+				else if (c == 'A')
+					state = 1;
+				else
+					state = 0;
+		}
+	}
+	return c = chSequentialStreamGet(in); // parses number of frames
+}
 
 uint16_t com_receive_data(BaseSequentialStream* in)
 {
@@ -191,9 +279,23 @@ uint16_t com_receive_data(BaseSequentialStream* in)
 }
 
 
+void com_set_telemetry(uint8_t level)
+{
+	if (level < NB_TELEMETRY_LEVELS)
+		telemetry_mask = telemetry_masks[level];
+}
+
+bool com_telemetry_enabled(message_type msg_type)
+{
+	return (telemetry_mask & MSG_BIT(msg_type)) != 0;
+}
+
 void com_send_data(BaseSequentialStream* out, uint8_t* data, uint16_t size,
                    message_type msg_type)
 {
+	if (!com_telemetry_enabled(msg_type))
+		return;
+
 	// send start message
 	chSequentialStreamWrite(out, (uint8_t*)"START\r", 6);
 
@@ -223,6 +325,18 @@ void com_send_data(BaseSequentialStream* out, uint8_t* data, uint16_t size,
 		case MSG_IMAGE_PATH:
 			chprintf(out, "path");
 			break;
+		case MSG_THRESHOLDS:
+			chprintf(out, "thresholds");
+			break;
+		case MSG_PRUNING:
+			chprintf(out, "pruning");
+			break;
+		case MSG_EDGE_MAP:
+			chprintf(out, "preview");
+			break;
+		case MSG_ORDERING:
+			chprintf(out, "ordering");
+			break;
 	}
 	chprintf(out, "\n");
 
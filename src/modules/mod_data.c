@@ -11,6 +11,7 @@
 // Module headers
 
 #include <mod_data.h>
+#include <mod_img_processing.h>
 
 /*===========================================================================*/
 /* Module constants.                                                         */
@@ -18,7 +19,11 @@
 
 #define MAX_ALLOCATED_DATA   100000 // max size in bytes for data structures
 #define SIZE_OF_DATA         (sizeof(cartesian_coord) + sizeof(uint8_t))
-#define MAX_LENGTH           (MAX_ALLOCATED_DATA/SIZE_OF_DATA)
+#define MAX_PATH_LENGTH      (MAX_ALLOCATED_DATA/SIZE_OF_DATA)
+
+// the color buffer also holds the colors of the pixels of a frame
+#define MAX_LENGTH           (MAX_PATH_LENGTH > IM_LENGTH_PX*IM_HEIGHT_PX ? \
+                              MAX_PATH_LENGTH : IM_LENGTH_PX*IM_HEIGHT_PX)
 
 /*===========================================================================*/
 /* Module local variables.                                                   */
@@ -1,11 +1,18 @@
 /**
  * @file    mod_img_processing.c
  * @brief   Handles the capture and the processing of an image.
+ * @details The processing of a capture starts on the first half of the frame
+ *          (half-transfer interrupt of the DCMI), the streaming engine works
+ *          on the landed rows while the next ones are received.
+ *
+ *          The live preview runs capture, edge detection and transmission as
+ *          three threads linked by mailboxes: only the latest frame is
+ *          processed, and if the link is still busy, the edges waiting to be
+ *          sent are replaced by the new ones. No path is planned.
  */
 
 // C standard header files
 
-#include <math.h>
 #include <stdlib.h>
 
 // ChibiOS headers
@@ -23,137 +30,173 @@
 // Module headers
 
 #include <mod_img_processing.h>
+#include <canny.h>
+#include <edge_map.h>
+#include <arena.h>
 #include <mod_path.h>
 #include <mod_communication.h>
 #include <mod_data.h>
-#include <tools.h>
 
 
 /*===========================================================================*/
 /* Module constants.                                                         */
 /*===========================================================================*/
 
-// Buffer size
-
-#define IM_LENGTH_PX       100
-#define IM_HEIGHT_PX       90
-
-// Convolution offsets
-
-#define XY_OFFSET_5x5      2
-#define XY_OFFSET_3x3      1
-
-#define MARGIN_PX          4
-
-// Conversion coefficients
-
-#define RAD2DEG            180./M_PI
-#define DEG2RAD            M_PI/180.
-
-// Octant limits in degree
-
-#define FIRST_OCTANT_L     -22.5f
-#define FIRST_OCTANT_H     22.5f
-
-#define SECOND_OCTANT_L    22.5
-#define SECOND_OCTANT_H    67.5
-
-#define THIRD_OCTANT_L     67.5
-#define THIRD_OCTANT_H     112.5
-
-#define FOURTH_OCTANT_L    112.5
-#define FOURTH_OCTANT_H    157.5
-
-#define FIFTH_OCTANT_L     157.5
-#define FIFTH_OCTANT_H     -157.5
-
-#define SIXTH_OCTANT_L     -157.5
-#define SIXTH_OCTANT_H     -112.5
-
-#define SEVENTH_OCTANT_L   -112.5
-#define SEVENTH_OCTANT_H   -67.5
+// Camera settings
 
-#define EIGHTH_OCTANT_L    -67.5
-#define EIGHTH_OCTANT_H    -22.5
+#define CAMERA_CONTRAST    150
 
+// Subsampling of the single frame and of the tiles of the mosaic (twice the
+// resolution), for the resolution profile
 
-#define HIGH_THRESHOLD     0.18
-#define LOW_THRESHOLD      0.05
+#if IM_PROFILE == IM_PROFILE_100x90 || IM_PROFILE == IM_PROFILE_160x120
+#define CAMERA_SUBSAMPLING 4
+#define CAMERA_SUBSAMPLING_MODE SUBSAMPLING_X4
+#define TILE_SUBSAMPLING   2
+#define TILE_SUBSAMPLING_MODE SUBSAMPLING_X2
+#else
+#define CAMERA_SUBSAMPLING 2
+#define CAMERA_SUBSAMPLING_MODE SUBSAMPLING_X2
+#define TILE_SUBSAMPLING   1
+#define TILE_SUBSAMPLING_MODE SUBSAMPLING_X1
+#endif
 
-#define WEAK_PIXEL         100
-#define BG_PIXEL           0
+#define CAMERA_X_POS       ((PO8030_MAX_WIDTH-CAMERA_SUBSAMPLING*IM_LENGTH_PX)/2)
+#define CAMERA_Y_POS       0
 
-// If the maximum of all pixels in I_mag is under this value,
-// the picture is considered pitch black
+#if CAMERA_SUBSAMPLING*IM_LENGTH_PX > PO8030_MAX_WIDTH \
+    || CAMERA_SUBSAMPLING*IM_HEIGHT_PX > PO8030_MAX_HEIGHT
+#error "the camera window of the profile exceeds the sensor"
+#endif
+
+// Tiled capture, the mosaic is centered like the single frame
+
+#define MOSAIC_X_POS       ((PO8030_MAX_WIDTH-TILE_SUBSAMPLING*MOSAIC_LENGTH_PX)/2)
+#define MOSAIC_Y_POS       0
+
+#if TILE_SUBSAMPLING*MOSAIC_LENGTH_PX > PO8030_MAX_WIDTH \
+    || TILE_SUBSAMPLING*MOSAIC_HEIGHT_PX > PO8030_MAX_HEIGHT
+#error "the mosaic of the profile exceeds the sensor"
+#endif
+
+// a new window is applied from the next frame of the sensor on
+#define TILE_SETTLE_MS     100
+
+// the tile of a captured frame, its index in a multi-frame capture and the
+// processing it goes through are sent with its buffer index
+#define NO_TILE            0xFF
+#define FRAME_EDGES        0        // canny edge detection
+#define FRAME_REGIONS      1        // outlines of the color regions
+#define FRAME_PREVIEW      2        // edges streamed to the computer only
+#define FRAME_MSG(frame, mode, tile, index, count) \
+	((msg_t)((count) << 24 | (index) << 16 | (tile) << 8 | (mode) << 4 | (frame)))
+#define MSG_FRAME(msg)     ((uint8_t)((msg) & 0x0F))
+#define MSG_MODE(msg)      ((uint8_t)(((msg) >> 4) & 0x0F))
+#define MSG_TILE(msg)      ((uint8_t)((msg) >> 8))
+#define MSG_INDEX(msg)     ((uint8_t)((msg) >> 16))
+#define MSG_COUNT(msg)     ((uint8_t)((msg) >> 24))
+
+// Capture of frame N+1 while frame N is processed, if two RGB565 frames of
+// the profile fit in the DCMI buffer. Otherwise a single buffer is used and
+// the next capture waits for the end of the processing.
+
+#define ROW_BYTES          (IM_LENGTH_PX*2)
+
+#if FRAME_BYTES > MAX_BUFF_SIZE
+#error "a frame of the profile does not fit in the DCMI buffer"
+#elif 2*FRAME_BYTES <= MAX_BUFF_SIZE
+#define DOUBLE_BUFFERING   1
+#else
+#define DOUBLE_BUFFERING   0
+#endif
+
+#if DOUBLE_BUFFERING
+#define NB_FRAME_BUFFERS   2
+#else
+#define NB_FRAME_BUFFERS   1
+#endif
+
+// Edge maps of the live preview: one being sent, one waiting to be sent
+// (replaced by a newer frame if the link is too slow)
+#define NB_PREVIEW_SLOTS   2
 
-#define MIN_I_MAG          100.0
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
 
-// Color masks for RGB565 image format
+// Owner of a DCMI buffer, only the owner may access it
+typedef enum buffer_owner {
+	BUFFER_FREE,
+	BUFFER_CAMERA,         // being filled by the DMA
+	BUFFER_PIPELINE        // being processed (modified in place)
+} buffer_owner;
 
-#define RED_MASK           0xF800
-#define GREEN_MASK         0x7E0
-#define BLUE_MASK          0x1F
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
 
-#define RGB_RED_POS        8
-#define RGB_GREEN_POS      3
-#define RGB_BLUE_POS       3
+static uint8_t *img_buffer;
 
-#define RGB_MAX_VALUE      255.0f
+// edges of the last processed frame, they outlive the frame buffer
+static edge_map frame_edges;
 
-#define LUMA_RED_COEFF     0.2989f
-#define LUMA_GREEN_COEFF   0.5870f
-#define LUMA_BLUE_COEFF	    0.1140f
+static uint8_t *frame_buffers[NB_FRAME_BUFFERS];
+static volatile buffer_owner frame_owner[NB_FRAME_BUFFERS];
 
-#define BLACK_THRESHOLD    60
-#define BLUE_MIN_VALUE     45
-#define GREEN_BLUE_DIFF    20
-#define GREEN_COEFF        1.2f
-#define RED_COEFF          1.5f
+// rows of each buffer that have landed, the processing of a frame starts
+// with its first row group while the DMA fills the next rows
+static volatile img_coord frame_rows[NB_FRAME_BUFFERS];
 
-#define NUMBER_COLORS      3
+// buffer the DMA fills on the next capture
+static uint8_t next_frame = 0;
 
-// Camera settings
+// set by capture_image_tiled() (capture_image_regions()) until the capture
+// thread takes the request
+static volatile bool tiled_request = false;
+static volatile bool regions_request = false;
+static volatile bool preview_request = false;
 
-#define CAMERA_CONTRAST    150
-#define CAMERA_SUBSAMPLING 4
-#define CAMERA_X_POS       ((PO8030_MAX_WIDTH-CAMERA_SUBSAMPLING*IM_LENGTH_PX)/2)
-#define CAMERA_Y_POS       0
+// frames are captured continuously for the live preview until it is cleared
+static volatile bool preview_active = false;
 
-#define KER_DIV 159
+// edges of the preview frames, the transmit thread sends them one by one
+static edge_map preview_slots[NB_PREVIEW_SLOTS];
 
-const uint8_t Gaus5x5[] = { 2,  4,  5,  4,  2,
-                            4,  9,  12, 9,  4,
-                            5,  12, 15, 12, 5,
-                            4,  9,  12, 9,  4,
-                            2,  4,  5,  4,  2 };
+// frames averaged by each capture (each tile), set from the computer
+static volatile uint8_t nb_accumulated_frames = 1;
 
-const int8_t Kx[] = { -1,  0,  1,
-                      -2,  0,  2,
-                      -1,  0,  1 };
+// running sum of the frames of a multi-frame capture, in the arena
+static gray_sum *frame_sum;
 
-const int8_t Ky[] = { 1,  2,  1,
-                      0,  0,  0,
-                     -1, -2, -1 };
+static bool capture_thd_alive = false;
+static bool process_thd_alive = false;
+static bool transmit_thd_alive = false;
 
 /*===========================================================================*/
-/* Module local variables.                                                   */
+/* Semaphores.                                                               */
 /*===========================================================================*/
 
-static uint8_t *img_buffer;
-static uint8_t *img_temp_buffer;
+static BSEMAPHORE_DECL(sem_capture_image, TRUE);
 
-static uint8_t *sobel_angle_state;
-static float *I_mag;
+// counts the buffers released by the processing
+static SEMAPHORE_DECL(sem_frame_free, NB_FRAME_BUFFERS);
 
-static bool capture_thd_alive = false;
-static bool process_thd_alive = false;
+// signaled when a row group of the frame being captured has landed
+static BSEMAPHORE_DECL(sem_rows_landed, TRUE);
 
 /*===========================================================================*/
-/* Semaphores.                                                               */
+/* Mailboxes.                                                                */
 /*===========================================================================*/
 
-static BSEMAPHORE_DECL(sem_image_captured, TRUE);
-static BSEMAPHORE_DECL(sem_capture_image, TRUE);
+// index and tile of the captured buffers, in capture order
+static msg_t frames_captured_buffer[NB_FRAME_BUFFERS];
+static MAILBOX_DECL(mb_frames_captured, frames_captured_buffer, NB_FRAME_BUFFERS);
+
+// preview slots free for the next frame, and slots waiting to be sent
+static msg_t preview_free_buffer[NB_PREVIEW_SLOTS];
+static MAILBOX_DECL(mb_preview_free, preview_free_buffer, NB_PREVIEW_SLOTS);
+static msg_t preview_ready_buffer[NB_PREVIEW_SLOTS];
+static MAILBOX_DECL(mb_preview_ready, preview_ready_buffer, NB_PREVIEW_SLOTS);
 
 /*===========================================================================*/
 /* Module thread pointers.                                                   */
@@ -161,484 +204,307 @@ static BSEMAPHORE_DECL(sem_capture_image, TRUE);
 
 static thread_t* ptr_capture_image;
 static thread_t* ptr_process_image;
+static thread_t* ptr_transmit_preview;
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
 /**
- * @brief                       classifies a color from its RGB values
- * @param[in]   rgb             rgb_color struct containing rgb information
- * @return                      a color (white, black, red, green, blue)
+ * @brief                       sends the image produced by a stage of the
+ *                              canny edge detection to the computer
+ * @param[in]   stage           stage that has just completed
+ * @param[in]   data            pointer to the buffer produced by the stage
+ * @param[in]   size            size in bytes of data
+ * @return                      none
  */
-static uint8_t classify_color(rgb_color rgb)
+static void send_stage_image(pipeline_stage stage, uint8_t* data, uint16_t size)
 {
-	if (rgb.red > RED_COEFF*rgb.blue && rgb.red > RED_COEFF*rgb.green)
-		return red;
-	else if (abs((int16_t)rgb.blue - (int16_t)rgb.green) < GREEN_BLUE_DIFF
-	         && rgb.green > GREEN_COEFF*rgb.red)
-		return green;
-	else if ((rgb.blue > rgb.red) && (rgb.blue > rgb.green)
-	           && (rgb.blue > BLUE_MIN_VALUE))
-		return blue;
-	else if ((rgb.red + rgb.green + rgb.blue)/NUMBER_COLORS < BLACK_THRESHOLD)
-		return black;
-	else
-		return white;
+	switch (stage) {
+		case STAGE_GRAYSCALE:
+			com_send_data((BaseSequentialStream *)&SD3, data, size, MSG_IMAGE_GRAYSCALE);
+			break;
+		case STAGE_GAUSS:
+			com_send_data((BaseSequentialStream *)&SD3, data, size, MSG_IMAGE_GAUSS);
+			break;
+		case STAGE_SOBEL:
+			com_send_data((BaseSequentialStream *)&SD3, data, size, MSG_IMAGE_SOBEL_MAG);
+			break;
+		case STAGE_LOCAL_MAX:
+			com_send_data((BaseSequentialStream *)&SD3, data, size, MSG_IMAGE_LOCAL_THR);
+			break;
+		case STAGE_HYSTERESIS:
+		case STAGE_REGIONS:
+			com_send_data((BaseSequentialStream *)&SD3, data, size, MSG_IMAGE_CANNY);
+			break;
+		default:
+			break;
+	}
 }
 
 /**
- * @brief                       converts an rgb565 color to a grayscale image
- *                              and classifies image colors
- * @param[out]  color           pointer to buffer containing path color
+ * @brief                       sets the camera window of the single frame
+ *                              capture
  * @return                      none
  */
-static void set_grayscale_filter_colors(uint8_t* color)
+static void set_frame_window(void)
 {
-	rgb_color rgb;
-//	uint8_t red_px, green_px, blue_px = 0;
-	for (uint16_t i = 0; i < (IM_LENGTH_PX * IM_HEIGHT_PX)*2; i+=2) {
-
-		// extract RGB values and convert to range 0-255
-		uint16_t rgb_565 = ((int16_t)img_buffer[i]  << 8) | img_buffer[i+1];
-		rgb.red = (rgb_565 & RED_MASK) >> RGB_RED_POS;
-		rgb.green = (rgb_565 & GREEN_MASK) >> RGB_GREEN_POS;
-		rgb.blue = (rgb_565 & BLUE_MASK) << RGB_BLUE_POS;
-
-		// classify pixel color (black, red, green, blue, background (white))
-		color[i/2] = classify_color(rgb);
-
-		// convert img_buffer to grayscale
-		img_buffer[i/2] = LUMA_RED_COEFF*rgb.red + LUMA_GREEN_COEFF*rgb.green
-		                  + LUMA_BLUE_COEFF*rgb.blue;
-	}
+	po8030_advanced_config(FORMAT_RGB565,
+	                       CAMERA_X_POS, CAMERA_Y_POS,
+	                       CAMERA_SUBSAMPLING*IM_LENGTH_PX,
+	                       CAMERA_SUBSAMPLING*IM_HEIGHT_PX,
+	                       CAMERA_SUBSAMPLING_MODE, CAMERA_SUBSAMPLING_MODE);
 }
 
 /**
- * @brief                       Filters out obvious noise and smoothens the image.
+ * @brief                       sets the camera window of a tile of the mosaic,
+ *                              the frame size stays IM_LENGTH_PX x IM_HEIGHT_PX
+ * @param[in]   tile            tile index, row by row
  * @return                      none
- * @note                        A 5x5 Gaussian filter was chosen with a standard
- *                              deviation of 1.
  */
-static void gaussian_filter(void)
+static void set_tile_window(uint8_t tile)
 {
-	uint16_t pos = 0;
-	for (uint8_t x = 0; x < IM_LENGTH_PX; ++x) {
-		for (uint8_t y = 0; y < IM_HEIGHT_PX; ++y) {
-			pos = position(x,y);
-			if (x < XY_OFFSET_5x5 || x >= (IM_LENGTH_PX - XY_OFFSET_5x5)
-			    || y < XY_OFFSET_5x5 || y >= (IM_HEIGHT_PX - XY_OFFSET_5x5)) {
-				img_temp_buffer[pos] = img_buffer[pos];
-				continue;
-			}
-			uint16_t conv = 0;
-			uint16_t k = 0;
-			for (int8_t x_ker = -XY_OFFSET_5x5; x_ker <= XY_OFFSET_5x5; ++x_ker) {
-				for (int8_t y_ker = -XY_OFFSET_5x5; y_ker <= XY_OFFSET_5x5; ++y_ker) {
-					conv += img_buffer[pos + x_ker +(y_ker * IM_LENGTH_PX)]*Gaus5x5[k];
-//					__SMMLA(img_buffer[position + x_ker +(y_ker * IM_LENGTH_PX)],Gaus5x5[k],conv);
-					++k;
-				}
-			}
-			img_temp_buffer[pos] = (uint8_t)(conv / KER_DIV);
-		}
-	}
+	po8030_advanced_config(FORMAT_RGB565,
+	                       MOSAIC_X_POS + TILE_SUBSAMPLING*TILE_STEP_X*(tile % TILES_X),
+	                       MOSAIC_Y_POS + TILE_SUBSAMPLING*TILE_STEP_Y*(tile / TILES_X),
+	                       TILE_SUBSAMPLING*IM_LENGTH_PX,
+	                       TILE_SUBSAMPLING*IM_HEIGHT_PX,
+	                       TILE_SUBSAMPLING_MODE, TILE_SUBSAMPLING_MODE);
+	chThdSleepMilliseconds(TILE_SETTLE_MS);
 }
 
 /**
- * @brief                       The sobel filter emphasizes edges by computing
- *                              the norm of the gradient of the image intensity
- *                              for each pixel. From these values, we can also
- *                              extract the gradient's angle from this function
- *                              and use it later for edge thinning.
- * @return        max           The maximum gradient intensity computed for an image.
+ * @brief                       waits until rows of a captured frame have
+ *                              landed in its buffer
+ * @param[in]   frame           index of the buffer
+ * @param[in]   rows            rows needed, IM_HEIGHT_PX for the whole frame
+ * @return                      rows landed, at least rows
  */
-static float sobel_filter(void)
+static img_coord wait_frame_rows(uint8_t frame, img_coord rows)
 {
-	float max = 0;
-	float theta = 0;
-	uint16_t pos = 0;
-	for (uint8_t x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
-		for (uint8_t y = XY_OFFSET_3x3; y < IM_HEIGHT_PX-XY_OFFSET_3x3; ++y) {
-			pos = position(x,y);
-			int16_t Ix = 10;
-			int16_t Iy = 0;
-			uint16_t k = 0;
-			for (int8_t x_ker = -XY_OFFSET_3x3; x_ker <= XY_OFFSET_3x3; ++x_ker) {
-				for (int8_t y_ker = -XY_OFFSET_3x3; y_ker <= XY_OFFSET_3x3; ++y_ker) {
-					Ix += img_temp_buffer[pos + x_ker +(y_ker * IM_LENGTH_PX)]*Kx[k];
-					Iy += img_temp_buffer[pos+ x_ker +(y_ker * IM_LENGTH_PX)]*Ky[k];
-//					Ix = (int16_t)__SMMLA((int32_t)(img_temp_buffer[pos + x_ker +(y_ker * IM_LENGTH_PX)]), (int32_t)(Kx[k]), (int32_t)Ix);
-//					Iy = (int16_t)__SMMLA((int32_t)(img_temp_buffer[pos + x_ker +(y_ker * IM_LENGTH_PX)]), (int32_t)(Ky[k]), (int32_t)Iy);
-					++k;
-				}
-			}
-			I_mag[pos] = sqrtf(Ix*Ix + Iy*Iy);
-			if (I_mag[pos]>max)
-				max = I_mag[pos];
-
-			theta = atan2f((float)Ix , (float)Iy)*RAD2DEG;
-
-			if ((theta > FIRST_OCTANT_L && theta <= FIRST_OCTANT_H)) {
-				sobel_angle_state[pos] = first_octant;
-			} else if ((theta > SECOND_OCTANT_L && theta <= SECOND_OCTANT_H)) {
-				sobel_angle_state[pos] = second_octant;
-			} else if ((theta > THIRD_OCTANT_L && theta <= THIRD_OCTANT_H)) {
-				sobel_angle_state[pos] = third_octant;
-			} else if ((theta > FOURTH_OCTANT_L && theta <= FOURTH_OCTANT_H	)) {
-				sobel_angle_state[pos] = fourth_octant;
-			} else if ((theta > FIFTH_OCTANT_L) || (theta <= FIFTH_OCTANT_H)) {
-				sobel_angle_state[pos] =  fifth_octant;
-			} else if ((theta > SIXTH_OCTANT_L && theta <= SIXTH_OCTANT_H)) {
-				sobel_angle_state[pos] = sixth_octant;
-			} else if ((theta > SEVENTH_OCTANT_L && theta <= SEVENTH_OCTANT_H)) {
-				sobel_angle_state[pos] = seventh_octant;
-			} else if ((theta > EIGHTH_OCTANT_L && theta <= EIGHTH_OCTANT_H)) {
-				sobel_angle_state[pos] = eighth_octant;
-			}
-		}
-	}
-	return max;
+	img_coord landed;
+	// a row group landing after the test leaves the semaphore signaled
+	while ((landed = frame_rows[frame]) < rows)
+		chBSemWait(&sem_rows_landed);
+	return landed;
 }
 
 /**
- * @brief                       Sets the color at the edge to the color inside
- *                              the shape that the edge is encircling.
- * @note                        The sobel_angle_state buffer tells us in which
- *                              octant the interior of a shape is, in relation
- *                              to the corresponding pixel
- * @param[out]     color        Pointer to buffer containing path color
+ * @brief                       runs the streaming edge detection on the rows
+ *                              of a frame as they land, the edges are detected
+ *                              shortly after its last row group
+ * @param[in]   frame           index of the buffer
+ * @param[in]   average         running sum of a multi-frame capture (may be
+ *                              NULL)
+ * @param[out]  color           color buffer of the frame
+ * @param[out]  edges           edges of the frame
+ * @param[in]   hook            see canny_edge_stream() (may be NULL)
  * @return                      none
  */
-static void set_strong_pixel_colors(uint8_t* color)
+static void stream_frame_rows(uint8_t frame, const gray_sum* average, uint8_t* color,
+                              edge_map* edges, stage_hook hook)
 {
-	uint16_t pos = 0;
-	int8_t dx = 0;
-	int8_t dy = 0;
-	for (uint8_t x = 1; x < IM_LENGTH_PX-1; ++x) {
-		for (uint8_t y = 1; y < IM_HEIGHT_PX-1; ++y) {
-			pos = position(x,y);
-			if (img_buffer[pos] == STRONG_PIXEL) {
-				switch (sobel_angle_state[pos]) {
-				case first_octant:
-					dx = 1; dy = 0;
-					break;
-				case second_octant:
-					dx = 1; dy = -IM_LENGTH_PX;
-					break;
-				case third_octant:
-					dx = 0; dy = -IM_LENGTH_PX;
-					break;
-				case fourth_octant:
-					dx = -1; dy = -IM_LENGTH_PX;
-					break;
-				case fifth_octant:
-					dx = -1; dy = 0;
-					break;
-				case sixth_octant:
-					dx = -1; dy = IM_LENGTH_PX;
-					break;
-				case seventh_octant:
-					dx = 0; dy = IM_LENGTH_PX;
-					break;
-				case eighth_octant:
-					dx = 1; dy = IM_LENGTH_PX;
-					break;
-				}
-				color[pos] = color[pos + dx + dy];
-			}
-		}
+	canny_stream_begin(img_buffer, average, color, edges, hook);
+	for (img_coord landed = 0; landed < IM_HEIGHT_PX; ) {
+		landed = wait_frame_rows(frame, landed + 1);
+		canny_stream_rows(landed);
 	}
+	canny_stream_end();
 }
 
-
 /**
- * @brief                       Depending on the gradient's angle, we know in which
- *                              direction an edge thickens for all pixels.
- *                              Given that, we check if a pixel's gradient intensity
- *                              is higher than both pixels located in its
- *                              corresponding octants. If it is the case, then
- *                              we keep its value. If not, then we put it to 0.
- * @param[in]      max          The maximum gradient intensity computed for an image.
+ * @brief                       runs the edge detection on a captured frame
+ *                              and reports its thresholds
+ * @param[in]   frame           index of the buffer
+ * @param[in]   average         running sum of a multi-frame capture (may be
+ *                              NULL)
+ * @param[out]  color           color buffer of the frame
  * @return                      none
  */
-static void local_max_supression(float max)
+static void detect_edges(uint8_t frame, const gray_sum* average, uint8_t* color)
 {
-	float mag_octant = 0;
-	float mag_octant_opposed = 0;
-
-	const int8_t dx = 1;
-	const int8_t dy = IM_LENGTH_PX;
-
-	uint16_t pos = 0;
-	for (uint8_t x = XY_OFFSET_3x3; x < IM_LENGTH_PX-XY_OFFSET_3x3; ++x) {
-		for (uint8_t y = XY_OFFSET_3x3; y < IM_HEIGHT_PX-XY_OFFSET_3x3; ++y) {
-			pos = position(x,y);
-			switch (sobel_angle_state[pos]) {
-				case first_octant:
-				case fifth_octant:
-					mag_octant = I_mag[pos - dx];
-					mag_octant_opposed = I_mag[pos + dx];
-					break;
-				case second_octant:
-				case sixth_octant:
-					mag_octant = I_mag[pos - dy + dx];
-					mag_octant_opposed = I_mag[pos + dy - dx];
-					break;
-				case third_octant:
-				case seventh_octant:
-					mag_octant = I_mag[pos - dy];
-					mag_octant_opposed = I_mag[pos + dy];
-				break;
-				case fourth_octant:
-				case eighth_octant:
-					mag_octant = I_mag[pos - dy - dx];
-					mag_octant_opposed = I_mag[pos + dy + dx];
-				break;
-			}
-			if ((I_mag[pos] >= mag_octant) && (I_mag[pos] >= mag_octant_opposed)) {
-				img_buffer[pos] = I_mag[pos]/max*STRONG_PIXEL;
-			} else
-				img_buffer[pos] = BG_PIXEL;
-		}
+	// the intermediate images only exist with the full frame engine
+	if (com_telemetry_enabled(MSG_IMAGE_GAUSS)
+	    || com_telemetry_enabled(MSG_IMAGE_SOBEL_MAG)
+	    || com_telemetry_enabled(MSG_IMAGE_LOCAL_THR)) {
+		wait_frame_rows(frame, IM_HEIGHT_PX);
+		canny_edge(img_buffer, average, color, &frame_edges, send_stage_image);
+	} else {
+		stream_frame_rows(frame, average, color, &frame_edges, send_stage_image);
 	}
-}
 
-/**
- * @brief                       Compares the gradient intensity of all pixels to
- *                              selected threshold values and
- *                              separates them into 3 categories : Strong pixels,
- *                              Weak pixels and Background pixels.
- * @return   none
- */
-static void double_threshold(void)
-{
-	uint16_t pos = 0;
-	for (uint8_t x = 0; x < IM_LENGTH_PX; x++) {
-		for (uint8_t y = 0; y < IM_HEIGHT_PX; y++) {
-			pos = position(x,y);
-			if (img_buffer[pos] > HIGH_THRESHOLD*STRONG_PIXEL) {
-				img_temp_buffer[pos] = STRONG_PIXEL;
-			} else if (img_buffer[pos] > LOW_THRESHOLD*STRONG_PIXEL) {
-				img_temp_buffer[pos] = WEAK_PIXEL;
-			} else {
-				img_temp_buffer[pos] = BG_PIXEL;
-			}
-		}
-	}
+	canny_thresholds thresholds = canny_get_thresholds();
+	com_send_data((BaseSequentialStream *)&SD3, (uint8_t*)&thresholds,
+	              sizeof(canny_thresholds), MSG_THRESHOLDS);
 }
 
-
 /**
- * @brief                       Checks if weak pixels are near a strong pixels.
- *                              If it is the case, then they are turned into strong pixels.
- *                              Otherwise, they are turned to background pixels.
+ * @brief                       gives a processed frame buffer back to the
+ *                              camera
+ * @param[in]   frame           index of the buffer
  * @return                      none
  */
-static void edge_track_hyst(void)
+static void release_frame(uint8_t frame)
 {
-	const int8_t dx = 1;
-	const int8_t dy = IM_LENGTH_PX;
-
-	uint16_t pos = 0;
-	for (uint8_t x = 1; x < IM_LENGTH_PX-1; x++) {
-		for (uint8_t y = 1; y < IM_HEIGHT_PX-1; y++) {
-			pos = position(x,y);
-			if (img_temp_buffer[pos] == WEAK_PIXEL) {
-				if (img_temp_buffer[pos-dy-dx] == STRONG_PIXEL
-				    || img_temp_buffer[pos-dy] == STRONG_PIXEL
-				    || img_temp_buffer[pos-dy+dx] == STRONG_PIXEL
-				    || img_temp_buffer[pos-dx] == STRONG_PIXEL
-				    || img_temp_buffer[pos+dx] == STRONG_PIXEL
-				    || img_temp_buffer[pos+dy-dx] == STRONG_PIXEL
-				    || img_temp_buffer[pos+dy] == STRONG_PIXEL
-				    || img_temp_buffer[pos+dy+dx] == STRONG_PIXEL)
-
-					img_buffer[pos] = STRONG_PIXEL;
-				else
-					img_buffer[pos] = BG_PIXEL;
-			} else if (img_temp_buffer[pos] == STRONG_PIXEL) {
-				img_buffer[pos] = STRONG_PIXEL;
-			} else {
-				img_buffer[pos] = BG_PIXEL;
-			}
-		}
-	}
+	img_buffer = NULL;
+	frame_owner[frame] = BUFFER_FREE;
+	chSemSignal(&sem_frame_free);
 }
 
 /**
- * @brief                       Fills the image with background pixels
+ * @brief                       captures a frame into the next buffer once
+ *                              it is released, the frame is posted to the
+ *                              processing as soon as the capture starts and
+ *                              its row groups are signaled as they land
+ * @param[in]   msg             FRAME_MSG() of the frame, its buffer index
+ *                              being set here
  * @return                      none
  */
-static void fill_background(void)
+static void capture_frame(msg_t msg)
 {
-	uint16_t pos = 0;
-	for (uint8_t x = 0; x < IM_LENGTH_PX; x++) {
-		for (uint8_t y = 0; y < IM_HEIGHT_PX; y++) {
-			pos = position(x,y);
-			img_buffer[pos] = BG_PIXEL;
+	// wait until the pipeline releases the buffer filled next
+	chSemWait(&sem_frame_free);
+	uint8_t frame = next_frame;
+	chDbgAssert(frame_owner[frame] == BUFFER_FREE, "frame still processed");
+	frame_owner[frame] = BUFFER_CAMERA;
+	frame_rows[frame] = 0;
+
+	// never blocks, a message per buffer at most
+	dcmi_capture_start();
+	chMBPost(&mb_frames_captured, msg | frame, TIME_INFINITE);
+
+	// first half of the frame (DMA half transfer), then the whole frame
+	uint32_t received = 0;
+	while (received < FRAME_BYTES) {
+		received = dcmi_wait_bytes_received(received);
+		if (received < FRAME_BYTES) {
+			frame_rows[frame] = received / ROW_BYTES;
+			chBSemSignal(&sem_rows_landed);
 		}
 	}
-}
-
-/**
- * @brief                       Removes removes image borders (width = MARGIN_PX)
- * @return                      none
- */
-static void remove_borders(void)
-{
-	uint16_t pos = 0;
-
-	for (uint8_t x = 0; x < IM_LENGTH_PX; ++x) {
+	chDbgAssert(dcmi_get_last_image_ptr() == frame_buffers[frame],
+	            "unexpected frame buffer");
 
-		// top pixels
-		for (uint8_t y = 0; y < MARGIN_PX; ++y) {
-			pos = position(x,y);
-			img_buffer[pos] = BG_PIXEL;
-		}
-
-		// bottom pixels
-		for (uint8_t y = IM_HEIGHT_PX-MARGIN_PX; y < IM_HEIGHT_PX; ++y) {
-			pos = position(x,y);
-			img_buffer[pos] = BG_PIXEL;
-		}
-	}
-
-	for (uint8_t y = MARGIN_PX; y < IM_HEIGHT_PX - MARGIN_PX; ++y) {
-
-		// left pixels
-		for (uint8_t x = 0; x < MARGIN_PX; ++x) {
-			pos = position(x,y);
-			img_buffer[pos] = BG_PIXEL;
-		}
-
-		// right pixels
-		for (uint8_t x = IM_LENGTH_PX - MARGIN_PX; x < IM_LENGTH_PX; ++x) {
-			pos = position(x,y);
-			img_buffer[pos] = BG_PIXEL;
-		}
-	}
+	frame_owner[frame] = BUFFER_PIPELINE;
+	next_frame = (frame + 1) % NB_FRAME_BUFFERS;
+	frame_rows[frame] = IM_HEIGHT_PX;
+	chBSemSignal(&sem_rows_landed);
 }
 
 /**
- * @brief                        Removes pixels that don't have any neighbours
- * @return                       none
+ * @brief                       detects the edges of a preview frame and
+ *                              hands them to the transmit thread
+ * @param[in]   frame           index of the buffer
+ * @return                      none
+ * @note                        A frame is dropped if a newer one is already
+ *                              being captured, and the edges waiting to be sent are
+ *                              replaced if the link is still busy with the
+ *                              previous ones: the computer always receives
+ *                              the latest frame.
  */
-static void remove_unique_px(void)
+static void preview_frame(uint8_t frame)
 {
-	const int8_t dx = 1;
-	const int8_t dy = IM_LENGTH_PX;
-	uint16_t pos= 0;
-	for (uint8_t x = 1; x < IM_LENGTH_PX-1; x++) {
-		for (uint8_t y = 1; y < IM_HEIGHT_PX-1; y++) {
-			pos = position(x,y);
-			if (img_buffer[pos]) {
-				if (  !img_buffer[pos + dx]      && !img_buffer[pos - dx]
-				   && !img_buffer[pos + dy]      && !img_buffer[pos - dy]
-				   && !img_buffer[pos - dy - dx] && !img_buffer[pos - dy + dx]
-				   && !img_buffer[pos + dy - dx] && !img_buffer[pos + dy + dx])
-					img_buffer[pos] = BG_PIXEL;
-			}
-		}
+	// the capture of a newer frame has started, this one has fully landed
+	chSysLock();
+	bool stale = chMBGetUsedCountI(&mb_frames_captured) > 0;
+	chSysUnlock();
+	if (stale) {
+		release_frame(frame);
+		return;
 	}
-}
-
-
-/**
- * @brief                         canny edge detection algorithm on img_buffer
- * @return                        none
- * @detaiL                        this algorithm performs canny edge detection
- *                                on an image buffer obtained by the camera.
- *                                The resulting buffers are a buffer of size
- *                                IM_LENGTH_PX * IM_HEIGHT_PX containing edges
- *                                of img_buffer. Active pixels take the value of
- *                                IM_MAX_VALUE and inactive pixels take a value of 0.
- */
-static void canny_edge(void)
-{
-	// free position and color buffers
-	data_free();
-
-
-	uint8_t* color = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
-	set_grayscale_filter_colors(color);
-
-	// send grayscale image
-	com_send_data((BaseSequentialStream *)&SD3, img_buffer,
-	              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t), MSG_IMAGE_GRAYSCALE);
-
-	img_temp_buffer = calloc(IM_LENGTH_PX*IM_HEIGHT_PX, sizeof(uint8_t));
-	gaussian_filter();
-
-	// send image after Gaussian filter
-	com_send_data((BaseSequentialStream *)&SD3, img_temp_buffer,
-	              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t), MSG_IMAGE_GAUSS);
-
-	sobel_angle_state = calloc(IM_LENGTH_PX*IM_HEIGHT_PX, sizeof(uint8_t));
-	I_mag = malloc(IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(float));
 
-	float max = sobel_filter();
-
-	// send Sobel filter gradient data
-	com_send_data((BaseSequentialStream *)&SD3, sobel_angle_state,
-	              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t), MSG_IMAGE_SOBEL_MAG);
-
-	local_max_supression(max);
-
-	// send image after local max suppression (local thresholding)
-	com_send_data((BaseSequentialStream *)&SD3, img_buffer,
-	              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t), MSG_IMAGE_LOCAL_THR);
-
-	free(I_mag);
-
-	if (max > MIN_I_MAG) {
-		double_threshold();
-		edge_track_hyst();
-		remove_borders();
-		remove_unique_px();
-		set_strong_pixel_colors(color);
+	msg_t slot;
+	if (chMBFetch(&mb_preview_free, &slot, TIME_IMMEDIATE) != MSG_OK
+	    && chMBFetch(&mb_preview_ready, &slot, TIME_IMMEDIATE) != MSG_OK)
+		chMBFetch(&mb_preview_free, &slot, TIME_INFINITE);
 
+	// nothing outlives a preview frame, the path of the last capture is kept
+	arena_reset();
+	uint8_t* color = arena_malloc(IM_LENGTH_PX * IM_HEIGHT_PX);
+	if (color != NULL) {
+		stream_frame_rows(frame, NULL, color, &preview_slots[slot], NULL);
 	} else {
-		fill_background();
+		wait_frame_rows(frame, IM_HEIGHT_PX);
+		edge_map_clear(&preview_slots[slot]);
 	}
-
-	// send final Canny filtered image
-	com_send_data((BaseSequentialStream *)&SD3, img_buffer,
-	              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint8_t), MSG_IMAGE_CANNY);
-
-	free(img_temp_buffer);
-
-	free(sobel_angle_state);
+	release_frame(frame);
+	chMBPost(&mb_preview_ready, slot, TIME_INFINITE);
 }
 
 /*===========================================================================*/
 /* Module threads.                                                           */
 /*===========================================================================*/
 
+/**
+ * @note                        The DMA fills the buffers one after the other
+ *                              (double buffer mode of the DMA, one frame per
+ *                              capture) and the processing releases them in
+ *                              the same order. A capture may start as soon as
+ *                              a buffer is free: it is the one the DMA fills
+ *                              next, so the camera never writes into a frame
+ *                              that is still being processed.
+ *                              A frame is posted when its capture starts:
+ *                              its rows are processed as they land (row
+ *                              groups of dcmi_wait_bytes_received()), the
+ *                              camera only writes the rows not read yet.
+ *                              A tiled capture posts the NB_TILES tiles in
+ *                              a row, so the next tile is captured while the
+ *                              previous one is processed.
+ *                              A multi-frame capture posts its frames in a
+ *                              row as well, each of them is added to the
+ *                              running sum while the next one is captured.
+ *                              The live preview captures frames back to back
+ *                              until it is stopped.
+ */
 static THD_WORKING_AREA(wa_capture_image, 256);
 static THD_FUNCTION(thd_capture_image, arg)
 {
 	chRegSetThreadName(__FUNCTION__);
 	(void)arg;
 
-	po8030_advanced_config(FORMAT_RGB565,
-	                       CAMERA_X_POS, CAMERA_Y_POS,
-	                       CAMERA_SUBSAMPLING*IM_LENGTH_PX,
-	                       CAMERA_SUBSAMPLING*IM_HEIGHT_PX,
-	                       SUBSAMPLING_X4, SUBSAMPLING_X4);
+	set_frame_window();
 	po8030_set_contrast(CAMERA_CONTRAST);
 	po8030_set_awb(1);
+#if DOUBLE_BUFFERING
+	dcmi_enable_double_buffering();
+	frame_buffers[1] = dcmi_get_second_buffer_ptr();
+#else
 	dcmi_disable_double_buffering();
+#endif
+	frame_buffers[0] = dcmi_get_first_buffer_ptr();
 	dcmi_set_capture_mode(CAPTURE_ONE_SHOT);
 	dcmi_prepare();
 	chThdSleepMilliseconds(1000);
 	while (1) {
 		chBSemWait(&sem_capture_image);
-		dcmi_capture_start();
-		wait_image_ready();
-		chBSemSignal(&sem_image_captured);
+		bool tiled = tiled_request;
+		bool regions = regions_request;
+		bool preview = preview_request;
+		tiled_request = false;
+		regions_request = false;
+		preview_request = false;
+
+		if (preview) {
+			while (preview_active)
+				capture_frame(FRAME_MSG(0, FRAME_PREVIEW, NO_TILE, 0, 1));
+			continue;
+		}
+
+		// the regions are segmented on the colors of a single frame
+		uint8_t nb_frames = regions ? 1 : nb_accumulated_frames;
+		uint8_t mode = regions ? FRAME_REGIONS : FRAME_EDGES;
 
-    }
+		for (uint8_t tile = 0; tile < (tiled ? NB_TILES : 1); ++tile) {
+			if (tiled)
+				set_tile_window(tile);
+
+			for (uint8_t index = 0; index < nb_frames; ++index)
+				capture_frame(FRAME_MSG(0, mode, tiled ? tile : NO_TILE, index, nb_frames));
+		}
+
+		if (tiled)
+			set_frame_window();
+	}
 }
 
 
@@ -649,22 +515,106 @@ static THD_FUNCTION(thd_process_image, arg)
 	(void)arg;
 
 	while (1) {
-		chBSemWait(&sem_image_captured);
-		img_buffer = dcmi_get_last_image_ptr();
+		msg_t msg;
+		chMBFetch(&mb_frames_captured, &msg, TIME_INFINITE);
+		uint8_t frame = MSG_FRAME(msg);
+		uint8_t mode = MSG_MODE(msg);
+		uint8_t tile = MSG_TILE(msg);
+		uint8_t index = MSG_INDEX(msg);
+		uint8_t count = MSG_COUNT(msg);
+		img_buffer = frame_buffers[frame];
+
+		if (mode == FRAME_PREVIEW) {
+			preview_frame(frame);
+			continue;
+		}
+
+		// a frame (a mosaic) starts with the first frame of its first tile
+		if (index == 0 && (tile == NO_TILE || tile == 0)) {
+			// free position and color buffers
+			data_free();
+			arena_reset();
+			if (tile == 0)
+				planner_mosaic_begin();
+		}
+
+		// the frames of a multi-frame capture are averaged, the colors and
+		// the images sent are those of the last one
+		gray_sum* average = NULL;
+		if (count > 1) {
+			if (index == 0)
+				frame_sum = arena_calloc(1, sizeof(gray_sum));
+			wait_frame_rows(frame, IM_HEIGHT_PX);
+			if (frame_sum != NULL)
+				canny_accumulate(img_buffer, frame_sum);
+			if (index < count - 1) {
+				release_frame(frame);
+				continue;
+			}
+			average = frame_sum;
+		}
 
 		// send rgb image
-		com_send_data((BaseSequentialStream *)&SD3, img_buffer,
-		              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint16_t), MSG_IMAGE_RGB);
-		canny_edge();
-		path_planning();
+		if (com_telemetry_enabled(MSG_IMAGE_RGB)) {
+			wait_frame_rows(frame, IM_HEIGHT_PX);
+			com_send_data((BaseSequentialStream *)&SD3, img_buffer,
+			              IM_LENGTH_PX*IM_HEIGHT_PX*sizeof(uint16_t), MSG_IMAGE_RGB);
+		}
+
+		// the planner only reads the edge map, the camera may fill the
+		// buffer again as soon as the edges are detected
+		if (tile == NO_TILE) {
+			uint8_t* color = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
+			if (mode == FRAME_REGIONS) {
+				wait_frame_rows(frame, IM_HEIGHT_PX);
+				canny_segment_regions(img_buffer, color, &frame_edges, send_stage_image);
+			} else {
+				detect_edges(frame, average, color);
+			}
+			release_frame(frame);
+			arena_free(average);
+			path_planning();
+		} else {
+			// only the contours of the tile are kept
+			uint8_t* color = data_alloc_color(IM_LENGTH_PX * IM_HEIGHT_PX);
+			detect_edges(frame, average, color);
+			release_frame(frame);
+			arena_free(average);
+			planner_mosaic_add(&frame_edges, color, tile % TILES_X, tile / TILES_X, NULL);
+			data_free_color();
+			if (tile == NB_TILES - 1)
+				path_planning_mosaic();
+		}
+	}
+}
+
+/**
+ * @note                        Sends the edges of the preview frames as edge
+ *                              maps (1 bit per pixel), at the rate of the
+ *                              serial link. Below the processing, the link is
+ *                              mostly waited for.
+ */
+static THD_WORKING_AREA(wa_transmit_preview, 256);
+static THD_FUNCTION(thd_transmit_preview, arg)
+{
+	chRegSetThreadName(__FUNCTION__);
+	(void)arg;
+
+	while (1) {
+		msg_t slot;
+		chMBFetch(&mb_preview_ready, &slot, TIME_INFINITE);
+		com_send_data((BaseSequentialStream *)&SD3, (uint8_t*)preview_slots[slot].words,
+		              sizeof(edge_map), MSG_EDGE_MAP);
+		chMBPost(&mb_preview_free, slot, TIME_INFINITE);
 	}
 }
 
 static void capture_create_thd(void)
 {
 	if (!capture_thd_alive) {
+		// above the processing so that the next capture starts while it runs
 		ptr_capture_image = chThdCreateStatic(wa_capture_image, sizeof(wa_capture_image),
-		                                      NORMALPRIO, thd_capture_image, NULL);
+		                                      NORMALPRIO+2, thd_capture_image, NULL);
 		capture_thd_alive = true;
 	}
 }
@@ -678,13 +628,25 @@ static void process_img_create_thd(void)
 	}
 }
 
+static void transmit_preview_create_thd(void)
+{
+	if (!transmit_thd_alive) {
+		for (uint8_t slot = 0; slot < NB_PREVIEW_SLOTS; ++slot)
+			chMBPost(&mb_preview_free, slot, TIME_INFINITE);
+		ptr_transmit_preview = chThdCreateStatic(wa_transmit_preview,
+		                                         sizeof(wa_transmit_preview),
+		                                         NORMALPRIO, thd_transmit_preview, NULL);
+		transmit_thd_alive = true;
+	}
+}
+
 /*===========================================================================*/
 /* Module exported functions.                                                */
 /*===========================================================================*/
 
-uint8_t* get_img_buffer(void)
+edge_map* get_edge_map(void)
 {
-	return img_buffer;
+	return &frame_edges;
 }
 
 
@@ -693,9 +655,45 @@ void mod_img_processing_init(void)
 {
 	capture_create_thd();
 	process_img_create_thd();
+	transmit_preview_create_thd();
 }
 
 void capture_image(void)
 {
+	preview_active = false;
+	chBSemSignal(&sem_capture_image);
+}
+
+void capture_image_tiled(void)
+{
+	preview_active = false;
+	tiled_request = true;
+	chBSemSignal(&sem_capture_image);
+}
+
+void capture_image_regions(void)
+{
+	preview_active = false;
+	regions_request = true;
 	chBSemSignal(&sem_capture_image);
 }
+
+void capture_preview_start(void)
+{
+	if (preview_active)
+		return;
+	preview_active = true;
+	preview_request = true;
+	chBSemSignal(&sem_capture_image);
+}
+
+void capture_preview_stop(void)
+{
+	preview_active = false;
+}
+
+void set_accumulated_frames(uint8_t nb_frames)
+{
+	if (nb_frames >= 1 && nb_frames <= MAX_ACCUMULATED_FRAMES)
+		nb_accumulated_frames = nb_frames;
+}
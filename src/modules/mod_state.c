@@ -24,6 +24,7 @@
 #include <mod_data.h>
 #include <mod_calibration.h>
 #include <mod_img_processing.h>
+#include <planner.h>
 #include <def_epuck_field.h>
 
 /*===========================================================================*/
@@ -42,6 +43,13 @@
 #define CMD_IMAGE          'I'
 #define CMD_HOME           'H'
 #define CMD_VALIDATE       'V'
+#define CMD_TELEMETRY      'T'
+#define CMD_IMAGE_TILED    'M'
+#define CMD_ACCUMULATE     'A'
+#define CMD_IMAGE_REGIONS  'F'
+#define CMD_MIN_STROKE     'L'
+#define CMD_PREVIEW        'W'
+#define CMD_STOP_PREVIEW   'X'
 
 
 // Periods
@@ -107,6 +115,30 @@ static void process_command(uint8_t cmd)
 		case CMD_VALIDATE:
 			cal_set_goal_distance();
 			break;
+		case CMD_IMAGE_TILED:
+			if (draw_get_state() == false)
+				capture_image_tiled();
+			break;
+		case CMD_TELEMETRY:
+			com_set_telemetry(com_receive_telemetry((BaseSequentialStream *)&SD3));
+			break;
+		case CMD_ACCUMULATE:
+			set_accumulated_frames(com_receive_nb_frames((BaseSequentialStream *)&SD3));
+			break;
+		case CMD_IMAGE_REGIONS:
+			if (draw_get_state() == false)
+				capture_image_regions();
+			break;
+		case CMD_MIN_STROKE:
+			planner_set_min_stroke(com_receive_length((BaseSequentialStream *)&SD3));
+			break;
+		case CMD_PREVIEW:
+			if (draw_get_state() == false)
+				capture_preview_start();
+			break;
+		case CMD_STOP_PREVIEW:
+			capture_preview_stop();
+			break;
 	}
 }
 
@@ -0,0 +1,569 @@
+/**
+ * @file    path_order.c
+ * @brief   Ordering of the contours of a path to reduce the pen up travel.
+ * @details The greedy order draws next the extremity closest to the pen. The
+ *          extremities are indexed by a uniform grid of about two per cell,
+ *          the search widens ring by ring of cells and stops once the next
+ *          ring is farther than the best extremity found, in about linear
+ *          time instead of the quadratic scan of all the contours (same
+ *          order, same ties).
+ *
+ *          A local search then shortens the pen up moves left by the greedy
+ *          order: 2-opt moves reverse a sequence of contours, Or-opt moves
+ *          take a few consecutive contours elsewhere, a moved contour may be
+ *          drawn from its other end. It stops when no move helps or when its
+ *          time is over, the order at hand being the best one found.
+ * @note    This module does not depend on ChibiOS, it is shared by the
+ *          e-puck firmware and the host benchmark harness.
+ */
+
+// C standard header files
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <float.h>
+
+// Module headers
+
+#include <path_order.h>
+#include <arena.h>
+#include <tools.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// Extremities per cell of the grid, on average over its bounding box
+#define GRID_EXTREMITIES_PER_CELL 2
+
+// Smallest gain of a move of the local search (pixels), below it the rounding
+// errors could undo the move
+#define MIN_GAIN_PX        0.001f
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+// Uniform grid of the extremities left. The extremities of a cell are
+// entries[first[c]] to entries[first[c] + live[c] - 1], a drawn extremity is
+// swapped with the last one of its cell and live[c] decremented.
+// The contours are the pairs of edges, slot and at mirror the swaps of
+// path_order_nearest_scan() without moving the edges.
+typedef struct order_grid {
+	uint16_t* first;       // first entry of each cell, nb_cells + 1
+	uint16_t* live;        // extremities of each cell not drawn yet
+	uint16_t* entries;     // extremities (index in edges) sorted by cell
+	uint16_t* where;       // entry of each extremity
+	uint16_t* slot;        // position of each contour in the drawing order
+	uint16_t* at;          // contour at each position
+	cartesian_coord min;   // top left corner of the grid
+	uint16_t cell_px;      // side of a cell
+	uint16_t cols;
+	uint16_t rows;
+} order_grid;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static order_grid grid;
+
+// position the pen goes to after the contours improved by
+// path_order_improve() (NULL if they end the path)
+static const cartesian_coord* search_to;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                       squared distance between two points
+ */
+static inline uint32_t squared_distance(cartesian_coord a, cartesian_coord b)
+{
+	int32_t dx = (int32_t)a.x - b.x;
+	int32_t dy = (int32_t)a.y - b.y;
+	return (uint32_t)(dx*dx) + (uint32_t)(dy*dy);
+}
+
+/**
+ * @brief                       column or row of the cell of a coordinate,
+ *                              clamped to the grid
+ */
+static inline uint16_t grid_cell_coord(uint16_t pos, uint16_t min, uint16_t nb)
+{
+	if (pos < min)
+		return 0;
+	uint16_t cell = (pos - min)/grid.cell_px;
+	return cell < nb ? cell : nb - 1;
+}
+
+/**
+ * @brief                       cell of a point
+ */
+static inline uint32_t grid_cell(cartesian_coord pos)
+{
+	return grid_cell_coord(pos.x, grid.min.x, grid.cols)
+	       + (uint32_t)grid_cell_coord(pos.y, grid.min.y, grid.rows)*grid.cols;
+}
+
+/**
+ * @brief                       removes a drawn extremity from its cell
+ */
+static void grid_remove(const edge_pos* edges, uint16_t extremity)
+{
+	uint32_t cell = grid_cell(edges[extremity].pos);
+	uint16_t last = grid.first[cell] + --grid.live[cell];
+	uint16_t entry = grid.where[extremity];
+	grid.entries[entry] = grid.entries[last];
+	grid.where[grid.entries[entry]] = entry;
+}
+
+/**
+ * @brief                       finds the closest extremity left of a cell
+ * @param[in,out] best, best_key squared distance and position in edges (as
+ *                              path_order_nearest_scan() would have sorted
+ *                              them) of the closest extremity so far
+ * @return                      closest extremity so far
+ */
+static uint16_t grid_search_cell(const edge_pos* edges, uint32_t cell, cartesian_coord from,
+                                 uint16_t closest, uint32_t* best, uint16_t* best_key)
+{
+	uint16_t stop = grid.first[cell] + grid.live[cell];
+	for (uint16_t i = grid.first[cell]; i < stop; ++i) {
+		uint16_t extremity = grid.entries[i];
+		uint32_t distance = squared_distance(edges[extremity].pos, from);
+		uint16_t key = 2*grid.slot[extremity/2] + extremity%2;
+		if (distance < *best || (distance == *best && key < *best_key)) {
+			*best = distance;
+			*best_key = key;
+			closest = extremity;
+		}
+	}
+	return closest;
+}
+
+/**
+ * @brief                       finds the closest extremity left of a point,
+ *                              the rings of cells around it are searched until
+ *                              the next one is farther than the closest
+ *                              extremity found
+ * @return                      closest extremity (index in edges), there must
+ *                              be one left
+ */
+static uint16_t grid_nearest(const edge_pos* edges, cartesian_coord from)
+{
+	int32_t col = grid_cell_coord(from.x, grid.min.x, grid.cols);
+	int32_t row = grid_cell_coord(from.y, grid.min.y, grid.rows);
+	uint32_t best = UINT32_MAX;
+	uint16_t best_key = UINT16_MAX;
+	uint16_t closest = 0;
+
+	for (int32_t r = 0; ; ++r) {
+		// the cells of ring r are at least (r-1) cells away from the point
+		uint32_t gap = r > 0 ? (uint32_t)(r - 1)*grid.cell_px : 0;
+		if (best < gap*gap)
+			break;
+		if (col - r < 0 && col + r >= grid.cols && row - r < 0 && row + r >= grid.rows)
+			break;
+		for (int32_t y = row - r; y <= row + r; ++y) {
+			if (y < 0 || y >= grid.rows)
+				continue;
+			// whole top and bottom rows of the ring, both ends of the others
+			int32_t step = (y == row - r || y == row + r) ? 1 : 2*r;
+			for (int32_t x = col - r; x <= col + r; x += step) {
+				if (x >= 0 && x < grid.cols)
+					closest = grid_search_cell(edges, x + (uint32_t)y*grid.cols, from,
+					                           closest, &best, &best_key);
+			}
+		}
+	}
+	return closest;
+}
+
+/**
+ * @brief                       allocates the grid of the extremities and
+ *                              fills it
+ * @return                      false if it does not fit in the arena
+ */
+static bool grid_build(const edge_pos* edges, uint16_t size_edges)
+{
+	cartesian_coord max = edges[0].pos;
+	grid.min = edges[0].pos;
+	for (uint16_t i = 1; i < size_edges; ++i) {
+		if (edges[i].pos.x < grid.min.x)
+			grid.min.x = edges[i].pos.x;
+		if (edges[i].pos.y < grid.min.y)
+			grid.min.y = edges[i].pos.y;
+		if (edges[i].pos.x > max.x)
+			max.x = edges[i].pos.x;
+		if (edges[i].pos.y > max.y)
+			max.y = edges[i].pos.y;
+	}
+	uint32_t length = max.x - grid.min.x + 1;
+	uint32_t height = max.y - grid.min.y + 1;
+
+	// smallest cells holding GRID_EXTREMITIES_PER_CELL extremities on average
+	uint32_t nb_cells_max = (size_edges + GRID_EXTREMITIES_PER_CELL - 1)
+	                        / GRID_EXTREMITIES_PER_CELL;
+	grid.cell_px = 1;
+	while ((uint32_t)grid.cell_px*grid.cell_px*nb_cells_max < length*height)
+		++grid.cell_px;
+	grid.cols = (length + grid.cell_px - 1)/grid.cell_px;
+	grid.rows = (height + grid.cell_px - 1)/grid.cell_px;
+	uint32_t nb_cells = (uint32_t)grid.cols*grid.rows;
+
+	uint16_t* block = arena_malloc((2*nb_cells + 1 + 3*(uint32_t)size_edges)
+	                               *sizeof(uint16_t));
+	if (block == NULL)
+		return false;
+	grid.first = block;
+	grid.live = grid.first + nb_cells + 1;
+	grid.entries = grid.live + nb_cells;
+	grid.where = grid.entries + size_edges;
+	grid.slot = grid.where + size_edges;
+	grid.at = grid.slot + size_edges/2;
+
+	// counting sort of the extremities by cell
+	for (uint32_t c = 0; c < nb_cells; ++c)
+		grid.live[c] = 0;
+	for (uint16_t i = 0; i < size_edges; ++i)
+		++grid.live[grid_cell(edges[i].pos)];
+	grid.first[0] = 0;
+	for (uint32_t c = 0; c < nb_cells; ++c) {
+		grid.first[c+1] = grid.first[c] + grid.live[c];
+		grid.live[c] = 0;
+	}
+	for (uint16_t i = 0; i < size_edges; ++i) {
+		uint32_t cell = grid_cell(edges[i].pos);
+		uint16_t entry = grid.first[cell] + grid.live[cell]++;
+		grid.entries[entry] = i;
+		grid.where[i] = entry;
+	}
+
+	for (uint16_t p = 0; p < size_edges/2; ++p)
+		grid.slot[p] = grid.at[p] = p;
+	return true;
+}
+
+/**
+ * @brief                       first and last extremities drawn of the
+ *                              contour at a position
+ */
+static inline cartesian_coord entry_pos(const edge_pos* edges, uint16_t k)
+{
+	return edges[2*k].pos;
+}
+
+static inline cartesian_coord exit_pos(const edge_pos* edges, uint16_t k)
+{
+	return edges[2*k+1].pos;
+}
+
+/**
+ * @brief                       position of the pen before the contour at a
+ *                              position is drawn
+ */
+static inline cartesian_coord pen_pos(const edge_pos* edges, uint16_t k,
+                                      cartesian_coord from)
+{
+	return k > 0 ? exit_pos(edges, k-1) : from;
+}
+
+/**
+ * @brief                       extremity drawn after the contour at position
+ *                              k-1: the first one of the contour at position k
+ *                              or, after the last contour, search_to
+ * @return                      false if there is none
+ */
+static inline bool next_pos(const edge_pos* edges, uint16_t k, uint16_t nb_contours,
+                            cartesian_coord* pos)
+{
+	if (k < nb_contours)
+		*pos = entry_pos(edges, k);
+	else if (search_to != NULL)
+		*pos = *search_to;
+	else
+		return false;
+	return true;
+}
+
+/**
+ * @brief                       reverses the drawing of the contour at a
+ *                              position
+ */
+static void flip_contour(edge_pos* edges, uint8_t* status, uint16_t k)
+{
+	edge_pos temp = edges[2*k];
+	edges[2*k] = edges[2*k+1];
+	edges[2*k+1] = temp;
+	status[2*k] = status[2*k] == start ? end : start;
+}
+
+/**
+ * @brief                       reverses the contours at positions first to
+ *                              last: their order and the drawing of each one
+ */
+static void reverse_contours(edge_pos* edges, uint8_t* status, uint16_t first,
+                             uint16_t last)
+{
+	for (uint16_t i = first, j = last; i < j; ++i, --j) {
+		for (uint8_t e = 0; e < 2; ++e) {
+			edge_pos temp = edges[2*i+e];
+			edges[2*i+e] = edges[2*j+e];
+			edges[2*j+e] = temp;
+		}
+		uint8_t temp = status[2*i];
+		status[2*i] = status[2*j];
+		status[2*j] = temp;
+	}
+	for (uint16_t k = first; k <= last; ++k)
+		flip_contour(edges, status, k);
+}
+
+/**
+ * @brief                       travel saved by a 2-opt move: the contours at
+ *                              positions first to last are reversed
+ * @return                      gain in pixels (negative if the travel grows)
+ */
+static float two_opt_gain(const edge_pos* edges, uint16_t nb_contours,
+                          cartesian_coord from, uint16_t first, uint16_t last)
+{
+	cartesian_coord pen = pen_pos(edges, first, from);
+	float before = two_point_distance(pen, entry_pos(edges, first));
+	float after = two_point_distance(pen, exit_pos(edges, last));
+	cartesian_coord next;
+	if (next_pos(edges, last+1, nb_contours, &next)) {
+		before += two_point_distance(exit_pos(edges, last), next);
+		after += two_point_distance(entry_pos(edges, first), next);
+	}
+	return before - after;
+}
+
+/**
+ * @brief                       travel saved by an Or-opt move: the contours at
+ *                              positions first to last are drawn after the
+ *                              contour at position to (to > last), or before
+ *                              it (to < first)
+ * @param[in]   reversed        the moved contours are reversed
+ * @return                      gain in pixels (negative if the travel grows)
+ */
+static float or_opt_gain(const edge_pos* edges, uint16_t nb_contours, cartesian_coord from,
+                         uint16_t first, uint16_t last, uint16_t to, bool reversed)
+{
+	cartesian_coord head = reversed ? exit_pos(edges, last) : entry_pos(edges, first);
+	cartesian_coord tail = reversed ? entry_pos(edges, first) : exit_pos(edges, last);
+	float before;
+	float after;
+	if (to > last) {
+		cartesian_coord pen = pen_pos(edges, first, from);
+		before = two_point_distance(pen, entry_pos(edges, first))
+		         + two_point_distance(exit_pos(edges, last), entry_pos(edges, last+1));
+		after = two_point_distance(pen, entry_pos(edges, last+1))
+		        + two_point_distance(exit_pos(edges, to), head);
+		cartesian_coord next;
+		if (next_pos(edges, to+1, nb_contours, &next)) {
+			before += two_point_distance(exit_pos(edges, to), next);
+			after += two_point_distance(tail, next);
+		}
+	} else {
+		cartesian_coord pen = pen_pos(edges, to, from);
+		before = two_point_distance(pen, entry_pos(edges, to))
+		         + two_point_distance(exit_pos(edges, first-1), entry_pos(edges, first));
+		after = two_point_distance(pen, head) + two_point_distance(tail, entry_pos(edges, to));
+		cartesian_coord next;
+		if (next_pos(edges, last+1, nb_contours, &next)) {
+			before += two_point_distance(exit_pos(edges, last), next);
+			after += two_point_distance(exit_pos(edges, first-1), next);
+		}
+	}
+	return before - after;
+}
+
+/**
+ * @brief                       makes an Or-opt move (see or_opt_gain()) with
+ *                              two or three reversals
+ */
+static void or_opt_move(edge_pos* edges, uint8_t* status, uint16_t first,
+                        uint16_t last, uint16_t to, bool reversed)
+{
+	uint16_t length = last - first + 1;
+	if (to > last) {
+		reverse_contours(edges, status, first, to);
+		reverse_contours(edges, status, first, first + to - last - 1);
+		if (!reversed)
+			reverse_contours(edges, status, to - length + 1, to);
+	} else {
+		reverse_contours(edges, status, to, last);
+		reverse_contours(edges, status, to + length, last);
+		if (!reversed)
+			reverse_contours(edges, status, to, to + length - 1);
+	}
+}
+
+/**
+ * @brief                       makes the first Or-opt move of the contours
+ *                              from position first on that shortens the travel
+ * @return                      true if a move was made
+ */
+static bool or_opt_first(edge_pos* edges, uint8_t* status, uint16_t nb_contours,
+                         cartesian_coord from, uint16_t first)
+{
+	for (uint16_t last = first; last < nb_contours && last - first < OR_OPT_MAX_CONTOURS;
+	     ++last) {
+		for (uint16_t to = 0; to < nb_contours; ++to) {
+			if (to >= first && to <= last)
+				continue;
+			for (uint8_t r = 0; r < 2; ++r) {
+				if (or_opt_gain(edges, nb_contours, from, first, last, to, r) > MIN_GAIN_PX) {
+					or_opt_move(edges, status, first, last, to, r);
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+bool path_order_nearest(edge_pos* edges, uint8_t* status, uint16_t size_edges,
+                        cartesian_coord from)
+{
+	if (size_edges < 2)
+		return true;
+	if (!grid_build(edges, size_edges))
+		return false;
+
+	uint16_t nb_contours = size_edges/2;
+	for (uint16_t k = 0; k < nb_contours; ++k) {
+		uint16_t extremity = grid_nearest(edges, from);
+		grid_remove(edges, extremity);
+		grid_remove(edges, extremity^1);
+
+		// the contour at position k takes the place of the one drawn
+		uint16_t contour = extremity/2;
+		uint16_t moved = grid.at[k];
+		grid.at[grid.slot[contour]] = moved;
+		grid.slot[moved] = grid.slot[contour];
+		grid.at[k] = contour;
+		grid.slot[contour] = k;
+
+		status[2*k] = extremity%2 ? end : start;
+		from = edges[extremity^1].pos;
+	}
+
+	// moves each contour to its position (cycles of the permutation), the
+	// drawn extremity first
+	for (uint16_t p = 0; p < nb_contours; ++p) {
+		while (grid.slot[p] != p) {
+			uint16_t s = grid.slot[p];
+			for (uint8_t i = 0; i < 2; ++i) {
+				edge_pos temp = edges[2*p+i];
+				edges[2*p+i] = edges[2*s+i];
+				edges[2*s+i] = temp;
+			}
+			grid.slot[p] = grid.slot[s];
+			grid.slot[s] = s;
+		}
+	}
+	for (uint16_t k = 0; k < nb_contours; ++k) {
+		if (status[2*k] == end) {
+			edge_pos temp = edges[2*k];
+			edges[2*k] = edges[2*k+1];
+			edges[2*k+1] = temp;
+		}
+	}
+
+	arena_free(grid.first);
+	return true;
+}
+
+void path_order_nearest_scan(edge_pos* edges, uint8_t* status, uint16_t size_edges,
+                             cartesian_coord from)
+{
+	uint16_t min_index = 0;
+	float min_distance = FLT_MAX;
+	float distance = 0;
+
+	// first find edge pair closest to initial robot position
+	bool first_pos = true;
+	for (uint16_t start_index = 0; start_index < size_edges-1; start_index+=2) {
+		min_distance = FLT_MAX;
+		for (uint16_t i = start_index; i < size_edges; ++i) {
+			// search for index with smallest distance
+			if (first_pos)
+				distance = two_point_distance(edges[i].pos, from);
+			else
+				distance = two_point_distance(edges[i].pos, edges[start_index-1].pos);
+			if (distance < min_distance) {
+				min_distance = distance;
+				min_index = i;
+			}
+		}
+		struct edge_pos edge_start_temp;
+		struct edge_pos edge_end_temp;
+		// if min_index is even, smaller index is at min_index
+		if (min_index%2 == 0) {
+			edge_start_temp = edges[min_index];
+			edge_end_temp = edges[min_index+1];
+			edges[min_index] = edges[start_index];
+			edges[min_index+1] = edges[start_index+1];
+			edges[start_index] = edge_start_temp;
+			edges[start_index+1] = edge_end_temp;
+			status[start_index] = start;
+
+		// if index is odd, smaller index is at min_index-1
+		} else {
+			edge_start_temp = edges[min_index];
+			edge_end_temp = edges[min_index-1];
+			edges[min_index-1] = edges[start_index];
+			edges[min_index] = edges[start_index+1];
+			edges[start_index] = edge_start_temp;
+			edges[start_index+1] = edge_end_temp;
+			status[start_index] = end;
+		}
+		// once first index is found, repeat for other edge pairs
+		first_pos = false;
+	}
+}
+
+uint16_t path_order_improve(edge_pos* edges, uint8_t* status, uint16_t size_edges,
+                            cartesian_coord from, const cartesian_coord* to,
+                            pipeline_clock clock, uint32_t budget_ms)
+{
+	uint16_t nb_contours = size_edges/2;
+	search_to = to;
+	uint32_t start_ms = clock != NULL ? clock() : 0;
+	uint16_t moves = 0;
+	bool improved = true;
+	while (improved) {
+		improved = false;
+		for (uint16_t first = 0; first < nb_contours; ++first) {
+			if (clock != NULL && clock() - start_ms >= budget_ms)
+				return moves;
+			for (uint16_t last = first; last < nb_contours; ++last) {
+				if (two_opt_gain(edges, nb_contours, from, first, last) > MIN_GAIN_PX) {
+					reverse_contours(edges, status, first, last);
+					++moves;
+					improved = true;
+				}
+			}
+			if (or_opt_first(edges, status, nb_contours, from, first)) {
+				++moves;
+				improved = true;
+			}
+		}
+	}
+	return moves;
+}
+
+float path_order_travel(const edge_pos* edges, uint16_t size_edges, cartesian_coord from)
+{
+	float travel = 0;
+	for (uint16_t k = 0; k < size_edges/2; ++k)
+		travel += two_point_distance(pen_pos(edges, k, from), entry_pos(edges, k));
+	return travel;
+}
@@ -0,0 +1,1865 @@
+/**
+ * @file    planner.c
+ * @brief   Turns an edge image into an ordered, colored path.
+ * @details The edges are first thinned to one pixel wide strokes (Zhang-Suen
+ *          thinning, the deletion conditions are read in a table indexed by
+ *          the 8 neighbours of a pixel), so that a thick edge is not drawn
+ *          twice side by side.
+ *
+ *          Each contour is traced up to an extremity and walked back to the
+ *          other one, the moves of the second walk are stored as chain codes,
+ *          two per byte, with a record per contour at the end of the same
+ *          block. The pruning, coloring, simplification and ordering walk the
+ *          codes, the kept points are only decoded when the path is written.
+ *          In a tiled capture, a contour stitched across the tiles is a run
+ *          of records linked by a flag.
+ *
+ *          The contours shorter than the minimum stroke are pruned, unless
+ *          they bridge two longer strokes or end on a tile seam. The others
+ *          are ordered by path_order.c, grouped by color: a drawing time
+ *          model (moves at the drawing speed, a pen cycle per contour and the
+ *          turns of the carousel of the pens) chooses the order of the groups
+ *          and whether the grouped order is drawn at all.
+ * @note    This module does not depend on ChibiOS, it is shared by the
+ *          e-puck firmware and the host benchmark harness.
+ */
+
+
+/** ---------------------------------------------------------------------------
+*
+* Main buffer structure:
+*
+* -----------------------------------------------------------------------------
+*
+* store:
+* size: store.nb_chains contours, store.nb_codes chain codes
+* contains the contours, each of them as its first extremity, its color and
+* the chain codes of the moves from a pixel to the next one (two codes per
+* byte, in store.codes). The records of the contours (store.chains) follow the
+* codes in the same block. A code also tells if the point it reaches is kept
+* by the optimization.
+*
+* -----------------------------------------------------------------------------
+*
+* edges:
+* size: size_edges
+* contains positions of extremities.
+* Ordered by pairs, i.e. edges[0] goes with edges[1] and so on.
+* note: Index is the contour of the extremity in the store (the first contour
+* of a run of stitched contours).
+*
+* -----------------------------------------------------------------------------
+*
+* final_path:
+* size: total_size
+* contains the final positions that the robot has to follow.
+* note: final_path[0] contains initial robot position
+*
+* -----------------------------------------------------------------------------
+*
+* color:
+* size: total_size
+* contains the color associated to each pixel in final_path.
+*
+* -----------------------------------------------------------------------------
+*
+* status:
+* size: size_edges
+* contains edge status (start, end).
+* note: it is separated from the edge_pos structure to avoid padding.
+*
+* -----------------------------------------------------------------------------
+*
+* mosaic:
+* size: mosaic.nb_chains contours, mosaic.nb_codes chain codes
+* same as store, for all the tiles added to the mosaic, in mosaic
+* coordinates. Its contours are stitched into store and edges once the last
+* tile is added. It is the block at the high end of the arena, which outlives
+* the tiles.
+*
+* -----------------------------------------------------------------------------
+*/
+
+// C standard header files
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+// Module headers
+
+#include <planner.h>
+#include <canny.h>
+#include <edge_map.h>
+#include <arena.h>
+#include <path_order.h>
+#include <mod_draw.h>
+#include <mod_data.h>
+#include <tools.h>
+#include <mod_img_processing.h>
+#include <def_epuck_field.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+// initial robot position: middle of the top border of the image
+#define INIT_ROBPOS_PY     0
+
+// contour end that is not stitched to another contour
+#define NO_LINK            UINT16_MAX
+
+// neighbours tested by the contour tracing, the moves between two of them are
+// chain codes (Freeman codes: 0 right, counterclockwise, y pointing down)
+#define NB_DIRECTIONS      8
+#define NO_DIRECTION       NB_DIRECTIONS
+
+// chain codes of the contour store: the direction of the move and a flag set
+// while the optimization keeps the point it reaches, two codes per byte (the
+// first one in the low bits)
+#define CODE_BITS          4
+#define CODE_MASK          0xF
+#define CODE_DIRECTION     0x7
+#define CODE_KEEP          0x8
+#define CODES_PER_BYTE     2
+
+// links of a contour of the store to the following ones, a run of stitched
+// mosaic contours is ordered and drawn as one contour
+#define CHAIN_JOINED       0x01     // the next contour continues this one
+#define CHAIN_CLOSED       0x02     // the run comes back to its first point
+
+// strokes shorter than this (image pixels) are pruned unless both of their
+// ends touch a longer stroke, can be changed from the computer
+#define DEFAULT_MIN_STROKE_PX 3
+
+// Draw time model of the pruning and ordering reports: a contour costs a pen
+// up and a pen down (the servo and the pen stepper of the arduino wait 500 ms
+// each), its strokes and the pen up moves are drawn at the speed of the
+// motors (MAX_SPEED of mod_draw.c)
+#define PEN_CYCLE_MS       1500
+#define DRAW_SPEED_ST      250      // steps/s
+
+// Carousel of the pens (arduino/src/main.cpp): a change of color turns it by
+// the steps between the positions of the pens (STEPPER_POSITION_0..3) at 5
+// rpm of a 2048 steps/rev stepper. It starts on the black pen and comes back
+// to it once the drawing is done.
+#define CAROUSEL_SPEED_ST  170      // steps/s
+#define NB_PEN_COLORS      4        // black, red, green and blue
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+// Tracing state of the pixels, one bit plane per state
+typedef struct trace_maps {
+	edge_map* max;         // active pixels not visited yet
+	edge_map* visited;
+	edge_map* rewind;
+	edge_map* begin;
+	uint8_t* columns;      // pixels of max in each column
+} trace_maps;
+
+typedef struct trace_direction {
+	uint16_t window;       // neighbour in a 3x3 window (WINDOW_*)
+	int16_t offset;        // bit offset in an edge map
+	int8_t dx;
+	int8_t dy;
+} trace_direction;
+
+// A contour of the store: its first extremity and the chain codes of the
+// moves to its next pixels
+typedef struct contour_chain {
+	cartesian_coord pos;   // first extremity
+	uint16_t code;         // first chain code in the store
+	uint16_t nb_codes;     // 0 for an isolated pixel
+	uint8_t color;
+	uint8_t links;         // CHAIN_* flags
+} contour_chain;
+
+// Contours of an image (or of a mosaic), one block holding the chain codes
+// followed by the contours
+typedef struct contour_store {
+	uint8_t* codes;        // the block
+	contour_chain* chains;
+	uint16_t nb_chains;
+	uint16_t nb_codes;
+	size_t capacity;       // bytes of the block
+} contour_store;
+
+// Subcontour waiting for its optimization, it ends where the next one starts
+typedef struct subcontour {
+	uint16_t start;        // index of its first point
+	cartesian_coord start_pos;
+} subcontour;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static edge_pos* edges;
+static contour_store store;
+
+static uint8_t* status;
+
+// size of the traced image, a single frame or the mosaic of the tiles
+static uint16_t plan_length_px = IM_LENGTH_PX;
+static uint16_t plan_height_px = IM_HEIGHT_PX;
+
+// moves of each chain code
+static const trace_direction chain_directions[NB_DIRECTIONS] = {
+	{WINDOW_RIGHT, 1, 1, 0},
+	{WINDOW_TOP_RIGHT, 1 - EDGE_MAP_ROW_BITS, 1, -1},
+	{WINDOW_TOP, -EDGE_MAP_ROW_BITS, 0, -1},
+	{WINDOW_TOP_LEFT, -1 - EDGE_MAP_ROW_BITS, -1, -1},
+	{WINDOW_LEFT, -1, -1, 0},
+	{WINDOW_BOTTOM_LEFT, -1 + EDGE_MAP_ROW_BITS, -1, 1},
+	{WINDOW_BOTTOM, EDGE_MAP_ROW_BITS, 0, 1},
+	{WINDOW_BOTTOM_RIGHT, 1 + EDGE_MAP_ROW_BITS, 1, 1}
+};
+
+// order in which the neighbours of a pixel are followed: right, left, bottom,
+// top, bottom right, bottom left, top right and top left
+static const uint8_t trace_order[NB_DIRECTIONS] = {0, 4, 6, 2, 7, 5, 1, 3};
+
+// stepper position of the pen of each color, from black to blue
+static const uint16_t carousel_steps[NB_PEN_COLORS] = {30, 187, 330, 487};
+
+// orders of n groups of contours, n = 0 to NB_PEN_COLORS
+static const uint8_t factorials[NB_PEN_COLORS + 1] = {1, 1, 2, 6, 24};
+
+// the edges are thinned to one pixel before the tracing
+static bool thinning = true;
+
+static uint8_t min_stroke_px = DEFAULT_MIN_STROKE_PX;
+static planner_pruning pruning;
+static planner_tracing tracing;
+
+// tolerances of the contour simplification
+static float max_perp_dist = MAX_PERP_DIST;
+static uint8_t max_pixel_dist = MAX_PIXEL_DIST;
+
+static contour_store mosaic = {0};
+
+// improvement of the order of the contours
+static uint16_t order_budget_ms = ORDER_BUDGET_MS;
+static pipeline_clock order_clock = NULL;
+static planner_ordering ordering;
+static bool color_grouping = true;
+
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                       returns the initial robot position in the
+ *                              traced image
+ * @return                      initial position in px
+ */
+static cartesian_coord initial_position(void)
+{
+	cartesian_coord init_pos;
+	init_pos.x = plan_length_px/2;
+	init_pos.y = INIT_ROBPOS_PY;
+	return init_pos;
+}
+
+/**
+ * @brief                       returns the direction followed from a pixel to
+ *                              one of its neighbours: the first one of the
+ *                              tracing order in a window
+ * @param[in]   window          candidate neighbours (WINDOW_* bits)
+ * @return                      chain code, NO_DIRECTION if there is no
+ *                              candidate
+ * @note                        The loop tests the window against the masks
+ *                              of chain_directions in the tracing order and
+ *                              stops at the first candidate: the directions
+ *                              early in trace_order cost the fewest tests.
+ */
+static inline uint8_t next_direction(uint16_t window)
+{
+	for (uint8_t i = 0; i < NB_DIRECTIONS; ++i) {
+		if (window & chain_directions[trace_order[i]].window)
+			return trace_order[i];
+	}
+	return NO_DIRECTION;
+}
+
+/**
+ * @brief                       reads a chain code of a store
+ * @param[in]   codes           chain codes of the store
+ * @param[in]   index           code index
+ * @return                      code (CODE_DIRECTION and CODE_KEEP bits)
+ */
+static inline uint8_t chain_code(const uint8_t* codes, uint16_t index)
+{
+	return (codes[index/CODES_PER_BYTE] >> (index % CODES_PER_BYTE)*CODE_BITS) & CODE_MASK;
+}
+
+/**
+ * @brief                       writes a chain code of a store
+ * @param[in,out] codes         chain codes of the store
+ * @param[in]   index           code index
+ * @param[in]   code            code (CODE_DIRECTION and CODE_KEEP bits)
+ */
+static inline void set_chain_code(uint8_t* codes, uint16_t index, uint8_t code)
+{
+	uint8_t shift = (index % CODES_PER_BYTE)*CODE_BITS;
+	uint8_t* byte = &codes[index/CODES_PER_BYTE];
+	*byte = (*byte & ~(CODE_MASK << shift)) | code << shift;
+}
+
+/**
+ * @brief                       moves a position along a chain code
+ * @param[in,out] pos           position
+ * @param[in]   code            chain code
+ * @param[in]   sign            1 to follow the move, -1 to undo it
+ */
+static inline void chain_move(cartesian_coord* pos, uint8_t code, int8_t sign)
+{
+	const trace_direction* move = &chain_directions[code & CODE_DIRECTION];
+	pos->x += sign*move->dx;
+	pos->y += sign*move->dy;
+}
+
+/**
+ * @brief                       returns the last extremity of a contour
+ * @param[in]   from            store of the contour
+ * @param[in]   chain           contour
+ * @return                      position of its last pixel
+ */
+static cartesian_coord chain_end(const contour_store* from, const contour_chain* chain)
+{
+	cartesian_coord pos = chain->pos;
+	for (uint16_t i = 0; i < chain->nb_codes; ++i)
+		chain_move(&pos, chain_code(from->codes, chain->code + i), 1);
+	return pos;
+}
+
+/**
+ * @brief                       tells if the optimization keeps a point of a
+ *                              contour of the store
+ * @param[in]   chain           contour
+ * @param[in]   point           point index, 0 for its first extremity
+ */
+static inline bool point_kept(const contour_chain* chain, uint16_t point)
+{
+	return point == 0 || (chain_code(store.codes, chain->code + point - 1) & CODE_KEEP);
+}
+
+/**
+ * @brief                       keeps or removes a point of a contour of the
+ *                              store, its first extremity is always kept
+ * @param[in]   chain           contour
+ * @param[in]   point           point index
+ * @param[in]   keep            true to keep the point
+ */
+static inline void keep_point(const contour_chain* chain, uint16_t point, bool keep)
+{
+	if (point == 0)
+		return;
+	uint16_t index = chain->code + point - 1;
+	uint8_t code = chain_code(store.codes, index) & CODE_DIRECTION;
+	set_chain_code(store.codes, index, keep ? code | CODE_KEEP : code);
+}
+
+/**
+ * @brief                       offset of the contours in the block of a store
+ * @param[in]   nb_codes        chain codes of the store
+ * @return                      bytes of the codes, rounded up to the alignment
+ *                              of the contours
+ */
+static inline size_t chains_offset(uint16_t nb_codes)
+{
+	size_t bytes = (nb_codes + CODES_PER_BYTE - 1)/CODES_PER_BYTE;
+	return bytes + bytes % sizeof(uint16_t);
+}
+
+/**
+ * @brief                       tells if the store being traced has room for
+ *                              more contours and codes
+ */
+static inline bool store_fits(uint16_t chains, uint16_t codes)
+{
+	return chains_offset(store.nb_codes + codes)
+	       + (store.nb_chains + chains)*sizeof(contour_chain) <= store.capacity;
+}
+
+/**
+ * @brief                       grows the store being traced by half, its
+ *                              contours are kept at the end of the block
+ * @return                      false if the arena budget is exceeded
+ */
+static bool store_grow(void)
+{
+	size_t chains_bytes = store.nb_chains*sizeof(contour_chain);
+	size_t capacity = store.capacity + store.capacity/2 + sizeof(contour_chain);
+	capacity += capacity % sizeof(uint16_t);
+	uint8_t* block = arena_realloc(store.codes, capacity);
+	if (block == NULL)
+		return false;
+	memmove(block + capacity - chains_bytes, block + store.capacity - chains_bytes,
+	        chains_bytes);
+	store.codes = block;
+	store.capacity = capacity;
+	return true;
+}
+
+/**
+ * @brief                       moves the contours of the store right after its
+ *                              codes and shrinks the block to fit them
+ * @return                      none
+ * @note                        The store must hold a contour at least.
+ */
+static void store_shrink(void)
+{
+	size_t offset = chains_offset(store.nb_codes);
+	memmove(store.codes + offset, store.chains, store.nb_chains*sizeof(contour_chain));
+	store.capacity = offset + store.nb_chains*sizeof(contour_chain);
+	store.codes = arena_realloc(store.codes, store.capacity);
+	store.chains = (contour_chain*)(store.codes + offset);
+}
+
+/**
+ * @brief                       moves a pixel from a tracing state to another
+ * @param[in]   from, to        bit planes of the states (trace_maps)
+ * @param[in]   bit             pixel bit in the edge maps
+ */
+static inline void move_pixel(edge_map* from, edge_map* to, uint16_t bit)
+{
+	edge_map_reset(from, bit);
+	edge_map_set(to, bit);
+}
+
+/**
+ * @brief                       moves an active pixel (max) to another
+ *                              tracing state
+ * @param[in]   to              bit plane of the new state
+ * @param[in]   bit             pixel bit in the edge maps
+ * @param[in]   x               pixel column
+ */
+static inline void take_pixel(trace_maps* maps, edge_map* to, uint16_t bit, img_coord x)
+{
+	move_pixel(maps->max, to, bit);
+	--maps->columns[x];
+}
+
+/**
+ * @brief                       traces the contours of an edge image into the
+ *                              store
+ * @param[in]   img_edges       edge image, modified (the traced pixels are
+ *                              removed)
+ * @param[in]   area            bounding box of the edges, contours start
+ *                              from its pixels
+ * @param[in]   capacity        first guess of the bytes of the store
+ * @param[out]  nb_points       number of points of the contours, an isolated
+ *                              pixel counts twice (both of its extremities)
+ * @return                      false if the arena budget is exceeded (nothing
+ *                              is traced, the store is not allocated)
+ * @note                        The state of a pixel is kept in bit planes:
+ *                              max (active pixel not visited yet), visited,
+ *                              rewind and begin.
+ *                              From a pixel, the contour moves on to the
+ *                              first neighbour in the order right, left,
+ *                              bottom, top, bottom right, bottom left, top
+ *                              right and top left, the 3x3 window of a plane
+ *                              is read once per step (next_direction()). The
+ *                              columns without active pixel left are
+ *                              skipped by the search for the next contour.
+ *                              A contour is first followed up to an
+ *                              extremity, then traced back from it to the
+ *                              other extremity, and only the moves of the
+ *                              second walk are written. The contours are
+ *                              written at the end of the block of the store
+ *                              while it grows, then after its codes.
+ */
+static bool path_tracing(edge_map* img_edges, edge_component area, size_t capacity,
+                         uint16_t* nb_points)
+{
+	capacity += capacity % sizeof(uint16_t);
+	store = (contour_store){arena_malloc(capacity), NULL, 0, 0, capacity};
+	trace_maps maps = {img_edges, arena_calloc(1, sizeof(edge_map)),
+	                   arena_calloc(1, sizeof(edge_map)), arena_calloc(1, sizeof(edge_map)),
+	                   arena_calloc(IM_LENGTH_PX, sizeof(uint8_t))};
+
+	// arena budget exceeded: nothing is traced
+	if (store.codes == NULL || maps.visited == NULL || maps.rewind == NULL
+	    || maps.begin == NULL || maps.columns == NULL) {
+		arena_free(maps.columns);
+		arena_free(maps.begin);
+		arena_free(maps.rewind);
+		arena_free(maps.visited);
+		arena_free(store.codes);
+		return false;
+	}
+
+	// the columns left without active pixel by the contours traced are skipped
+	for (img_coord y = 0; y < IM_HEIGHT_PX; ++y) {
+		img_coord start, end;
+		for (img_coord x = 0; (start = edge_map_next_run(maps.max, y, x, &end))
+		     < IM_LENGTH_PX; x = end) {
+			for (img_coord i = start; i < end; ++i)
+				++maps.columns[i];
+		}
+	}
+
+	bool fits = true;
+	*nb_points = 0;
+	for (img_coord x = area.x_min; x <= area.x_max && fits; ++x) {
+		for (img_coord y = area.y_min; y <= area.y_max && maps.columns[x] > 0; ++y) {
+			uint16_t pos = edge_map_bit(x, y);
+			if (!edge_map_test(maps.max, pos))
+				continue;
+
+			// Start from a pixel and move until extremity is found
+			img_coord x_temp = x;
+			img_coord y_temp = y;
+			take_pixel(&maps, maps.visited, pos, x_temp);
+			bool has_converged = false;
+			for (;;) {
+				// First check pixels with max intensity (not visited yet)
+				uint8_t dir = next_direction(edge_map_window(maps.max, pos));
+				edge_map* from = maps.max;
+
+				// Here we allow the robot to come back ONCE on a pixel that
+				// has been marked as "rewind"
+				if (dir == NO_DIRECTION && !has_converged) {
+					dir = next_direction(edge_map_window(maps.rewind, pos));
+					from = maps.rewind;
+					has_converged = dir != NO_DIRECTION;
+				}
+				if (dir == NO_DIRECTION)
+					break;
+
+				pos += chain_directions[dir].offset;
+				x_temp += chain_directions[dir].dx;
+				y_temp += chain_directions[dir].dy;
+				++tracing.steps;
+				if (from == maps.max)
+					take_pixel(&maps, maps.visited, pos, x_temp);
+				else
+					move_pixel(maps.rewind, maps.visited, pos);
+			}
+
+			// Once extremity is found, rewind the path and find second extremity.
+
+			// this allows overlapping back on the starting position
+			// (e.g. closed curve)
+			move_pixel(maps.visited, maps.begin, pos);
+
+			// the record of the contour is written once it is traced
+			if (!store_fits(1, 0) && !store_grow()) {
+				fits = false;
+				break;
+			}
+			++store.nb_chains;
+			contour_chain chain = {{x_temp, y_temp}, store.nb_codes, 0, white, 0};
+
+			for (;;) {
+				// Check visited pixels first (to avoid rewinding the wrong pixels)
+				uint8_t dir = next_direction(edge_map_window(maps.visited, pos));
+				bool from_visited = dir != NO_DIRECTION;
+
+				// Then, check max pixels or starting position.
+
+				/** note: we don't want to connect back to starting position
+				  *       if line length is 2 px
+				  */
+				if (!from_visited) {
+					uint16_t next = edge_map_window(maps.max, pos);
+					if (chain.nb_codes != 1)
+						next |= edge_map_window(maps.begin, pos);
+					dir = next_direction(next);
+				}
+				if (dir == NO_DIRECTION) {
+					// an isolated pixel is still in the begin state
+					if (chain.nb_codes == 0)
+						move_pixel(maps.begin, maps.rewind, pos);
+					break;
+				}
+
+				if (!store_fits(0, 1) && !store_grow()) {
+					fits = false;
+					break;
+				}
+				set_chain_code(store.codes, store.nb_codes++, dir | CODE_KEEP);
+				++chain.nb_codes;
+				pos += chain_directions[dir].offset;
+				x_temp += chain_directions[dir].dx;
+				++tracing.steps;
+				if (from_visited)
+					move_pixel(maps.visited, maps.rewind, pos);
+				else if (edge_map_test(maps.max, pos))
+					take_pixel(&maps, maps.rewind, pos, x_temp);
+				else
+					move_pixel(maps.begin, maps.rewind, pos);
+			}
+
+			((contour_chain*)(store.codes + store.capacity))[-store.nb_chains] = chain;
+			// isolated points must be saved as 2 different edges
+			*nb_points += chain.nb_codes > 0 ? chain.nb_codes + 1 : 2;
+			if (!fits)
+				break;
+		}
+	}
+
+	arena_free(maps.visited);
+	arena_free(maps.rewind);
+	arena_free(maps.begin);
+	arena_free(maps.columns);
+
+	if (!fits) {
+		arena_free(store.codes);
+		return false;
+	}
+
+	// the contours were written from the end of the block, last one first
+	store.chains = (contour_chain*)(store.codes + store.capacity) - store.nb_chains;
+	for (uint16_t i = 0; i < store.nb_chains/2; ++i) {
+		contour_chain chain = store.chains[i];
+		store.chains[i] = store.chains[store.nb_chains - 1 - i];
+		store.chains[store.nb_chains - 1 - i] = chain;
+	}
+	// the tracing maps are reclaimed, the store is at the top of the arena
+	store_shrink();
+	return true;
+}
+
+/**
+ * @brief                       checks if a pixel is on the first or the last
+ *                              row or column kept from a tile
+ * @param[in]   pos             position of the pixel in the mosaic (or in its
+ *                              tile, the tiles are TILE_STEP_X, TILE_STEP_Y
+ *                              apart)
+ * @return                      true if a contour may cross a seam there
+ */
+static bool on_seam(cartesian_coord pos)
+{
+	uint16_t x = (pos.x + TILE_STEP_X - MARGIN_PX) % TILE_STEP_X;
+	uint16_t y = (pos.y + TILE_STEP_Y - MARGIN_PX) % TILE_STEP_Y;
+	return x == 0 || x == TILE_STEP_X - 1 || y == 0 || y == TILE_STEP_Y - 1;
+}
+
+/**
+ * @brief                       returns the ratio between the canvas and the
+ *                              traced image (the path is resized to fit the
+ *                              canvas)
+ * @return                      canvas pixels per image pixel
+ */
+static float canvas_scale(void)
+{
+	float scale_x = (float)IM_MAX_WIDTH/plan_length_px;
+	float scale_y = (float)IM_MAX_HEIGHT/plan_height_px;
+	return scale_x < scale_y ? scale_x : scale_y;
+}
+
+/**
+ * @brief                       length of the strokes of a traced contour
+ * @param[in]   chain           contour of the store
+ * @return                      length in pixels
+ */
+static float stroke_length(const contour_chain* chain)
+{
+	float length = 0;
+	for (uint16_t i = 0; i < chain->nb_codes; ++i)
+		length += chain_code(store.codes, chain->code + i) % 2 ? sqrtf(2) : 1;
+	return length;
+}
+
+/**
+ * @brief                       tells if a pixel touches a pixel of a map
+ *                              (8-connectivity, or is one of them)
+ */
+static inline bool touches_map(const edge_map* map, cartesian_coord pos)
+{
+	return edge_map_window(map, edge_map_bit(pos.x, pos.y)) != 0;
+}
+
+/**
+ * @brief                       removes the contours shorter than
+ *                              min_stroke_px: the spurs off longer strokes
+ *                              and the isolated strokes. A short contour whose
+ *                              two ends touch longer strokes links them and
+ *                              is kept.
+ * @param[in,out] size_edges    size (length) of edges buffer
+ * @param[in]   tile            true for the contours of a tile: those ending
+ *                              on a seam may continue in the next tile, they
+ *                              are kept
+ * @return                      none
+ * @note                        The contours are those of the tracing, edges
+ *                              holds their extremities in the order of the
+ *                              store. The store and edges are compacted in
+ *                              place and the removed contours are added to
+ *                              pruning.
+ */
+static void prune_contours(uint16_t* size_edges, bool tile)
+{
+	pruning.traced += *size_edges/2;
+	if (min_stroke_px == 0)
+		return;
+
+	edge_map* strokes = arena_calloc(1, sizeof(edge_map));
+	if (strokes == NULL)
+		return;
+
+	// pixels of the strokes kept in any case
+	for (uint16_t i = 0; i < store.nb_chains; ++i) {
+		const contour_chain* chain = &store.chains[i];
+		if (stroke_length(chain) < min_stroke_px)
+			continue;
+		cartesian_coord pos = chain->pos;
+		edge_map_set(strokes, edge_map_bit(pos.x, pos.y));
+		for (uint16_t j = 0; j < chain->nb_codes; ++j) {
+			chain_move(&pos, chain_code(store.codes, chain->code + j), 1);
+			edge_map_set(strokes, edge_map_bit(pos.x, pos.y));
+		}
+	}
+
+	float ms_per_px = canvas_scale()*CART_TO_ST*1000/DRAW_SPEED_ST;
+	uint16_t kept_chains = 0;
+	uint16_t kept_codes = 0;
+	for (uint16_t i = 0; i < *size_edges; i += 2) {
+		contour_chain chain = store.chains[edges[i].index];
+		float length = stroke_length(&chain);
+		bool linked = touches_map(strokes, edges[i].pos) && touches_map(strokes, edges[i+1].pos);
+		bool seam = tile && (on_seam(edges[i].pos) || on_seam(edges[i+1].pos));
+		if (length < min_stroke_px && !linked && !seam) {
+			++pruning.contours;
+			pruning.time_ms += PEN_CYCLE_MS + length*ms_per_px;
+			continue;
+		}
+
+		for (uint16_t j = 0; j < chain.nb_codes; ++j)
+			set_chain_code(store.codes, kept_codes + j,
+			               chain_code(store.codes, chain.code + j));
+		chain.code = kept_codes;
+		store.chains[kept_chains] = chain;
+		edges[2*kept_chains] = edges[i];
+		edges[2*kept_chains].index = kept_chains;
+		edges[2*kept_chains+1] = edges[i+1];
+		edges[2*kept_chains+1].index = kept_chains;
+		kept_codes += chain.nb_codes;
+		++kept_chains;
+	}
+	store.nb_chains = kept_chains;
+	store.nb_codes = kept_codes;
+	*size_edges = 2*kept_chains;
+
+	arena_free(strokes);
+}
+
+/**
+ * @brief                       determines the dominant color of each contour
+ *                              of the store
+ * @param[in]   color           pointer to buffer containing path color
+ * @return                      none
+ */
+static void set_contours_color(const uint8_t* color)
+{
+	for (uint16_t i = 0; i < store.nb_chains; ++i) {
+		contour_chain* chain = &store.chains[i];
+
+		// count number of corresponding color for each contour
+		uint16_t black_count = 0, red_count = 0, green_count = 0, blue_count = 0;
+		cartesian_coord pos = chain->pos;
+		for (uint16_t j = 0; j <= chain->nb_codes; ++j) {
+			if (j > 0)
+				chain_move(&pos, chain_code(store.codes, chain->code + j - 1), 1);
+
+			switch (color[position(pos.x, pos.y)]) {
+				case black:
+					++black_count;
+					break;
+				case red:
+					++red_count;
+					break;
+				case green:
+					++green_count;
+					break;
+				case blue:
+					++blue_count;
+					break;
+			}
+		}
+
+		if (red_count > fmax(fmax(green_count,blue_count),black_count)) {
+			chain->color = red;
+		} else if (green_count > fmax(fmax(blue_count,red_count), black_count)) {
+			chain->color = green;
+		} else if (blue_count > fmax(fmax(black_count,red_count), green_count)) {
+			chain->color = blue;
+		}	else chain->color = black;
+	}
+}
+
+/**
+ * @brief                       optimizes the path, i.e. deletes redundant points
+ *                              between two edges
+ * @param[in]   chain           contour of the store
+ * @param[in]   end             index of the last point optimized, the points
+ *                              are removed up to it by clearing the CODE_KEEP
+ *                              flag of their code
+ * @param[out]  pending         work buffer of end subcontours
+ * @return                      none
+ * @details                     if the maximum distance is superior to max_perp_dist,
+ *                              the contour is divided into 2 subcontours for which
+ *                              the start index and position are pushed in the
+ *                              pending buffer. If the maximum distance is equal to zero,
+ *                              this means that the subcontour is linear and we keep
+ *                              one out of max_pixel_dist pixel along the line.
+ *                              Finally if the maximum distance is inferior to zero,
+ *                              we cut all pixels between the start and the end.
+ *                              The pending subcontours follow each other, the
+ *                              last one pushed ends where the last one done
+ *                              starts. The points are decoded from the chain
+ *                              codes along each subcontour.
+ */
+static void contour_optimization(const contour_chain* chain, uint16_t end,
+                                 subcontour* pending)
+{
+	const uint8_t* codes = store.codes;
+	uint16_t first = chain->code;
+
+	cartesian_coord end_pos = chain->pos;
+	for (uint16_t i = 0; i < end; ++i)
+		chain_move(&end_pos, chain_code(codes, first + i), 1);
+
+	pending[0] = (subcontour){0, chain->pos};
+	uint16_t stack_count = 1;
+
+	float distance = 0;
+
+	while (stack_count > 0) {
+
+		--stack_count;
+		uint16_t start = pending[stack_count].start;
+		cartesian_coord start_pos = pending[stack_count].start_pos;
+
+		uint16_t index = start;
+		cartesian_coord index_pos = start_pos;
+		float dmax = 0;
+
+		cartesian_coord pos = start_pos;
+		for (uint16_t i = index+1; i < end; ++i) {
+			uint8_t code = chain_code(codes, first + i - 1);
+			chain_move(&pos, code, 1);
+			if (code & CODE_KEEP) {
+				distance = perpendicular_distance(start_pos, end_pos, pos);
+				if (distance > dmax) {
+					index = i;
+					index_pos = pos;
+					dmax = distance;
+				}
+			}
+		}
+
+		if (dmax >= max_perp_dist) {
+			pending[stack_count++] = (subcontour){start, start_pos};
+			pending[stack_count++] = (subcontour){index, index_pos};
+			continue;
+		} else if (dmax == 0) {
+			uint16_t k = 0;
+			for (uint16_t i = start + 1; i < end;++i) {
+				keep_point(chain, i, false);
+			}
+			while (k*max_pixel_dist + start + 1 < end ) {
+				keep_point(chain, start+k*max_pixel_dist, true);
+				++k;
+				}
+			if (!((k-1)*max_pixel_dist+start == end)) {
+				keep_point(chain, end, true);
+				++k;
+				}
+		} else {
+			for (uint16_t i = start + 1; i < end;++i) {
+				keep_point(chain, i, false);
+			}
+		}
+		end = start;
+		end_pos = start_pos;
+	}
+}
+
+/**
+ * @brief                           optimizes the contours of the store one by
+ *                                  one
+ * @return      opt_contours_size   number of points kept, i.e. of the path
+ *                                  drawing the contours
+ * @note                            The contours are kept whole if the arena
+ *                                  budget is exceeded.
+ */
+static uint16_t path_optimization(void)
+{
+	// the pending subcontours do not overlap, there are fewer than points
+	uint16_t max_codes = 0;
+	for (uint16_t i = 0; i < store.nb_chains; ++i) {
+		if (store.chains[i].nb_codes > max_codes)
+			max_codes = store.chains[i].nb_codes;
+	}
+	subcontour* pending = arena_malloc(max_codes*sizeof(subcontour));
+
+	uint16_t opt_contours_size = 0;
+	for (uint16_t i = 0; i < store.nb_chains; ++i) {
+		const contour_chain* chain = &store.chains[i];
+
+		// both extremities of a 2 points contour (or isolated pixel) are kept
+		if (chain->nb_codes <= 1) {
+			opt_contours_size += 2;
+			continue;
+		}
+
+		// the last point of a loop is its first one, it is kept
+		uint16_t end = chain->nb_codes;
+		cartesian_coord last = chain_end(&store, chain);
+		if (chain->pos.x == last.x && chain->pos.y == last.y)
+			--end;
+
+		if (pending != NULL)
+			contour_optimization(chain, end, pending);
+
+		for (uint16_t j = 0; j <= chain->nb_codes; ++j)
+			opt_contours_size += point_kept(chain, j);
+	}
+
+	arena_free(pending);
+	return opt_contours_size;
+}
+
+/**
+ * @brief                       appends the points of a contour of the store
+ *                              kept by the optimization to the path
+ * @param[in]   chain           contour
+ * @param[in]   reverse         true to draw it from its last extremity
+ * @param[out]  color           pointer to buffer containing path color
+ * @param[out]  final_path      pointer to buffer containing the coordinates of
+ *                              path to be drawn
+ * @param[in]   k               index of the first point appended
+ * @return                      index following the last point appended
+ * @note                        An isolated pixel is drawn as two points.
+ */
+static uint16_t append_points(const contour_chain* chain, bool reverse, uint8_t* color,
+                              cartesian_coord* final_path, uint16_t k)
+{
+	cartesian_coord pos = reverse ? chain_end(&store, chain) : chain->pos;
+	final_path[k] = pos;
+	color[k++] = chain->color;
+	for (uint16_t i = 1; i <= chain->nb_codes; ++i) {
+		// point reached by the move, in the order of the drawing
+		uint16_t point = reverse ? chain->nb_codes - i : i;
+		uint8_t code = chain_code(store.codes, chain->code + (reverse ? point : point - 1));
+		chain_move(&pos, code, reverse ? -1 : 1);
+		if (point_kept(chain, point)) {
+			final_path[k] = pos;
+			color[k++] = chain->color;
+		}
+	}
+	if (chain->nb_codes == 0) {
+		final_path[k] = pos;
+		color[k++] = chain->color;
+	}
+	return k;
+}
+
+
+/**
+ * @brief                       fills final_path and color buffers with optimized contour
+ *                              and its corresponding colors.
+ * @param[in]	size_edges      the size of the edges buffer
+ * @param[out] 	color           pointer to buffer containing path color
+ * @param[out]	final_path      pointer to buffer containing the coordinates of
+ *                              path to be drawn
+ * @return                      none
+ * @note                        Each pair of edges is a run of contours of the
+ *                              store (a single contour unless they are
+ *                              stitched), drawn from its first contour if its
+ *                              status is start, from its last one otherwise.
+ */
+static void create_final_path(uint8_t* color, uint16_t size_edges,
+                               cartesian_coord* final_path)
+{
+	final_path[0] = initial_position();
+	color[0] = white;
+	uint16_t k = 1;
+	for (uint16_t i = 0; i < size_edges; i+=2) {
+		uint16_t first = edges[i].index;
+		uint16_t last = first;
+		while (store.chains[last].links & CHAIN_JOINED)
+			++last;
+		bool closed = store.chains[last].links & CHAIN_CLOSED;
+
+		uint16_t run_start = k;
+		if (status[i] == start) {
+			for (uint16_t j = first; j <= last; ++j)
+				k = append_points(&store.chains[j], false, color, final_path, k);
+			if (closed) {
+				final_path[k] = store.chains[first].pos;
+				color[k++] = store.chains[first].color;
+			}
+		} else {
+			if (closed)
+				final_path[k++] = store.chains[first].pos;
+			// int32 because j is decremented to -1 for a first contour of 0
+			for (int32_t j = last; j >= first; --j)
+				k = append_points(&store.chains[j], true, color, final_path, k);
+		}
+		color[run_start] = white;
+	}
+}
+
+
+/**
+ * @brief                       resizes path buffer to fit into an image of size
+ *                              (canvas_size_x) x (canvas_size_y)
+ * @param[in]   canvas_size_x   canvas width in pixel
+ * @param[in]   canvas_size_y   canvas height in pixel
+ * @param[out]  path            pointer to path buffer
+ * @return                      none
+ */
+static void img_resize(cartesian_coord* path, uint16_t canvas_size_x,
+                        uint16_t canvas_size_y)
+{
+	// calculate resize coefficient
+	float resize_coeff_x = (float)canvas_size_x/plan_length_px;
+	float resize_coeff_y = (float)canvas_size_y/plan_height_px;
+	float resize_coeff;
+
+	if (resize_coeff_x > resize_coeff_y)
+		resize_coeff = resize_coeff_y;
+	else
+		resize_coeff = resize_coeff_x;
+
+	// resize each position in path buffer
+	uint16_t path_length = data_get_length();
+	for (uint16_t i = 0; i < path_length; ++i) {
+		path[i].x *= resize_coeff;
+		path[i].y *= resize_coeff;
+	}
+
+}
+
+
+/**
+ * @brief                       thins the edges of an edge image, traces their
+ *                              contours, prunes the short ones, sets their
+ *                              color and optimizes them
+ * @param[in]   img_edges       edge image (output of the last canny_edge()
+ *                              call), modified
+ * @param[in]   color           color buffer (output of canny_edge)
+ * @param[in]   tile            true if the image is a tile of a mosaic
+ * @param[out]  size_edges      size (length) of edges buffer
+ * @param[in]   hook            called after each stage (may be NULL)
+ * @return                      number of points of the optimized contours, 0
+ *                              if there is no edge or no stroke left by the
+ *                              pruning (the store and edges are then not
+ *                              allocated)
+ */
+static uint16_t trace_contours(edge_map* img_edges, uint8_t* color, bool tile,
+                               uint16_t* size_edges, stage_hook hook)
+{
+	uint16_t size_contours = 0;
+
+	// a stroke thicker than one pixel would be traced (and drawn) twice, side
+	// by side
+	if (thinning) {
+		edge_map* scratch = arena_malloc(sizeof(edge_map));
+		if (scratch != NULL)
+			edge_map_thin(img_edges, scratch);
+		arena_free(scratch);
+
+		if (hook != NULL)
+			hook(STAGE_THINNING, NULL, 0);
+	}
+
+	// number of active pixels
+	uint16_t nb_pixels = edge_map_count(img_edges);
+
+	// bounding box of the active pixels, from the connected components found
+	// by the hysteresis
+	const edge_component* components;
+	uint16_t nb_components = canny_components(&components);
+
+	edge_component area = {0, IM_LENGTH_PX, 0, IM_HEIGHT_PX, 0};
+	for (uint16_t i = 0; i < nb_components; ++i) {
+		if (components[i].x_min < area.x_min)
+			area.x_min = components[i].x_min;
+		if (components[i].x_max > area.x_max)
+			area.x_max = components[i].x_max;
+		if (components[i].y_min < area.y_min)
+			area.y_min = components[i].y_min;
+		if (components[i].y_max > area.y_max)
+			area.y_max = components[i].y_max;
+	}
+	canny_free_components();
+
+	*size_edges = 0;
+	if (nb_pixels == 0)
+		return 0;
+
+	// half a byte per move and a contour for about 20 pixels
+	if (!path_tracing(img_edges, area, nb_pixels, &size_contours))
+		return 0;
+	tracing.contours += store.nb_chains;
+	tracing.points += size_contours;
+	tracing.store_bytes += store.capacity;
+
+	// too many edges for the arena budget: no path for this frame
+	edges = arena_malloc(2*store.nb_chains*sizeof(edge_pos));
+	if (edges == NULL) {
+		arena_free(store.codes);
+		return 0;
+	}
+	for (uint16_t i = 0; i < store.nb_chains; ++i) {
+		edges[2*i] = (edge_pos){store.chains[i].pos, i};
+		edges[2*i+1] = (edge_pos){chain_end(&store, &store.chains[i]), i};
+	}
+	*size_edges = 2*store.nb_chains;
+
+	if (hook != NULL)
+		hook(STAGE_TRACING, NULL, 0);
+
+	// remove the short strokes, each of them would cost a pen up and down
+	prune_contours(size_edges, tile);
+	if (*size_edges == 0) {
+		arena_free(edges);
+		arena_free(store.codes);
+		return 0;
+	}
+	store_shrink();
+	edges = arena_realloc(edges, *size_edges*sizeof(edge_pos));
+
+	if (hook != NULL)
+		hook(STAGE_PRUNING, NULL, 0);
+
+	// set color of each contour
+	set_contours_color(color);
+
+	// optimize contour by deleting redundant positions, their codes are kept
+	uint16_t opt_contours_size = path_optimization();
+
+	if (hook != NULL)
+		hook(STAGE_OPTIMIZATION, NULL, 0);
+
+	return opt_contours_size;
+}
+
+/**
+ * @brief                       time taken by the carousel to change the pen
+ * @param[in]   from, to        colors of the pens (black to blue)
+ * @return                      time in ms
+ */
+static uint32_t carousel_ms(uint8_t from, uint8_t to)
+{
+	int16_t steps = carousel_steps[to - black] - carousel_steps[from - black];
+	return (uint32_t)abs(steps)*1000/CAROUSEL_SPEED_ST;
+}
+
+/**
+ * @brief                       orders contours by nearest neighbour, through
+ *                              the grid of their extremities or, if it does
+ *                              not fit, by scanning them all
+ * @param[in,out] first         first extremity of the contours (pairs of edges)
+ * @param[out]  first_status    status of the first extremity
+ * @param[in]   size            number of extremities
+ * @param[in]   from            position of the pen before them
+ * @return                      none
+ */
+static void order_nearest(edge_pos* first, uint8_t* first_status, uint16_t size,
+                          cartesian_coord from)
+{
+	if (!path_order_nearest(first, first_status, size, from))
+		path_order_nearest_scan(first, first_status, size, from);
+}
+
+/**
+ * @brief                       draws contours ordered by order_nearest() in
+ *                              the direction they were traced again, the
+ *                              status of their first extremity back to start
+ * @param[in,out] first         first extremity of the contours
+ * @param[in,out] first_status  status of the first extremity
+ * @param[in]   size            number of extremities
+ * @return                      none
+ */
+static void reset_orientation(edge_pos* first, uint8_t* first_status, uint16_t size)
+{
+	for (uint16_t i = 0; i < size; i += 2) {
+		if (first_status[i] == end) {
+			edge_pos temp = first[i];
+			first[i] = first[i+1];
+			first[i+1] = temp;
+			first_status[i] = start;
+		}
+	}
+}
+
+/**
+ * @brief                       groups the contours by color and orders each
+ *                              group by nearest neighbour from the end of the
+ *                              previous one
+ * @param[in]   size_edges      size (length) of edges buffer
+ * @param[out]  group_size      extremities of each group, in the drawing order
+ * @return                      number of groups, 0 if the work buffer does
+ *                              not fit (the edges are left unordered)
+ * @details                     The groups are drawn in the order of the
+ *                              lowest predicted time: the pen up travel of
+ *                              their nearest neighbour orders and the turns of
+ *                              the carousel, every order of the colors used is
+ *                              tried.
+ */
+static uint8_t group_by_color(uint16_t size_edges, uint16_t* group_size)
+{
+	edge_pos* sorted = arena_malloc(size_edges*sizeof(edge_pos));
+	if (sorted == NULL)
+		return 0;
+
+	// counting sort of the contours by color, in the order of the carousel
+	uint16_t start[NB_PEN_COLORS] = {0};
+	uint16_t size[NB_PEN_COLORS] = {0};
+	for (uint16_t i = 0; i < size_edges; i += 2)
+		size[store.chains[edges[i].index].color - black] += 2;
+	for (uint8_t c = 1; c < NB_PEN_COLORS; ++c)
+		start[c] = start[c-1] + size[c-1];
+	uint16_t next[NB_PEN_COLORS];
+	memcpy(next, start, sizeof(next));
+	for (uint16_t i = 0; i < size_edges; i += 2) {
+		uint8_t c = store.chains[edges[i].index].color - black;
+		sorted[next[c]++] = edges[i];
+		sorted[next[c]++] = edges[i+1];
+	}
+	memcpy(edges, sorted, size_edges*sizeof(edge_pos));
+
+	// colors used
+	uint8_t colors[NB_PEN_COLORS];
+	uint8_t nb_groups = 0;
+	for (uint8_t c = 0; c < NB_PEN_COLORS; ++c) {
+		if (size[c] > 0)
+			colors[nb_groups++] = c;
+	}
+
+	// predicted time of each order of the groups, the first order is the one
+	// of the carousel
+	float ms_per_px = canvas_scale()*CART_TO_ST*1000/DRAW_SPEED_ST;
+	uint8_t best[NB_PEN_COLORS];
+	float best_ms = FLT_MAX;
+	for (uint8_t o = 0; o < factorials[nb_groups]; ++o) {
+		uint8_t left[NB_PEN_COLORS];
+		uint8_t order[NB_PEN_COLORS];
+		memcpy(left, colors, nb_groups);
+		uint8_t rank = o;
+		for (uint8_t j = 0; j < nb_groups; ++j) {
+			uint8_t f = factorials[nb_groups - 1 - j];
+			uint8_t k = rank/f;
+			rank %= f;
+			order[j] = left[k];
+			memmove(&left[k], &left[k+1], nb_groups - 1 - j - k);
+		}
+
+		float ms = 0;
+		cartesian_coord from = initial_position();
+		uint8_t pen = black;
+		for (uint8_t j = 0; j < nb_groups; ++j) {
+			uint8_t c = order[j];
+			order_nearest(&edges[start[c]], &status[start[c]], size[c], from);
+			ms += path_order_travel(&edges[start[c]], size[c], from)*ms_per_px
+			      + carousel_ms(pen, black + c);
+			from = edges[start[c] + size[c] - 1].pos;
+			pen = black + c;
+			reset_orientation(&edges[start[c]], &status[start[c]], size[c]);
+		}
+		ms += carousel_ms(pen, black);
+		if (ms < best_ms) {
+			best_ms = ms;
+			memcpy(best, order, nb_groups);
+		}
+	}
+
+	// the groups in the best order, each one ordered again from the end of
+	// the previous one
+	uint16_t first = 0;
+	for (uint8_t j = 0; j < nb_groups; ++j) {
+		uint8_t c = best[j];
+		memcpy(&sorted[first], &edges[start[c]], size[c]*sizeof(edge_pos));
+		group_size[j] = size[c];
+		first += size[c];
+	}
+	memcpy(edges, sorted, size_edges*sizeof(edge_pos));
+	arena_free(sorted);
+
+	first = 0;
+	for (uint8_t j = 0; j < nb_groups; ++j) {
+		order_nearest(&edges[first], &status[first], group_size[j],
+		              first > 0 ? edges[first-1].pos : initial_position());
+		first += group_size[j];
+	}
+	return nb_groups;
+}
+
+/**
+ * @brief                       predicts the part of the drawing time that
+ *                              depends on the order of the contours
+ * @param[in]   order           contours in the drawing order, the drawn
+ *                              extremity first
+ * @param[in]   order_status    status of their extremities
+ * @param[in]   size_edges      number of extremities
+ * @return                      time of the pen up moves and of the turns of
+ *                              the carousel in ms
+ * @note                        Same model as predict_drawing(), the strokes
+ *                              and pen cycles are the same in every order. The
+ *                              contours of a run (tiled capture) may have
+ *                              several colors, drawn in the order of the run.
+ */
+static float order_ms(const edge_pos* order, const uint8_t* order_status,
+                      uint16_t size_edges)
+{
+	float ms_per_px = canvas_scale()*CART_TO_ST*1000/DRAW_SPEED_ST;
+	float ms = path_order_travel(order, size_edges, initial_position())*ms_per_px;
+	uint8_t pen = black;
+	for (uint16_t i = 0; i < size_edges; i += 2) {
+		uint16_t first = order[i].index;
+		uint16_t last = first;
+		while (store.chains[last].links & CHAIN_JOINED)
+			++last;
+		for (uint16_t j = 0; j <= last - first; ++j) {
+			uint8_t color = store.chains[order_status[i] == start ? first + j : last - j].color;
+			ms += carousel_ms(pen, color);
+			pen = color;
+		}
+	}
+	return ms + carousel_ms(pen, black);
+}
+
+/**
+ * @brief                       improves the order of groups of contours, each
+ *                              one between the exit of the previous group and
+ *                              the entry of the next one
+ * @param[in,out] order         contours in the drawing order
+ * @param[in,out] order_status  status of their extremities
+ * @param[in]   group_size      extremities of each group, in the drawing order
+ * @param[in]   nb_groups       number of groups
+ * @param[in]   start_ms        time of the start of the ordering (order_clock)
+ * @param[in]   budget_ms       time allowed since start_ms
+ * @return                      number of moves made
+ */
+static uint16_t improve_groups(edge_pos* order, uint8_t* order_status,
+                               const uint16_t* group_size, uint8_t nb_groups,
+                               uint32_t start_ms, uint32_t budget_ms)
+{
+	uint16_t size_edges = 0;
+	for (uint8_t g = 0; g < nb_groups; ++g)
+		size_edges += group_size[g];
+
+	uint16_t moves = 0;
+	uint16_t first = 0;
+	for (uint8_t g = 0; g < nb_groups && budget_ms > 0; ++g) {
+		uint32_t elapsed = order_clock != NULL ? order_clock() - start_ms : 0;
+		if (elapsed >= budget_ms)
+			break;
+		// the first extremity of the next group stays where it is
+		uint16_t next = first + group_size[g];
+		moves += path_order_improve(&order[first], &order_status[first], group_size[g],
+		                            first > 0 ? order[first-1].pos : initial_position(),
+		                            next < size_edges ? &order[next].pos : NULL,
+		                            order_clock, budget_ms - elapsed);
+		first = next;
+	}
+	return moves;
+}
+
+/**
+ * @brief                       predicts the drawing of the path: pen changes
+ *                              and time
+ * @param[in]   path            path in canvas pixels
+ * @param[in]   color           colors of the path
+ * @param[in]   length          length of the path
+ * @return                      none
+ * @note                        Same model as the pruning: moves at the speed
+ *                              of the motors, a pen cycle per contour and the
+ *                              turns of the carousel.
+ */
+static void predict_drawing(const cartesian_coord* path, const uint8_t* color,
+                            uint16_t length)
+{
+	float move_px = 0;
+	uint32_t pen_ms = 0;
+	uint8_t pen = black;
+	for (uint16_t i = 1; i < length; ++i) {
+		move_px += two_point_distance(path[i-1], path[i]);
+		if (color[i] == white) {
+			pen_ms += PEN_CYCLE_MS;
+		} else if (color[i] != pen) {
+			++ordering.color_changes;
+			pen_ms += carousel_ms(pen, color[i]);
+			pen = color[i];
+		}
+	}
+	pen_ms += carousel_ms(pen, black);
+	ordering.total_ms = move_px*CART_TO_ST*1000/DRAW_SPEED_ST + pen_ms;
+}
+
+/**
+ * @brief                       orders the optimized contours, stores the path
+ *                              and its colors in mod_data and frees the store
+ *                              and edges
+ * @param[in]   opt_contours_size number of points of the optimized contours
+ * @param[in]   size_edges      size (length) of edges buffer
+ * @param[in]   hook            called after the ordering (may be NULL)
+ * @return                      length of the path, 0 if the arena budget is
+ *                              exceeded (the store and edges are freed)
+ */
+static uint16_t order_path(uint16_t opt_contours_size, uint16_t size_edges,
+                           stage_hook hook)
+{
+	// reorder the edges to minimize travel distance
+	status = arena_calloc(size_edges, sizeof(uint8_t));
+	if (status == NULL) {
+		arena_free(edges);
+		arena_free(store.codes);
+		return 0;
+	}
+	uint32_t start_ms = order_clock != NULL ? order_clock() : 0;
+
+	// the contours are also ordered without groups, this order is drawn if it
+	// is predicted faster (it is skipped if it does not fit)
+	edge_pos* plain = NULL;
+	uint8_t* plain_status = NULL;
+	if (color_grouping) {
+		plain = arena_malloc(size_edges*sizeof(edge_pos));
+		plain_status = arena_calloc(size_edges, sizeof(uint8_t));
+		if (plain != NULL && plain_status != NULL)
+			memcpy(plain, edges, size_edges*sizeof(edge_pos));
+	}
+
+	uint16_t group_size[NB_PEN_COLORS];
+	uint8_t nb_groups = color_grouping ? group_by_color(size_edges, group_size) : 0;
+	if (nb_groups == 0) {
+		order_nearest(edges, status, size_edges, initial_position());
+		group_size[0] = size_edges;
+		nb_groups = 1;
+	}
+	if (nb_groups == 1 || plain == NULL || plain_status == NULL) {
+		arena_free(plain_status);
+		arena_free(plain);
+		plain = NULL;
+	}
+
+	// then shorten the pen up moves left by the greedy order, within each
+	// group. Each order gets half of the time if both are improved.
+	float scale = canvas_scale();
+	float travel_before = path_order_travel(edges, size_edges, initial_position())*scale;
+	ordering.contours = size_edges/2;
+	ordering.moves = improve_groups(edges, status, group_size, nb_groups, start_ms,
+	                                plain != NULL ? order_budget_ms/2 : order_budget_ms);
+	if (plain != NULL) {
+		order_nearest(plain, plain_status, size_edges, initial_position());
+		float plain_before = path_order_travel(plain, size_edges, initial_position())*scale;
+		uint16_t moves = improve_groups(plain, plain_status, &size_edges, 1, start_ms,
+		                                order_budget_ms);
+		if (order_ms(plain, plain_status, size_edges) < order_ms(edges, status, size_edges)) {
+			memcpy(edges, plain, size_edges*sizeof(edge_pos));
+			memcpy(status, plain_status, size_edges*sizeof(uint8_t));
+			travel_before = plain_before;
+			ordering.moves = moves;
+		}
+		arena_free(plain_status);
+		arena_free(plain);
+	}
+	float travel_after = path_order_travel(edges, size_edges, initial_position())*scale;
+	ordering.travel_before = travel_before;
+	ordering.travel_after = travel_after;
+	ordering.time_ms = (travel_before - travel_after)*CART_TO_ST*1000/DRAW_SPEED_ST;
+
+	// Allocate and fill final_path and color buffers
+	uint16_t total_size = opt_contours_size + 1;
+	cartesian_coord* final_path = data_alloc_xy(total_size);
+	data_set_length(total_size);
+	total_size = data_get_length();
+
+	// the colors of the image are no longer needed
+	uint8_t* color = data_realloc_color(total_size);
+	create_final_path(color, size_edges, final_path);
+
+	img_resize(final_path, IM_MAX_WIDTH, IM_MAX_HEIGHT);
+	predict_drawing(final_path, color, total_size);
+
+	data_set_ready(true);
+
+	// free buffers
+	arena_free(status);
+	arena_free(edges);
+	arena_free(store.codes);
+
+	if (hook != NULL)
+		hook(STAGE_ORDERING, NULL, 0);
+
+	return total_size;
+}
+
+/**
+ * @brief                       returns the tile of the mosaic a pixel belongs
+ *                              to along one axis
+ * @param[in]   coord           coordinate of the pixel in the mosaic
+ * @param[in]   step            distance between two tiles
+ * @param[in]   nb_tiles        number of tiles along the axis
+ * @return                      tile index
+ * @note                        Each tile keeps the edges of its pixels
+ *                              [MARGIN_PX, MARGIN_PX + step[ (the other ones
+ *                              are cleared by the edge detection), these
+ *                              regions pave the mosaic.
+ */
+static uint8_t tile_index(uint16_t coord, uint16_t step, uint8_t nb_tiles)
+{
+	if (coord < MARGIN_PX)
+		return 0;
+	uint16_t tile = (coord - MARGIN_PX)/step;
+	return tile < nb_tiles ? tile : nb_tiles - 1;
+}
+
+/**
+ * @brief                       checks if two contour ends continue each other
+ *                              across a seam, i.e. they are neighbours and
+ *                              belong to different tiles
+ * @param[in]   a, b            positions of the ends in the mosaic
+ * @return                      true if the ends are stitched
+ */
+static bool across_seam(cartesian_coord a, cartesian_coord b)
+{
+	if (abs(a.x - b.x) > 1 || abs(a.y - b.y) > 1)
+		return false;
+	return tile_index(a.x, TILE_STEP_X, TILES_X) != tile_index(b.x, TILE_STEP_X, TILES_X)
+	       || tile_index(a.y, TILE_STEP_Y, TILES_Y) != tile_index(b.y, TILE_STEP_Y, TILES_Y);
+}
+
+/**
+ * @brief                       appends a contour of the mosaic to the store
+ * @param[in]   chain           contour of the mosaic
+ * @param[in]   reverse         true to append it from its last extremity
+ * @return                      number of its points kept by the optimization
+ */
+static uint16_t append_chain(const contour_chain* chain, bool reverse)
+{
+	contour_chain* copy = &store.chains[store.nb_chains++];
+	*copy = *chain;
+	copy->code = store.nb_codes;
+	copy->links = 0;
+	if (reverse)
+		copy->pos = chain_end(&mosaic, chain);
+
+	uint16_t points = chain->nb_codes > 0 ? 1 : 2;
+	for (uint16_t i = 0; i < chain->nb_codes; ++i) {
+		uint8_t code;
+		if (reverse) {
+			// opposite move, the point reached is the one before in the mosaic
+			uint16_t point = chain->nb_codes - 1 - i;
+			code = chain_code(mosaic.codes, chain->code + point) & CODE_DIRECTION;
+			code = (code + NB_DIRECTIONS/2) % NB_DIRECTIONS;
+			if (point == 0 || chain_code(mosaic.codes, chain->code + point - 1) & CODE_KEEP)
+				code |= CODE_KEEP;
+		} else {
+			code = chain_code(mosaic.codes, chain->code + i);
+		}
+		set_chain_code(store.codes, store.nb_codes++, code);
+		points += (code & CODE_KEEP) != 0;
+	}
+	return points;
+}
+
+/**
+ * @brief                       appends a chain of stitched mosaic contours to
+ *                              the store as one run of contours
+ * @param[in]   end             end of the first mosaic contour of the chain
+ * @param[in]   link            end stitched to each end (NO_LINK if none)
+ * @param[in]   ends            position of each end
+ * @param[in,out] chained       true for the mosaic contours already appended
+ * @param[in,out] size_contours number of points of the store
+ * @param[in,out] size_edges    size (length) of edges buffer
+ * @return                      none
+ */
+static void chain_contours(uint16_t end, const uint16_t* link, const cartesian_coord* ends,
+                           bool* chained, uint16_t* size_contours, uint16_t* size_edges)
+{
+	uint16_t first = store.nb_chains;
+	uint16_t exit;
+
+	do {
+		chained[end/2] = true;
+		// a contour entered by its last point is reversed
+		*size_contours += append_chain(&mosaic.chains[end/2], end % 2);
+		store.chains[store.nb_chains - 1].links = CHAIN_JOINED;
+		exit = end^1;
+		end = link[exit];
+	} while (end != NO_LINK && !chained[end/2]);
+
+	uint16_t last = store.nb_chains - 1;
+	cartesian_coord last_pos = ends[exit];
+	store.chains[last].links = 0;
+
+	// the chain came back to its first contour: close the loop
+	if (end != NO_LINK) {
+		store.chains[last].links = CHAIN_CLOSED;
+		last_pos = store.chains[first].pos;
+		++(*size_contours);
+	}
+
+	edges[*size_edges] = (edge_pos){store.chains[first].pos, first};
+	edges[*size_edges+1] = (edge_pos){last_pos, first};
+	*size_edges += 2;
+}
+
+/**
+ * @brief                       forgets the contours of the mosaic
+ * @return                      none
+ */
+static void forget_mosaic(void)
+{
+	mosaic = (contour_store){0};
+}
+
+/**
+ * @brief                       gives up the stitching when the arena budget is
+ *                              exceeded: frees the store, edges and mosaic
+ * @param[out]  size_edges      size (length) of edges buffer, set to 0
+ * @return                      0, no point is stored
+ * @note                        The blocks allocated above the store are freed
+ *                              before.
+ */
+static uint16_t drop_stitching(uint16_t* size_edges)
+{
+	arena_free(edges);
+	arena_free(store.codes);
+	arena_realloc_high(mosaic.codes, 0);
+	forget_mosaic();
+	*size_edges = 0;
+	return 0;
+}
+
+/**
+ * @brief                       joins the mosaic contours that continue each
+ *                              other across the seams of the tiles, fills
+ *                              the store and edges and frees the mosaic
+ * @param[out]  size_edges      size (length) of edges buffer
+ * @return                      number of points of the store
+ * @details                     A contour crossing a seam is traced as one
+ *                              contour per tile, ending on the last pixel
+ *                              kept from each tile. Those ends are neighbours,
+ *                              each of them is stitched to at most one other
+ *                              end. The chains of stitched contours are then
+ *                              copied in order (reversing the contours
+ *                              entered by their last point), each of them is
+ *                              a run of contours of the store.
+ */
+static uint16_t stitch_contours(uint16_t* size_edges)
+{
+	uint16_t nb_ends = 2*mosaic.nb_chains;
+	uint16_t size_contours = 0;
+
+	// the runs hold the contours and codes of the mosaic
+	size_t offset = chains_offset(mosaic.nb_codes);
+	size_t capacity = offset + mosaic.nb_chains*sizeof(contour_chain);
+	store = (contour_store){arena_malloc(capacity), NULL, 0, 0, capacity};
+	store.chains = (contour_chain*)(store.codes + offset);
+	edges = arena_malloc(nb_ends*sizeof(edge_pos));
+	*size_edges = 0;
+	if (store.codes == NULL || edges == NULL)
+		return drop_stitching(size_edges);
+
+	cartesian_coord* ends = arena_malloc(nb_ends*sizeof(cartesian_coord));
+	uint16_t* link = arena_malloc(nb_ends*sizeof(uint16_t));
+	uint16_t* seam_ends = arena_malloc(nb_ends*sizeof(uint16_t));
+	if (ends == NULL || link == NULL || seam_ends == NULL) {
+		arena_free(seam_ends);
+		arena_free(link);
+		arena_free(ends);
+		return drop_stitching(size_edges);
+	}
+	uint16_t nb_seam_ends = 0;
+
+	for (uint16_t e = 0; e < nb_ends; ++e) {
+		const contour_chain* chain = &mosaic.chains[e/2];
+		ends[e] = e % 2 ? chain_end(&mosaic, chain) : chain->pos;
+		link[e] = NO_LINK;
+		if (on_seam(ends[e]))
+			seam_ends[nb_seam_ends++] = e;
+	}
+
+	for (uint16_t i = 0; i < nb_seam_ends; ++i) {
+		uint16_t a = seam_ends[i];
+		for (uint16_t j = i + 1; j < nb_seam_ends && link[a] == NO_LINK; ++j) {
+			uint16_t b = seam_ends[j];
+			if (link[b] == NO_LINK && a/2 != b/2 && across_seam(ends[a], ends[b])) {
+				link[a] = b;
+				link[b] = a;
+			}
+		}
+	}
+	arena_free(seam_ends);
+
+	bool* chained = arena_calloc(nb_ends/2, sizeof(bool));
+	if (chained == NULL) {
+		arena_free(link);
+		arena_free(ends);
+		return drop_stitching(size_edges);
+	}
+
+	// open chains start from an end that is not stitched, the remaining
+	// contours form closed chains
+	for (uint8_t pass = 0; pass < 2; ++pass) {
+		for (uint16_t e = 0; e < nb_ends; ++e) {
+			if (chained[e/2] || (pass == 0 && link[e] != NO_LINK))
+				continue;
+			chain_contours(e, link, ends, chained, &size_contours, size_edges);
+		}
+	}
+
+	arena_free(chained);
+	arena_free(link);
+	arena_free(ends);
+	arena_realloc_high(mosaic.codes, 0);
+	forget_mosaic();
+
+	edges = arena_realloc(edges, *size_edges*sizeof(edge_pos));
+	return size_contours;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+uint16_t planner_path(edge_map* img_edges, uint8_t* color, stage_hook hook)
+{
+	uint16_t size_edges = 0;
+
+	plan_length_px = IM_LENGTH_PX;
+	plan_height_px = IM_HEIGHT_PX;
+	pruning = (planner_pruning){0};
+	tracing = (planner_tracing){0};
+	ordering = (planner_ordering){0};
+
+	uint16_t opt_contours_size = trace_contours(img_edges, color, false, &size_edges, hook);
+	if (opt_contours_size == 0)
+		return 0;
+
+	return order_path(opt_contours_size, size_edges, hook);
+}
+
+void planner_set_thinning(bool enable)
+{
+	thinning = enable;
+}
+
+void planner_set_min_stroke(uint8_t length)
+{
+	min_stroke_px = length;
+}
+
+void planner_set_simplification(float perp_dist, uint8_t pixel_dist)
+{
+	max_perp_dist = perp_dist;
+	if (pixel_dist > 0)
+		max_pixel_dist = pixel_dist;
+}
+
+void planner_set_ordering(uint16_t budget_ms, pipeline_clock clock)
+{
+	order_budget_ms = budget_ms;
+	order_clock = clock;
+}
+
+void planner_set_color_grouping(bool enable)
+{
+	color_grouping = enable;
+}
+
+float planner_get_scale(void)
+{
+	return canvas_scale();
+}
+
+planner_pruning planner_get_pruning(void)
+{
+	return pruning;
+}
+
+planner_ordering planner_get_ordering(void)
+{
+	return ordering;
+}
+
+planner_tracing planner_get_tracing(void)
+{
+	return tracing;
+}
+
+void planner_mosaic_begin(void)
+{
+	plan_length_px = MOSAIC_LENGTH_PX;
+	plan_height_px = MOSAIC_HEIGHT_PX;
+	pruning = (planner_pruning){0};
+	tracing = (planner_tracing){0};
+	ordering = (planner_ordering){0};
+
+	// the contours of the previous mosaic went with the last arena reset
+	forget_mosaic();
+}
+
+void planner_mosaic_add(edge_map* img_edges, uint8_t* color, uint8_t tile_x,
+                        uint8_t tile_y, stage_hook hook)
+{
+	uint16_t size_edges = 0;
+
+	if (trace_contours(img_edges, color, true, &size_edges, hook) == 0)
+		return;
+
+	uint16_t offset_x = tile_x*TILE_STEP_X;
+	uint16_t offset_y = tile_y*TILE_STEP_Y;
+
+	// the mosaic is the high block of the arena, the blocks of the tile are
+	// freed below it. The codes of the tile start on a new byte.
+	uint16_t first_code = mosaic.nb_codes + mosaic.nb_codes % CODES_PER_BYTE;
+	size_t old_offset = chains_offset(mosaic.nb_codes);
+	size_t offset = chains_offset(first_code + store.nb_codes);
+	size_t capacity = offset + (mosaic.nb_chains + store.nb_chains)*sizeof(contour_chain);
+	uint8_t* block = arena_realloc_high(mosaic.codes, capacity);
+	if (block == NULL) {
+		// the tile is dropped if the arena budget is exceeded
+		arena_free(edges);
+		arena_free(store.codes);
+		return;
+	}
+	memmove(block + offset, block + old_offset, mosaic.nb_chains*sizeof(contour_chain));
+	memcpy(block + first_code/CODES_PER_BYTE, store.codes,
+	       (store.nb_codes + CODES_PER_BYTE - 1)/CODES_PER_BYTE);
+	mosaic.codes = block;
+	mosaic.chains = (contour_chain*)(block + offset);
+	mosaic.capacity = capacity;
+
+	for (uint16_t i = 0; i < store.nb_chains; ++i) {
+		contour_chain* chain = &mosaic.chains[mosaic.nb_chains + i];
+		*chain = store.chains[i];
+		chain->pos.x += offset_x;
+		chain->pos.y += offset_y;
+		chain->code += first_code;
+	}
+	mosaic.nb_chains += store.nb_chains;
+	mosaic.nb_codes = first_code + store.nb_codes;
+
+	arena_free(edges);
+	arena_free(store.codes);
+}
+
+uint16_t planner_mosaic_path(stage_hook hook)
+{
+	uint16_t size_edges = 0;
+
+	plan_length_px = MOSAIC_LENGTH_PX;
+	plan_height_px = MOSAIC_HEIGHT_PX;
+
+	if (mosaic.nb_chains == 0)
+		return 0;
+
+	uint16_t size_contours = stitch_contours(&size_edges);
+	if (size_edges == 0)
+		return 0;
+	return order_path(size_contours, size_edges, hook);
+}
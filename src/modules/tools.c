@@ -18,12 +18,6 @@
 /* Module exported functions.                                                */
 /*===========================================================================*/
 
-uint16_t position(uint8_t pos_x, uint8_t pos_y)
-{
-	uint16_t position = pos_x + (uint16_t)pos_y*IM_LENGTH_PX;
-	return position;
-}
-
 float perpendicular_distance(struct cartesian_coord start, struct cartesian_coord end,
                              struct cartesian_coord point)
 {